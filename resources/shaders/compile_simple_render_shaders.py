@@ -14,7 +14,8 @@ if __name__ == '__main__':
     forceRecompile = "-f" in sys.argv
 
     shader_list = fromDir('geometry') + fromDir('lighting') + fromDir('postfx') + fromDir('forward')\
-        + ["culling.comp", "landscape_culling.comp", "quad3_vert.vert"]
+        + ["culling.comp", "culling_prefix.comp", "culling_scatter.comp", "depth_pyramid.comp", "landscape_culling.comp",
+           "landscape_culling_args.comp", "quad3_vert.vert"]
     
     for shader in shader_list:
         output = f"{shader}.spv"
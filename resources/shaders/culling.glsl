@@ -0,0 +1,110 @@
+#ifndef VK_GRAPHICS_BASIC_CULLING_H
+#define VK_GRAPHICS_BASIC_CULLING_H
+
+// Shared by the three static mesh culling passes, they run one after another with the same
+// descriptor sets and push constants:
+//  culling.comp         tests every instance once, counts visible ones per model
+//  culling_prefix.comp  turns the counts into ranges of the mapping buffer, writes the draws
+//  culling_scatter.comp puts visible instance ids into their model's range
+
+#define GROUP_SIZE 256
+
+// With occlusion culling the main view is culled twice a frame. The early pass draws what was
+// visible last frame, then the depth pyramid is built from that and the late pass draws only
+// what turned out visible and was not drawn yet. Shadow cascades are always culled in one go.
+#define CULL_PASS_ALL   0
+#define CULL_PASS_EARLY 1
+#define CULL_PASS_LATE  2
+
+// instanceSlots value of an instance that is not drawn
+#define INVISIBLE 0xFFFFFFFFu
+
+layout(push_constant) uniform params_t
+{
+    mat4 mProjView;
+    uint instanceCount;
+    uint modelCount;
+    uint pass;
+} params;
+
+struct IndirectCall
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int  vertexOffset;
+    uint firstInstance;
+};
+
+struct InstanceInfo
+{
+    uint modelId;
+    uint doRender;
+};
+
+layout(std430, binding = 0, set = 0) buffer instance_infos_t
+{
+    InstanceInfo instanceInfos[];
+};
+
+// top three rows of each instance matrix, see GpuInstanceTransform
+layout(std430, binding = 1, set = 0) buffer instance_matrices_t
+{
+    mat3x4 instanceMatrices[];
+};
+
+struct ModelInfo
+{
+    uint indexCount;
+    uint indexOffset;
+    uint vertexOffset;
+    float AABB[6];
+    // 16 and 32 bit index meshes are drawn from separate ranges of the indirect buffer
+    uint drawSlot;
+};
+
+layout(std430, binding = 2, set = 0) buffer model_infos_t
+{
+    ModelInfo modelInfos[];
+};
+
+
+
+layout(std430, binding = 0, set = 1) buffer indirection_t
+{
+    IndirectCall indirections[];
+};
+
+// [0] is the total visible count, model ranges start at 1
+layout(std430, binding = 1, set = 1) buffer mapping_t
+{
+    uint mappings[];
+};
+
+// visible instances per model after culling.comp, start of the model's range after culling_prefix.comp
+layout(std430, binding = 2, set = 1) buffer model_ranges_t
+{
+    uint modelRanges[];
+};
+
+// place of each instance within its model's range, or INVISIBLE
+layout(std430, binding = 3, set = 1) buffer instance_slots_t
+{
+    uint instanceSlots[];
+};
+
+
+
+// only read by the early and late passes, so views that are never occlusion culled can
+// bind the main view's set here
+
+// 1 for instances that ended up visible after last frame's late pass
+layout(std430, binding = 0, set = 2) buffer visibility_history_t
+{
+    uint visibilityHistory[];
+};
+
+// farthest depth of this frame's early pass, see depth_pyramid.comp
+layout(binding = 1, set = 2) uniform sampler2D depthPyramid;
+
+#endif // VK_GRAPHICS_BASIC_CULLING_H
@@ -15,9 +15,10 @@ layout(push_constant) uniform params_t
     mat4 mView;
 } params;
 
+// top three rows of each instance matrix, see GpuInstanceTransform
 layout(binding = 1, set = 0) buffer ModelMatrices
 {
-    mat4 modelMatrices[];
+    mat3x4 modelMatrices[];
 };
 
 layout(binding = 0, set = 1) buffer InstanceMapping
@@ -39,14 +40,13 @@ void main(void)
     const vec4 wNorm = vec4(DecodeNormal(floatBitsToInt(vPosNorm.w)),         0.0f);
     const vec4 wTang = vec4(DecodeNormal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
 
-    mat4 modelView = params.mView * modelMatrices[instanceMapping[gl_InstanceIndex]];
+    const mat3x4 model = modelMatrices[instanceMapping[gl_InstanceIndex]];
+    const mat3 normalView = mat3(params.mView) * NormalMatrix(model);
 
-    mat4 normalModelView = transpose(inverse(modelView));
-
-    vOut.sNorm    = mat3(normalModelView) * wNorm.xyz;
-    vOut.sTangent = mat3(normalModelView) * wTang.xyz;
+    vOut.sNorm    = normalView * wNorm.xyz;
+    vOut.sTangent = normalView * wTang.xyz;
     vOut.texCoord = vTexCoordAndTang.xy;
     shadingModel = 1;
 
-    gl_Position   = params.mProj * modelView * vec4(vPosNorm.xyz, 1.0f);
+    gl_Position   = params.mProj * params.mView * vec4(vec4(vPosNorm.xyz, 1.0f) * model, 1.0f);
 }
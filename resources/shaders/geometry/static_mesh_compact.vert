@@ -0,0 +1,86 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+
+#include "../unpack_attributes.h"
+
+// CompactVertex, see src/render/compact_vertex.h
+layout(location = 0) in uvec4 vPosTang;
+layout(location = 1) in vec2 vNormOct;
+layout(location = 2) in vec2 vTexCoord;
+
+layout(push_constant) uniform params_t
+{
+    mat4 mProj;
+    mat4 mView;
+} params;
+
+// top three rows of each instance matrix, see GpuInstanceTransform
+layout(binding = 1, set = 0) buffer ModelMatrices
+{
+    mat3x4 modelMatrices[];
+};
+
+struct InstanceInfo
+{
+    uint modelId;
+    uint doRender;
+};
+
+layout(std430, binding = 2, set = 0) buffer InstanceInfos
+{
+    InstanceInfo instanceInfos[];
+};
+
+struct ModelInfo
+{
+    uint indexCount;
+    uint indexOffset;
+    uint vertexOffset;
+    float AABB[6];
+    uint drawSlot;
+};
+
+layout(std430, binding = 3, set = 0) buffer ModelInfos
+{
+    ModelInfo modelInfos[];
+};
+
+layout(binding = 0, set = 1) buffer InstanceMapping
+{
+    uint instanceMapping[];
+};
+
+layout (location = 0 ) out VS_OUT
+{
+    vec3 sNorm;
+    vec3 sTangent;
+    vec2 texCoord;
+} vOut;
+
+layout (location = 3) flat out uint shadingModel;
+
+void main(void)
+{
+    const uint instId = instanceMapping[gl_InstanceIndex];
+    const ModelInfo model = modelInfos[instanceInfos[instId].modelId];
+
+    // positions are 16 bit fractions of the mesh bbox
+    const vec3 boxMin = vec3(model.AABB[0], model.AABB[1], model.AABB[2]);
+    const vec3 boxMax = vec3(model.AABB[3], model.AABB[4], model.AABB[5]);
+    const vec3 pos    = boxMin + vec3(vPosTang.xyz) * ((boxMax - boxMin) / 65535.0f);
+
+    const vec3 wNorm = DecodeOctahedral(vNormOct);
+    const vec3 wTang = DecodeOctahedral(max(unpackSnorm4x8(vPosTang.w).xy, vec2(-1.0f)));
+
+    const mat3x4 transform = modelMatrices[instId];
+    const mat3 normalView = mat3(params.mView) * NormalMatrix(transform);
+
+    vOut.sNorm    = normalView * wNorm;
+    vOut.sTangent = normalView * wTang;
+    vOut.texCoord = vTexCoord;
+    shadingModel = 1;
+
+    gl_Position   = params.mProj * params.mView * vec4(vec4(pos, 1.0f) * transform, 1.0f);
+}
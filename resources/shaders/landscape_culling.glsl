@@ -0,0 +1,56 @@
+#ifndef VK_GRAPHICS_BASIC_LANDSCAPE_CULLING_H
+#define VK_GRAPHICS_BASIC_LANDSCAPE_CULLING_H
+
+// Shared by the two landscape culling passes, run with the same descriptor sets and push constants:
+//  landscape_culling.comp       one invocation per tile, visible tiles compacted into the tile buffer
+//  landscape_culling_args.comp  turns the final tile count into the indirect draws
+
+#define GROUP_SIZE 16
+
+layout(push_constant) uniform params_t
+{
+    mat4 mProjView;
+} params;
+
+struct IndirectCall
+{
+    uint vertexCount;
+    uint instanceCount;
+    uint firstVertex;
+    uint firstInstance;
+};
+
+// (minY, maxY) for each tile, tiled linearly
+layout(std430, binding = 0, set = 0) buffer tileVerticalDims_t
+{
+    vec2 tileVerticalDims[];
+};
+
+layout(binding = 1, set = 0) uniform LandscapeInfo
+{
+    mat4 modelMat;
+    // Heightmap's dimensions
+    uint width;
+    uint height;
+    // In heightmap pixels
+    uint tileSize;
+    // Amount of grass blades per tile
+    uint grassDensity;
+} landscapeInfo;
+
+
+// Output: two inderect call structures, one for tile-based terrain rendering,
+// other for grass/bushes rendering with the appropriate density
+layout(std430, binding = 0, set = 1) buffer indirection_t
+{
+    IndirectCall landscapeIndirection;
+    IndirectCall grassInderection;
+};
+
+// Output: tile IDs tiled linearly. First element is the size.
+layout(std430, binding = 1, set = 1) buffer tiles_t
+{
+    uint tiles[];
+};
+
+#endif // VK_GRAPHICS_BASIC_LANDSCAPE_CULLING_H
@@ -20,4 +20,23 @@ vec3 DecodeNormal(uint a_data)
   return vec3(x, y, z);
 }
 
+// inverse of the octahedral mapping used by the compact vertex format
+vec3 DecodeOctahedral(vec2 a_enc)
+{
+  vec3 n = vec3(a_enc, 1.0f - abs(a_enc.x) - abs(a_enc.y));
+  const float t = max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return normalize(n);
+}
+
+// Normal matrix of a 3x4 instance transform without inverting it: the cofactor matrix is the
+// inverse transpose scaled by the determinant, normals get normalized later anyway.
+mat3 NormalMatrix(mat3x4 a_model)
+{
+  const mat3 m = mat3(transpose(a_model));
+  const mat3 cofactor = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+  return dot(m[0], cofactor[0]) < 0.0f ? -cofactor : cofactor;
+}
+
 #endif// CHIMERA_UNPACK_ATTRIBUTES_H
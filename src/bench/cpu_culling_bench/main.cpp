@@ -0,0 +1,189 @@
+// Measures CpuFrustumCuller on synthetic scenes of growing size, for every instruction set this
+// CPU has and a growing number of threads, and prints instances per second (also per core) as JSON.
+// Instances are scattered and rotated in a cube the camera looks into, the way culling_bench does it,
+// with a few of them not marked for rendering. Every SIMD result is checked against the scalar one,
+// they have to be the same set exactly.
+//
+// usage: cpu_culling_bench [--max-instances N] [--max-threads N] [--runs N] [--out result.json]
+//   --max-instances  largest instance count of the sweep, 4M by default
+//   --max-threads    hardware threads by default
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "render/cpu_culling.h"
+#include "utils/parallel.h"
+
+
+namespace
+{
+  constexpr uint32_t MODEL_COUNT = 1000;
+
+  struct Options
+  {
+    std::string outPath;
+    uint32_t maxInstances = 4000000;
+    std::size_t maxThreads = defaultWorkerCount();
+    int runs = 5;
+  };
+
+  bool parseOptions(int argc, const char** argv, Options& options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const bool hasValue = i + 1 < argc;
+      if (std::strcmp(argv[i], "--max-instances") == 0 && hasValue)
+        options.maxInstances = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+      else if (std::strcmp(argv[i], "--max-threads") == 0 && hasValue)
+        options.maxThreads = static_cast<std::size_t>(std::max(1, std::atoi(argv[++i])));
+      else if (std::strcmp(argv[i], "--runs") == 0 && hasValue)
+        options.runs = std::max(1, std::atoi(argv[++i]));
+      else if (std::strcmp(argv[i], "--out") == 0 && hasValue)
+        options.outPath = argv[++i];
+      else
+        return false;
+    }
+    return true;
+  }
+
+  // laid out the way SceneManager keeps it
+  struct SyntheticScene
+  {
+    std::vector<GpuInstanceInfo> infos;
+    std::vector<glm::mat4> matrices;
+    std::vector<LiteMath::Box4f> boxes;
+    glm::mat4 projView;
+  };
+
+  SyntheticScene makeScene(uint32_t instances)
+  {
+    SyntheticScene scene;
+    std::mt19937 rng(instances);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> extent(0.2f, 2.0f);
+    std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+    std::uniform_int_distribution<uint32_t> model(0, MODEL_COUNT - 1);
+
+    scene.boxes.resize(MODEL_COUNT);
+    for (auto& box : scene.boxes)
+    {
+      const glm::vec3 half(extent(rng), extent(rng), extent(rng));
+      box = LiteMath::Box4f(LiteMath::float4(-half.x, -half.y, -half.z, 1.0f), LiteMath::float4(half.x, half.y, half.z, 1.0f));
+    }
+
+    scene.infos.resize(instances);
+    scene.matrices.resize(instances);
+    for (uint32_t i = 0; i < instances; ++i)
+    {
+      scene.infos[i] = GpuInstanceInfo{ model(rng), i % 100 != 0 };
+      const glm::vec3 p(position(rng), position(rng), position(rng));
+      scene.matrices[i] = glm::rotate(glm::translate(glm::mat4(1.0f), p), angle(rng), glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    scene.projView = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 400.0f)
+      * glm::lookAt(glm::vec3(0.0f, 0.0f, -150.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return scene;
+  }
+
+  // best of runs, after one warm-up that also sizes the culler's chunk lists
+  double cullMs(CpuFrustumCuller& culler, const SyntheticScene& scene, int runs, std::vector<uint32_t>& visible)
+  {
+    culler.Cull(scene.projView, scene.infos, scene.matrices, scene.boxes, visible);
+
+    double best = 1e30;
+    for (int run = 0; run < runs; ++run)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      culler.Cull(scene.projView, scene.infos, scene.matrices, scene.boxes, visible);
+      const auto end = std::chrono::steady_clock::now();
+      best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+  }
+}
+
+int main(int argc, const char** argv)
+{
+  Options options;
+  if (!parseOptions(argc, argv, options))
+  {
+    std::cerr << "usage: cpu_culling_bench [--max-instances N] [--max-threads N] [--runs N] [--out result.json]" << std::endl;
+    return 1;
+  }
+
+  const CpuFrustumCuller::Isa best = CpuFrustumCuller::DetectIsa();
+  std::cerr << "best instruction set: " << CpuFrustumCuller::IsaName(best) << std::endl;
+
+  std::vector<CpuFrustumCuller::Isa> isas;
+  for (auto isa : {CpuFrustumCuller::Isa::Scalar, CpuFrustumCuller::Isa::Sse, CpuFrustumCuller::Isa::Avx})
+    if (isa <= best)
+      isas.push_back(isa);
+
+  std::vector<std::size_t> threadCounts;
+  for (std::size_t threads = 1; threads < options.maxThreads; threads *= 2)
+    threadCounts.push_back(threads);
+  threadCounts.push_back(options.maxThreads);
+
+  std::vector<uint32_t> instanceCounts;
+  for (uint64_t v = 10000; v < options.maxInstances; v *= 10)
+    instanceCounts.push_back(static_cast<uint32_t>(v));
+  instanceCounts.push_back(options.maxInstances);
+
+  std::ostringstream json;
+  json << "{\n  \"results\": [\n";
+  bool first = true;
+  bool mismatch = false;
+  for (uint32_t instances : instanceCounts)
+  {
+    const SyntheticScene scene = makeScene(instances);
+
+    std::vector<uint32_t> reference;
+    CpuFrustumCuller(1, CpuFrustumCuller::Isa::Scalar)
+      .Cull(scene.projView, scene.infos, scene.matrices, scene.boxes, reference);
+
+    for (auto isa : isas)
+    {
+      for (std::size_t threads : threadCounts)
+      {
+        CpuFrustumCuller culler(threads, isa);
+        std::vector<uint32_t> visible;
+        const double ms = cullMs(culler, scene, options.runs, visible);
+        const bool same = visible == reference;
+        mismatch = mismatch || !same;
+
+        const double perSecond = double(instances) / (ms * 1e-3);
+        char line[512];
+        std::snprintf(line, sizeof(line),
+          "%s    { \"instances\": %u, \"isa\": \"%s\", \"threads\": %zu, \"ms\": %.4f, \"instances_per_sec\": %.0f, "
+          "\"instances_per_sec_per_core\": %.0f, \"visible\": %zu, \"matches_scalar\": %s }",
+          first ? "" : ",\n", instances, CpuFrustumCuller::IsaName(isa), threads, ms, perSecond,
+          perSecond / double(threads), visible.size(), same ? "true" : "false");
+        json << line;
+        first = false;
+      }
+    }
+  }
+  json << "\n  ]\n}\n";
+
+  std::cout << json.str();
+  if (!options.outPath.empty())
+    std::ofstream(options.outPath) << json.str();
+
+  if (mismatch)
+  {
+    std::cerr << "SIMD culling differs from the scalar one for some configurations" << std::endl;
+    return 1;
+  }
+  return 0;
+}
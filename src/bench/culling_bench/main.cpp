@@ -0,0 +1,505 @@
+// Runs the static mesh culling passes (culling.comp, culling_prefix.comp, culling_scatter.comp)
+// on synthetic scenes of growing size on a headless device and prints GPU time per pass as JSON.
+// Instances are scattered in a cube the camera looks into, a good part of them ends up visible.
+// Every size runs twice: models picked at random per instance, and grouped, where each model's
+// instances are next to each other the way big vegetation or crowd batches are.
+// The visible set is checked against CpuFrustumCuller, and the draws and mapping buffer are
+// checked to hold every visible instance exactly once, in its model's range. Instances the two
+// disagree on only count as errors when their box isn't within rounding of a frustum plane.
+//
+// usage: culling_bench [--max-instances N] [--max-models N] [--runs N] [--device N] [--shaders dir] [--out result.json]
+//   --max-instances  largest instance count of the sweep, 1M by default
+//   --max-models     largest model count of the sweep, 10k by default
+//   --shaders        where the compiled culling shaders are, ../resources/shaders by default
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "vk_utils.h"
+#include "vk_buffers.h"
+#include "vk_copy.h"
+#include "vk_descriptor_sets.h"
+#include "vk_images.h"
+#include "vk_pipeline.h"
+#include "render/cpu_culling.h"
+#include "render/gpu_allocator.h"
+#include "render/scene_mgr.h"
+#include "bench/headless_device.h"
+
+
+namespace
+{
+  // GROUP_SIZE in culling.glsl
+  constexpr uint32_t GROUP_SIZE = 256;
+
+  struct Options
+  {
+    std::string shaderDir = "../resources/shaders";
+    std::string outPath;
+    uint32_t maxInstances = 1000000;
+    uint32_t maxModels = 10000;
+    int runs = 5;
+    uint32_t deviceId = 0;
+  };
+
+  bool parseOptions(int argc, const char** argv, Options& options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const bool hasValue = i + 1 < argc;
+      if (std::strcmp(argv[i], "--max-instances") == 0 && hasValue)
+        options.maxInstances = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+      else if (std::strcmp(argv[i], "--max-models") == 0 && hasValue)
+        options.maxModels = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+      else if (std::strcmp(argv[i], "--runs") == 0 && hasValue)
+        options.runs = std::max(1, std::atoi(argv[++i]));
+      else if (std::strcmp(argv[i], "--device") == 0 && hasValue)
+        options.deviceId = static_cast<uint32_t>(std::atoi(argv[++i]));
+      else if (std::strcmp(argv[i], "--shaders") == 0 && hasValue)
+        options.shaderDir = argv[++i];
+      else if (std::strcmp(argv[i], "--out") == 0 && hasValue)
+        options.outPath = argv[++i];
+      else
+        return false;
+    }
+    return true;
+  }
+
+  struct PushConstants
+  {
+    glm::mat4 projView;
+    uint32_t instanceCount;
+    uint32_t modelCount;
+    // CULL_PASS_ALL, the occlusion passes need a depth pyramid from a real frame
+    uint32_t pass;
+  };
+
+  // everything one view's culling reads and writes, laid out the way SceneManager and SimpleRender have it
+  struct SyntheticScene
+  {
+    std::vector<GpuInstanceInfo> infos;
+    std::vector<GpuInstanceTransform> transforms;
+    std::vector<GpuMeshInfo> models;
+    glm::mat4 projView;
+  };
+
+  SyntheticScene makeScene(uint32_t instances, uint32_t models, bool grouped)
+  {
+    SyntheticScene scene;
+    std::mt19937 rng(instances ^ (models << 20));
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_int_distribution<uint32_t> model(0, models - 1);
+
+    scene.models.resize(models);
+    for (uint32_t i = 0; i < models; ++i)
+    {
+      scene.models[i] = GpuMeshInfo{
+        .indexCount = 36,
+        .indexOffset = 36 * i,
+        .vertexOffset = 8 * i,
+        .AABB_min = glm::vec3(-1.0f),
+        .AABB_max = glm::vec3(1.0f),
+        .drawSlot = i,
+      };
+    }
+
+    scene.infos.resize(instances);
+    scene.transforms.resize(instances);
+    for (uint32_t i = 0; i < instances; ++i)
+    {
+      const uint32_t modelId = grouped ? static_cast<uint32_t>(uint64_t(i) * models / instances) : model(rng);
+      scene.infos[i] = GpuInstanceInfo{ modelId, VK_TRUE };
+      const glm::vec3 p(position(rng), position(rng), position(rng));
+      scene.transforms[i].rows[0] = glm::vec4(1, 0, 0, p.x);
+      scene.transforms[i].rows[1] = glm::vec4(0, 1, 0, p.y);
+      scene.transforms[i].rows[2] = glm::vec4(0, 0, 1, p.z);
+    }
+
+    scene.projView = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 400.0f)
+      * glm::lookAt(glm::vec3(0.0f, 0.0f, -150.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return scene;
+  }
+
+  // culling.comp's test with the frustum grown (slack > 0) or shrunk (slack < 0)
+  bool isOutsideOnCpu(const SyntheticScene& scene, std::size_t i, float slack)
+  {
+    const auto& box = scene.models[scene.infos[i].mesh_id];
+    const auto& rows = scene.transforms[i].rows;
+
+    bool left = true, right = true, top = true, bottom = true, front = true, back = true;
+    for (uint32_t j = 0; j < 8; ++j)
+    {
+      const glm::vec4 corner(
+        (j & 4) ? box.AABB_max.x : box.AABB_min.x,
+        (j & 2) ? box.AABB_max.y : box.AABB_min.y,
+        (j & 1) ? box.AABB_max.z : box.AABB_min.z,
+        1.0f);
+      const glm::vec3 world(glm::dot(corner, rows[0]), glm::dot(corner, rows[1]), glm::dot(corner, rows[2]));
+      glm::vec4 p = scene.projView * glm::vec4(world, 1.0f);
+      p /= std::abs(p.w);
+      left   = left   && p.x < -1 - slack;
+      right  = right  && p.x > 1 + slack;
+      top    = top    && p.y < -1 - slack;
+      bottom = bottom && p.y > 1 + slack;
+      front  = front  && p.z > 1 + slack;
+      back   = back   && p.z < -slack;
+    }
+    return left || right || top || bottom || front || back;
+  }
+
+  // the same scene the way SceneManager keeps it on the CPU
+  std::vector<uint32_t> cullOnCpu(const SyntheticScene& scene)
+  {
+    std::vector<glm::mat4> matrices(scene.transforms.size());
+    for (std::size_t i = 0; i < matrices.size(); ++i)
+    {
+      matrices[i] = glm::mat4(1.0f);
+      for (int row = 0; row < 3; ++row)
+        for (int col = 0; col < 4; ++col)
+          matrices[i][col][row] = scene.transforms[i].rows[row][col];
+    }
+
+    std::vector<LiteMath::Box4f> boxes(scene.models.size());
+    for (std::size_t i = 0; i < boxes.size(); ++i)
+    {
+      const auto& model = scene.models[i];
+      boxes[i] = LiteMath::Box4f(
+        LiteMath::float4(model.AABB_min.x, model.AABB_min.y, model.AABB_min.z, 1.0f),
+        LiteMath::float4(model.AABB_max.x, model.AABB_max.y, model.AABB_max.z, 1.0f));
+    }
+
+    std::vector<uint32_t> visible;
+    CpuFrustumCuller culler;
+    culler.Cull(scene.projView, scene.infos, matrices, boxes, visible);
+    return visible;
+  }
+
+  // GPU rounding (division in particular) isn't IEEE exact, so a box touching a plane may go either way
+  struct Parity
+  {
+    uint32_t borderline = 0;
+    uint32_t wrong = 0;
+  };
+
+  Parity compareVisibleSets(const SyntheticScene& scene, const std::vector<uint32_t>& mappings,
+    const std::vector<uint32_t>& cpuVisible)
+  {
+    std::vector<uint32_t> gpuVisible(mappings.begin() + 1,
+      mappings.begin() + 1 + std::min<std::size_t>(mappings[0], mappings.size() - 1));
+    std::sort(gpuVisible.begin(), gpuVisible.end());
+
+    std::vector<uint32_t> differ;
+    std::set_symmetric_difference(gpuVisible.begin(), gpuVisible.end(), cpuVisible.begin(), cpuVisible.end(),
+      std::back_inserter(differ));
+
+    Parity parity;
+    for (uint32_t i : differ)
+    {
+      const bool nearPlane = i < scene.infos.size()
+        && isOutsideOnCpu(scene, i, 1e-4f) != isOutsideOnCpu(scene, i, -1e-4f);
+      ++(nearPlane ? parity.borderline : parity.wrong);
+    }
+    return parity;
+  }
+
+  struct Result
+  {
+    uint32_t instances = 0;
+    uint32_t models = 0;
+    bool grouped = false;
+    double cullMs = 0.0;
+    double prefixMs = 0.0;
+    double scatterMs = 0.0;
+    double totalMs = 0.0;
+    uint32_t gpuVisible = 0;
+    uint32_t cpuVisible = 0;
+    Parity parity;
+    bool rangesOk = false;
+  };
+
+  bool checkRanges(const SyntheticScene& scene, const std::vector<VkDrawIndexedIndirectCommand>& draws,
+    const std::vector<uint32_t>& mappings)
+  {
+    std::vector<char> seen(scene.infos.size(), 0);
+    uint64_t total = 0;
+    for (uint32_t m = 0; m < draws.size(); ++m)
+    {
+      const auto& draw = draws[scene.models[m].drawSlot];
+      if (draw.firstInstance + uint64_t(draw.instanceCount) > mappings.size())
+        return false;
+      for (uint32_t k = draw.firstInstance; k < draw.firstInstance + draw.instanceCount; ++k)
+      {
+        const uint32_t instance = mappings[k];
+        if (instance >= seen.size() || seen[instance] || scene.infos[instance].mesh_id != m)
+          return false;
+        seen[instance] = 1;
+      }
+      total += draw.instanceCount;
+    }
+    return total == mappings[0];
+  }
+
+  Result runConfig(const HeadlessDevice& headless, const Options& options, uint32_t instances, uint32_t models,
+    bool grouped)
+  {
+    const VkDevice device = headless.device;
+    const SyntheticScene scene = makeScene(instances, models, grouped);
+
+    GpuAllocator allocator(device, headless.physDevice);
+    vk_utils::PingPongCopyHelper copyHelper(headless.physDevice, device, headless.queue,
+      headless.queueFamilyIDXs.graphics, 64 * 1024 * 1024);
+
+    constexpr VkBufferUsageFlags usage =
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    std::array buffers{
+      vk_utils::createBuffer(device, sizeof(GpuInstanceInfo) * instances, usage),
+      vk_utils::createBuffer(device, sizeof(GpuInstanceTransform) * instances, usage),
+      vk_utils::createBuffer(device, sizeof(GpuMeshInfo) * models, usage),
+      vk_utils::createBuffer(device, sizeof(VkDrawIndexedIndirectCommand) * models, usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT),
+      vk_utils::createBuffer(device, sizeof(uint32_t) * (instances + 1), usage),
+      vk_utils::createBuffer(device, sizeof(uint32_t) * models, usage),
+      vk_utils::createBuffer(device, sizeof(uint32_t) * instances, usage),
+    };
+    GpuAllocation memory = allocator.AllocateAndBind(std::vector<VkBuffer>(buffers.begin(), buffers.end()));
+
+    copyHelper.UpdateBuffer(buffers[0], 0, scene.infos.data(), sizeof(GpuInstanceInfo) * instances);
+    copyHelper.UpdateBuffer(buffers[1], 0, scene.transforms.data(), sizeof(GpuInstanceTransform) * instances);
+    copyHelper.UpdateBuffer(buffers[2], 0, scene.models.data(), sizeof(GpuMeshInfo) * models);
+
+    // set 2 is only read by the occlusion passes, it just has to be bound
+    VkBuffer historyBuffer = vk_utils::createBuffer(device, sizeof(uint32_t), usage);
+    GpuAllocation historyMemory = allocator.AllocateAndBind(std::vector<VkBuffer>{historyBuffer});
+    vk_utils::VulkanImageMem pyramid{};
+    pyramid.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    allocator.CreateImage(1, 1, VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_SAMPLED_BIT, &pyramid);
+    VkSampler pyramidSampler = vk_utils::createSampler(device, VK_FILTER_NEAREST,
+      VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK);
+
+    vk_utils::DescriptorMaker bindings(device,
+      {{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8}, {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}}, 3);
+    VkDescriptorSet sceneSet, outputSet, occlusionSet;
+    VkDescriptorSetLayout sceneLayout, outputLayout, occlusionLayout;
+    bindings.BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+    for (uint32_t i = 0; i < 3; ++i)
+      bindings.BindBuffer(i, buffers[i]);
+    bindings.BindEnd(&sceneSet, &sceneLayout);
+    bindings.BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+    for (uint32_t i = 0; i < 4; ++i)
+      bindings.BindBuffer(i, buffers[3 + i]);
+    bindings.BindEnd(&outputSet, &outputLayout);
+    bindings.BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+    bindings.BindBuffer(0, historyBuffer);
+    bindings.BindImage(1, pyramid.view, pyramidSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_IMAGE_LAYOUT_GENERAL);
+    bindings.BindEnd(&occlusionSet, &occlusionLayout);
+
+    std::array<VkPipelineLayout, 3> layouts{};
+    std::array<VkPipeline, 3> pipelines{};
+    const std::array shaders{"culling.comp.spv", "culling_prefix.comp.spv", "culling_scatter.comp.spv"};
+    for (std::size_t i = 0; i < shaders.size(); ++i)
+    {
+      vk_utils::ComputePipelineMaker maker;
+      maker.LoadShader(device, options.shaderDir + "/" + shaders[i]);
+      layouts[i] = maker.MakeLayout(device, {sceneLayout, outputLayout, occlusionLayout}, sizeof(PushConstants));
+      pipelines[i] = maker.MakePipeline(device);
+    }
+
+    VkQueryPoolCreateInfo queryInfo{
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = 4,
+    };
+    VkQueryPool queries;
+    VK_CHECK_RESULT(vkCreateQueryPool(device, &queryInfo, nullptr, &queries));
+
+    VkCommandPool cmdPool = vk_utils::createCommandPool(device, headless.queueFamilyIDXs.graphics,
+      VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+    const PushConstants pushConsts{ scene.projView, instances, models, 0 };
+    const uint32_t instanceGroups = (instances + GROUP_SIZE - 1) / GROUP_SIZE;
+
+    auto barrier = [](VkCommandBuffer cmd, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess)
+    {
+      VkMemoryBarrier memoryBarrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+      };
+      vkCmdPipelineBarrier(cmd, srcStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {}, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    };
+
+    Result result;
+    result.instances = instances;
+    result.models = models;
+    result.grouped = grouped;
+    result.totalMs = 1e30;
+    for (int run = 0; run < options.runs; ++run)
+    {
+      VkCommandBuffer cmd = vk_utils::createCommandBuffer(device, cmdPool);
+      VkCommandBufferBeginInfo beginInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+      };
+      VK_CHECK_RESULT(vkBeginCommandBuffer(cmd, &beginInfo));
+      vkCmdResetQueryPool(cmd, queries, 0, 4);
+
+      VkImageMemoryBarrier pyramidLayout{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = pyramid.image,
+        .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
+      };
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {},
+        0, nullptr, 0, nullptr, 1, &pyramidLayout);
+
+      // same sequence as SimpleRender::RecordStaticMeshCulling
+      vkCmdFillBuffer(cmd, buffers[5], 0, VK_WHOLE_SIZE, 0);
+      barrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+      vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries, 0);
+
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layouts[0], 0, 1, &sceneSet, 0, nullptr);
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layouts[0], 1, 1, &outputSet, 0, nullptr);
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layouts[0], 2, 1, &occlusionSet, 0, nullptr);
+      vkCmdPushConstants(cmd, layouts[0], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConsts), &pushConsts);
+
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0]);
+      vkCmdDispatch(cmd, instanceGroups, 1, 1);
+      barrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+      vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, queries, 1);
+
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[1]);
+      vkCmdDispatch(cmd, 1, 1, 1);
+      barrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+      vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, queries, 2);
+
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[2]);
+      vkCmdDispatch(cmd, instanceGroups, 1, 1);
+      vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries, 3);
+
+      VK_CHECK_RESULT(vkEndCommandBuffer(cmd));
+      vk_utils::executeCommandBufferNow(cmd, headless.queue, device);
+      vkFreeCommandBuffers(device, cmdPool, 1, &cmd);
+
+      std::array<uint64_t, 4> stamps{};
+      VK_CHECK_RESULT(vkGetQueryPoolResults(device, queries, 0, 4, sizeof(stamps), stamps.data(), sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+      auto ms = [&](int from, int to) { return double(stamps[to] - stamps[from]) * headless.timestampPeriod * 1e-6; };
+
+      if (ms(0, 3) < result.totalMs)
+      {
+        result.cullMs    = ms(0, 1);
+        result.prefixMs  = ms(1, 2);
+        result.scatterMs = ms(2, 3);
+        result.totalMs   = ms(0, 3);
+      }
+    }
+
+    std::vector<VkDrawIndexedIndirectCommand> draws(models);
+    std::vector<uint32_t> mappings(instances + 1);
+    copyHelper.ReadBuffer(buffers[3], 0, draws.data(), sizeof(draws[0]) * draws.size());
+    copyHelper.ReadBuffer(buffers[4], 0, mappings.data(), sizeof(mappings[0]) * mappings.size());
+    result.gpuVisible = mappings[0];
+    const std::vector<uint32_t> cpuVisible = cullOnCpu(scene);
+    result.cpuVisible = static_cast<uint32_t>(cpuVisible.size());
+    result.parity     = compareVisibleSets(scene, mappings, cpuVisible);
+    result.rangesOk   = checkRanges(scene, draws, mappings);
+
+    vkDestroyCommandPool(device, cmdPool, nullptr);
+    vkDestroyQueryPool(device, queries, nullptr);
+    for (std::size_t i = 0; i < pipelines.size(); ++i)
+    {
+      vkDestroyPipeline(device, pipelines[i], nullptr);
+      vkDestroyPipelineLayout(device, layouts[i], nullptr);
+    }
+    for (auto buffer : buffers)
+      vkDestroyBuffer(device, buffer, nullptr);
+    allocator.Free(memory);
+    vkDestroyBuffer(device, historyBuffer, nullptr);
+    allocator.Free(historyMemory);
+    allocator.DestroyImage(&pyramid);
+    vkDestroySampler(device, pyramidSampler, nullptr);
+    return result;
+  }
+}
+
+int main(int argc, const char** argv)
+{
+  Options options;
+  if (!parseOptions(argc, argv, options))
+  {
+    std::cerr << "usage: culling_bench [--max-instances N] [--max-models N] [--runs N] [--device N] [--shaders dir] [--out result.json]" << std::endl;
+    return 1;
+  }
+
+  HeadlessDevice headless(options.deviceId, "culling_bench");
+
+  // decades up to the maximum, the maximum itself always included
+  auto sweep = [](uint32_t from, uint32_t max) {
+    std::vector<uint32_t> values;
+    for (uint64_t v = from; v < max; v *= 10)
+      values.push_back(static_cast<uint32_t>(v));
+    values.push_back(max);
+    return values;
+  };
+
+  std::ostringstream json;
+  json << "{\n  \"results\": [\n";
+  bool first = true;
+  bool mismatch = false;
+  bool broken = false;
+  for (uint32_t instances : sweep(1000, options.maxInstances))
+  {
+    for (uint32_t models : sweep(1, options.maxModels))
+    {
+      if (models > instances)
+        continue;
+
+      for (bool grouped : {false, true})
+      {
+        const Result r = runConfig(headless, options, instances, models, grouped);
+        mismatch = mismatch || r.parity.borderline > 0;
+        broken = broken || !r.rangesOk || r.parity.wrong > 0;
+
+        char line[512];
+        std::snprintf(line, sizeof(line),
+          "%s    { \"instances\": %u, \"models\": %u, \"layout\": \"%s\", \"cull_ms\": %.4f, \"prefix_ms\": %.4f, "
+          "\"scatter_ms\": %.4f, \"total_ms\": %.4f, \"ns_per_instance\": %.4f, \"gpu_visible\": %u, \"cpu_visible\": %u, "
+          "\"borderline\": %u, \"wrong\": %u, \"ranges_ok\": %s }",
+          first ? "" : ",\n", r.instances, r.models, r.grouped ? "grouped" : "random", r.cullMs, r.prefixMs,
+          r.scatterMs, r.totalMs, r.totalMs * 1e6 / double(r.instances), r.gpuVisible, r.cpuVisible,
+          r.parity.borderline, r.parity.wrong, r.rangesOk ? "true" : "false");
+        json << line;
+        first = false;
+      }
+    }
+  }
+  json << "\n  ]\n}\n";
+
+  std::cout << json.str();
+  if (!options.outPath.empty())
+    std::ofstream(options.outPath) << json.str();
+
+  if (mismatch)
+    std::cerr << "GPU and CPU disagree on some instances right at a frustum plane" << std::endl;
+  if (broken)
+  {
+    std::cerr << "culling output is inconsistent or differs from the CPU for some configurations" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "vk_utils.h"
+
+
+// Vulkan instance and device without a window or swapchain, shared by the benchmarks.
+// Graphics, compute and transfer queues are requested, with timeline semaphores enabled
+// the way SimpleRender does it, since the staging ring signals one.
+struct HeadlessDevice
+{
+  VkInstance instance = VK_NULL_HANDLE;
+  VkPhysicalDevice physDevice = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  // first queue of the graphics family
+  VkQueue queue = VK_NULL_HANDLE;
+  vk_utils::QueueFID_T queueFamilyIDXs {UINT32_MAX, UINT32_MAX, UINT32_MAX};
+  float timestampPeriod = 1.0f;
+
+  HeadlessDevice(uint32_t deviceId, const char* appName)
+  {
+    VK_CHECK_RESULT(volkInitialize());
+
+    VkApplicationInfo appInfo = {};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = appName;
+    appInfo.applicationVersion = VK_MAKE_VERSION(0, 1, 0);
+    appInfo.pEngineName = appName;
+    appInfo.engineVersion = VK_MAKE_VERSION(0, 1, 0);
+    appInfo.apiVersion = VK_MAKE_VERSION(1, 2, 0);
+
+    std::vector<const char*> layers;
+    std::vector<const char*> extensions;
+    instance = vk_utils::createInstance(false, layers, extensions, &appInfo);
+    volkLoadInstance(instance);
+
+    physDevice = vk_utils::findPhysicalDevice(instance, true, deviceId, extensions);
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physDevice, &props);
+    std::cerr << "device: " << props.deviceName << std::endl;
+    timestampPeriod = props.limits.timestampPeriod;
+
+    VkPhysicalDeviceFeatures features = {};
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timelineFeatures.timelineSemaphore = VK_TRUE;
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    indexingFeatures.pNext = &timelineFeatures;
+    device = vk_utils::createLogicalDevice(physDevice, layers, extensions, features, queueFamilyIDXs,
+                                           VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT,
+                                           &indexingFeatures);
+    volkLoadDevice(device);
+    vkGetDeviceQueue(device, queueFamilyIDXs.graphics, 0, &queue);
+  }
+
+  ~HeadlessDevice()
+  {
+    vkDestroyDevice(device, nullptr);
+    vkDestroyInstance(instance, nullptr);
+  }
+
+  HeadlessDevice(const HeadlessDevice&) = delete;
+  HeadlessDevice& operator=(const HeadlessDevice&) = delete;
+};
@@ -0,0 +1,100 @@
+// Compares hydra_xml number parsing against the std::wstringstream based
+// implementation it replaced, on synthetic instance matrices and vectors.
+//
+// usage: hydra_xml_bench [matrix count, default 200000]
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "loader_utils/hydraxml.h"
+
+
+namespace
+{
+  LiteMath::float4x4 streamFloat4x4FromString(const std::wstring& matrix_str)
+  {
+    LiteMath::float4x4 result;
+    std::wstringstream inputStream(matrix_str);
+
+    float data[16];
+    for(int i = 0; i < 16; i++)
+      inputStream >> data[i];
+
+    result.set_row(0, LiteMath::float4(data[0],data[1], data[2], data[3]));
+    result.set_row(1, LiteMath::float4(data[4],data[5], data[6], data[7]));
+    result.set_row(2, LiteMath::float4(data[8],data[9], data[10], data[11]));
+    result.set_row(3, LiteMath::float4(data[12],data[13], data[14], data[15]));
+
+    return result;
+  }
+
+  // matrices formatted the way hydra writes them: rotation/scale with 6-9 significant digits and a translation
+  std::vector<std::wstring> makeMatrices(std::size_t count)
+  {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> offset(-500.0f, 500.0f);
+
+    std::vector<std::wstring> result;
+    result.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      wchar_t buffer[512];
+      swprintf(buffer, 512, L"%g %g %g %.3f %.9g %g %g %.3f %g %g %.7g %.3f 0 0 0 1",
+        unit(rng), unit(rng), unit(rng), offset(rng),
+        unit(rng), unit(rng), unit(rng), offset(rng),
+        unit(rng), unit(rng), unit(rng), offset(rng));
+      result.emplace_back(buffer);
+    }
+    return result;
+  }
+
+  template<typename F>
+  double measure(const std::vector<std::wstring>& input, std::vector<LiteMath::float4x4>& output, F&& parse)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < input.size(); ++i)
+      output[i] = parse(input[i]);
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+}
+
+int main(int argc, const char** argv)
+{
+  const std::size_t count = argc > 1 ? static_cast<std::size_t>(std::stoul(argv[1])) : 200000;
+
+  const auto input = makeMatrices(count);
+  std::size_t chars = 0;
+  for (const auto& str : input)
+    chars += str.size();
+
+  std::vector<LiteMath::float4x4> reference(count);
+  std::vector<LiteMath::float4x4> fast(count);
+
+  double streamMs = 1e30;
+  double fastMs   = 1e30;
+  for (int run = 0; run < 3; ++run)
+  {
+    streamMs = std::min(streamMs, measure(input, reference, [](const std::wstring& s) { return streamFloat4x4FromString(s); }));
+    fastMs   = std::min(fastMs, measure(input, fast, [](const std::wstring& s) { return hydra_xml::float4x4FromString(s.c_str()); }));
+  }
+
+  std::size_t mismatches = 0;
+  for (std::size_t i = 0; i < count; ++i)
+    mismatches += std::memcmp(&reference[i], &fast[i], sizeof(LiteMath::float4x4)) != 0;
+
+  const double mchars = double(chars) / 1e6;
+  std::printf("%zu matrices, %.1f M chars\n", count, mchars);
+  std::printf("%-18s %10s %12s %12s\n", "parser", "ms", "ns/matrix", "Mchars/s");
+  std::printf("%-18s %10.2f %12.1f %12.1f\n", "wstringstream", streamMs, streamMs * 1e6 / double(count), mchars / (streamMs / 1e3));
+  std::printf("%-18s %10.2f %12.1f %12.1f\n", "hydra_xml", fastMs, fastMs * 1e6 / double(count), mchars / (fastMs / 1e3));
+  std::printf("speedup %.2fx, %zu bitwise mismatches\n", streamMs / fastMs, mismatches);
+
+  return mismatches == 0 ? 0 : 1;
+}
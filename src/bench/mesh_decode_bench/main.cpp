@@ -0,0 +1,156 @@
+// Measures how mesh decoding (VSGF load + bbox) scales with the number of worker threads.
+// By default meshes are decoded into a cmesh::SimpleMesh, the way SceneManager::LoadSceneXML
+// did it before files were mapped, which is kept here as the baseline.
+//
+// usage: mesh_decode_bench <scene.xml | directory with *.vsgf> [--repeat N] [--runs N] [--max-threads N] [--mapped 0|1]
+//
+// --repeat decodes every file N times per run, which is handy to get "hundreds
+// of chunks" out of a small scene.
+// --mapped 1 measures the zero-copy path instead: map the file, compute bounds and
+// encode the vertices into a fixed size buffer, the way they are written into staging memory.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "render/mesh_decode.h"
+#include "loader_utils/hydraxml.h"
+#include "utils/parallel.h"
+
+
+static std::vector<std::string> collectMeshFiles(const std::string& source)
+{
+  std::vector<std::string> files;
+  if (std::filesystem::is_directory(source))
+  {
+    for (const auto& entry : std::filesystem::directory_iterator(source))
+    {
+      if (entry.is_regular_file() && entry.path().extension() == ".vsgf")
+        files.push_back(entry.path().string());
+    }
+    std::sort(files.begin(), files.end());
+  }
+  else
+  {
+    hydra_xml::HydraScene scene;
+    if (scene.LoadState(source) < 0)
+      return {};
+    for (auto loc : scene.MeshFiles())
+      files.push_back(loc);
+  }
+  return files;
+}
+
+static std::size_t decodeAndBound(const std::string& file)
+{
+  const auto mesh = cmesh::LoadMeshFromVSGF(file.c_str());
+  if (mesh.VerticesNum() > 0)
+  {
+    const auto bbox = computeMeshBbox(mesh);
+    (void)bbox;
+  }
+  return mesh.VerticesNum();
+}
+
+static std::size_t mapAndEncode(const std::string& file)
+{
+  // stands in for a staging ring half
+  constexpr uint32_t CHUNK_VERTICES = 64 * 1024;
+  thread_local std::vector<float> staging(CHUNK_VERTICES * 8);
+
+  auto mesh = mapMeshFile(file);
+  if (mesh.file == nullptr)
+    return 0;
+
+  const uint32_t vertNum = mesh.file->VerticesNum();
+  for (uint32_t first = 0; first < vertNum; first += CHUNK_VERTICES)
+    mesh.file->EncodeVertices8F(first, std::min(CHUNK_VERTICES, vertNum - first), staging.data());
+  return vertNum;
+}
+
+static double decodeAll(const std::vector<std::string>& files, std::size_t threads, bool mapped, std::size_t& vertexCount)
+{
+  std::vector<std::size_t> vertices(files.size());
+
+  const auto start = std::chrono::steady_clock::now();
+  parallelFor(files.size(), threads, [&](std::size_t i) {
+    vertices[i] = mapped ? mapAndEncode(files[i]) : decodeAndBound(files[i]);
+  });
+  const auto end = std::chrono::steady_clock::now();
+
+  vertexCount = 0;
+  for (auto v : vertices)
+    vertexCount += v;
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, const char** argv)
+{
+  if (argc < 2)
+  {
+    std::printf("usage: %s <scene.xml | directory> [--repeat N] [--runs N] [--max-threads N] [--mapped 0|1]\n", argv[0]);
+    return 1;
+  }
+
+  std::size_t repeat     = 1;
+  std::size_t runs       = 3;
+  std::size_t maxThreads = defaultWorkerCount();
+  bool mapped            = false;
+  for (int i = 2; i + 1 < argc; i += 2)
+  {
+    const std::string arg = argv[i];
+    const auto value = static_cast<std::size_t>(std::stoul(argv[i + 1]));
+    if (arg == "--repeat")
+      repeat = std::max<std::size_t>(value, 1);
+    else if (arg == "--runs")
+      runs = std::max<std::size_t>(value, 1);
+    else if (arg == "--max-threads")
+      maxThreads = std::max<std::size_t>(value, 1);
+    else if (arg == "--mapped")
+      mapped = value != 0;
+  }
+
+  const auto unique = collectMeshFiles(argv[1]);
+  if (unique.empty())
+  {
+    std::printf("no meshes found in %s\n", argv[1]);
+    return 1;
+  }
+
+  std::vector<std::string> files;
+  files.reserve(unique.size() * repeat);
+  for (std::size_t r = 0; r < repeat; ++r)
+    files.insert(files.end(), unique.begin(), unique.end());
+
+  std::size_t vertexCount = 0;
+  // warm up the OS file cache so that the first measured run isn't an outlier
+  decodeAll(files, maxThreads, mapped, vertexCount);
+
+  std::printf("%zu mesh files (%zu unique), %zu vertices per run, %s\n", files.size(), unique.size(), vertexCount,
+    mapped ? "mapped + encoded" : "decoded");
+  std::printf("%8s %12s %12s %10s\n", "threads", "best, ms", "median, ms", "speedup");
+
+  std::vector<std::size_t> threadCounts;
+  for (std::size_t threads = 1; threads < maxThreads; threads *= 2)
+    threadCounts.push_back(threads);
+  threadCounts.push_back(maxThreads);
+
+  double singleThreaded = 0.0;
+  for (auto threads : threadCounts)
+  {
+    std::vector<double> times;
+    for (std::size_t r = 0; r < runs; ++r)
+      times.push_back(decodeAll(files, threads, mapped, vertexCount));
+    std::sort(times.begin(), times.end());
+
+    if (threads == 1)
+      singleThreaded = times.front();
+
+    std::printf("%8zu %12.2f %12.2f %9.2fx\n", threads, times.front(), times[times.size() / 2], singleThreaded / times.front());
+  }
+
+  return 0;
+}
@@ -0,0 +1,261 @@
+// Loads a hydra scene through SceneManager::LoadSceneXML on a headless device (no window,
+// no swapchain) and prints per-phase timings and peak memory as JSON.
+// Runs fine on a software driver, e.g. VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json
+//
+// usage: scene_load_bench <scene.xml> [--runs N] [--device N] [--cache] [--compact] [--optimize-meshes] [--compare-upload] [--out result.json]
+//   --cache           lets LoadSceneXML read/write the binary scene cache, off by default so every run is cold
+//   --compact         uploads the 16 byte compact vertex format instead of Mesh8F
+//   --optimize-meshes runs the vertex cache optimization at import, the first run writes <mesh>.opt
+//                     copies next to the meshes and later runs reuse them
+//   --compare-upload  also pushes as many bytes as the load uploaded through seven ICopyEngine::UpdateBuffer
+//                     calls (how LoadGeoDataOnGPU used to do it) and through one batched StagingRing flush
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "vk_utils.h"
+#include "vk_buffers.h"
+#include "vk_copy.h"
+#include "render/scene_mgr.h"
+#include "render/staging_ring.h"
+#include "bench/headless_device.h"
+
+
+namespace
+{
+  struct Options
+  {
+    std::string scenePath;
+    std::string outPath;
+    int runs = 3;
+    uint32_t deviceId = 0;
+    bool useCache = false;
+    bool compareUpload = false;
+    bool compactVertices = false;
+    bool optimizeMeshes = false;
+  };
+
+  bool parseOptions(int argc, const char** argv, Options& options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const bool hasValue = i + 1 < argc;
+      if (std::strcmp(argv[i], "--runs") == 0 && hasValue)
+        options.runs = std::max(1, std::atoi(argv[++i]));
+      else if (std::strcmp(argv[i], "--device") == 0 && hasValue)
+        options.deviceId = static_cast<uint32_t>(std::atoi(argv[++i]));
+      else if (std::strcmp(argv[i], "--out") == 0 && hasValue)
+        options.outPath = argv[++i];
+      else if (std::strcmp(argv[i], "--cache") == 0)
+        options.useCache = true;
+      else if (std::strcmp(argv[i], "--compact") == 0)
+        options.compactVertices = true;
+      else if (std::strcmp(argv[i], "--optimize-meshes") == 0)
+        options.optimizeMeshes = true;
+      else if (std::strcmp(argv[i], "--compare-upload") == 0)
+        options.compareUpload = true;
+      else if (argv[i][0] != '-' && options.scenePath.empty())
+        options.scenePath = argv[i];
+      else
+        return false;
+    }
+    return !options.scenePath.empty();
+  }
+
+  // peak resident set of the whole process so far, in bytes
+  uint64_t peakRss()
+  {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters{};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return uint64_t(usage.ru_maxrss);
+#else
+    return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+  }
+
+  std::string jsonEscape(const std::string& str)
+  {
+    std::string result;
+    for (char c : str)
+    {
+      if (c == '"' || c == '\\')
+        result += '\\';
+      if (static_cast<unsigned char>(c) < 0x20)
+        continue;
+      result += c;
+    }
+    return result;
+  }
+
+  double gbPerSecond(uint64_t bytes, double ms)
+  {
+    return ms > 0.0 ? double(bytes) / (ms * 1e6) : 0.0;
+  }
+
+  struct UploadComparison
+  {
+    double perBufferMs = 0.0;
+    double batchedMs   = 0.0;
+    uint32_t batchedSubmits = 0;
+  };
+
+  // best of a few runs, the same bytes split into seven regions of one device local buffer
+  UploadComparison compareUploadPaths(const HeadlessDevice& headless, uint64_t bytes)
+  {
+    constexpr int REGIONS = 7;
+    constexpr int RUNS    = 5;
+
+    const VkDeviceSize size = std::max<VkDeviceSize>(bytes, REGIONS * 256) / 256 * 256;
+    const VkDeviceSize regionSize = size / REGIONS;
+    std::vector<std::byte> data(size, std::byte{0x5a});
+
+    VkQueue queue;
+    vkGetDeviceQueue(headless.device, headless.queueFamilyIDXs.transfer, 0, &queue);
+
+    GpuAllocator allocator(headless.device, headless.physDevice);
+    VkBuffer buffer = vk_utils::createBuffer(headless.device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    GpuAllocation memory = allocator.AllocateAndBind({buffer});
+
+    auto bestOf = [&](auto&& upload) {
+      double best = 1e30;
+      for (int run = 0; run < RUNS; ++run)
+      {
+        const auto start = std::chrono::steady_clock::now();
+        upload();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+      }
+      return best;
+    };
+
+    // same scratch and ring sizes SceneManager uses
+    UploadComparison result;
+    {
+      vk_utils::PingPongCopyHelper copyHelper(headless.physDevice, headless.device, queue,
+        headless.queueFamilyIDXs.transfer, 64 * 1024 * 1024);
+      result.perBufferMs = bestOf([&]() {
+        for (int i = 0; i < REGIONS; ++i)
+          copyHelper.UpdateBuffer(buffer, i * regionSize, data.data() + i * regionSize, regionSize);
+      });
+    }
+    {
+      StagingRing ring(allocator, headless.device, queue, headless.queueFamilyIDXs.transfer,
+        headless.queueFamilyIDXs.transfer, 32 * 1024 * 1024);
+      result.batchedMs = bestOf([&]() {
+        for (int i = 0; i < REGIONS; ++i)
+          ring.UploadData(buffer, i * regionSize, data.data() + i * regionSize, regionSize);
+        ring.Flush();
+      });
+      result.batchedSubmits = ring.Submits() / RUNS;
+    }
+
+    vkDestroyBuffer(headless.device, buffer, nullptr);
+    allocator.Free(memory);
+    return result;
+  }
+}
+
+int main(int argc, const char** argv)
+{
+  Options options;
+  if (!parseOptions(argc, argv, options))
+  {
+    std::cerr << "usage: scene_load_bench <scene.xml> [--runs N] [--device N] [--cache] [--compact] [--optimize-meshes] [--compare-upload] [--out result.json]" << std::endl;
+    return 1;
+  }
+
+  HeadlessDevice headless(options.deviceId, "scene_load_bench");
+  const uint64_t peakBeforeLoad = peakRss();
+
+  std::ostringstream json;
+  json << "{\n  \"scene\": \"" << jsonEscape(options.scenePath) << "\",\n"
+       << "  \"vertex_format\": \"" << (options.compactVertices ? "compact" : "full") << "\",\n  \"runs\": [\n";
+
+  SceneLoadStats best;
+  best.totalMs = 1e30;
+  uint32_t meshes = 0;
+  uint32_t instances = 0;
+  for (int run = 0; run < options.runs; ++run)
+  {
+    // a fresh manager each time, DestroyScene also drops the staging buffers
+    auto scnMgr = std::make_unique<SceneManager>(headless.device, headless.physDevice,
+      headless.queueFamilyIDXs.transfer, headless.queueFamilyIDXs.graphics, false);
+    scnMgr->SetSceneCacheEnabled(options.useCache);
+    scnMgr->SetVertexFormat(options.compactVertices ? VertexFormat::Compact : VertexFormat::Full);
+    scnMgr->SetMeshOptimization(options.optimizeMeshes);
+    scnMgr->LoadSceneXML(options.scenePath, true);
+    vkDeviceWaitIdle(headless.device);
+
+    const SceneLoadStats& stats = scnMgr->GetLoadStats();
+    meshes    = scnMgr->MeshesNum();
+    instances = scnMgr->InstancesNum();
+    if (stats.totalMs < best.totalMs)
+      best = stats;
+
+    const MeshOptimizeTotals& optimize = scnMgr->GetMeshOptimizeTotals();
+    char line[1024];
+    std::snprintf(line, sizeof(line),
+      "    { \"total_ms\": %.3f, \"cache_ms\": %.3f, \"xml_parse_ms\": %.3f, \"mesh_decode_ms\": %.3f, "
+      "\"decode_cpu_ms\": %.3f, \"bbox_cpu_ms\": %.3f, \"gpu_upload_ms\": %.3f, \"bytes_uploaded\": %llu, "
+      "\"upload_gb_per_s\": %.3f, \"upload_submits\": %u, \"from_cache\": %s, "
+      "\"meshes_optimized\": %u, \"meshes_optimize_reused\": %u, \"optimize_cpu_ms\": %.3f, "
+      "\"acmr_before\": %.3f, \"acmr_after\": %.3f, \"atvr_before\": %.3f, \"atvr_after\": %.3f }%s\n",
+      stats.totalMs, stats.cacheMs, stats.xmlParseMs, stats.meshDecodeMs, stats.decodeCpuMs, stats.bboxCpuMs,
+      stats.gpuUploadMs, static_cast<unsigned long long>(stats.bytesUploaded),
+      gbPerSecond(stats.bytesUploaded, stats.gpuUploadMs), stats.uploadSubmits, stats.fromCache ? "true" : "false",
+      optimize.optimized, optimize.reused, optimize.cpuMs,
+      optimize.before.Acmr(), optimize.after.Acmr(), optimize.before.Atvr(), optimize.after.Atvr(),
+      run + 1 < options.runs ? "," : "");
+    json << line;
+  }
+
+  json << "  ],\n";
+
+  if (options.compareUpload)
+  {
+    const UploadComparison upload = compareUploadPaths(headless, best.bytesUploaded);
+    char line[512];
+    std::snprintf(line, sizeof(line),
+      "  \"upload_comparison\": { \"bytes\": %llu, \"per_buffer_ms\": %.3f, \"per_buffer_gb_per_s\": %.3f, "
+      "\"batched_ms\": %.3f, \"batched_gb_per_s\": %.3f, \"batched_submits\": %u },\n",
+      static_cast<unsigned long long>(best.bytesUploaded), upload.perBufferMs,
+      gbPerSecond(best.bytesUploaded, upload.perBufferMs), upload.batchedMs,
+      gbPerSecond(best.bytesUploaded, upload.batchedMs), upload.batchedSubmits);
+    json << line;
+  }
+
+  const uint64_t peak = peakRss();
+  json << "  \"meshes\": " << meshes << ",\n"
+       << "  \"instances\": " << instances << ",\n"
+       << "  \"best_total_ms\": " << best.totalMs << ",\n"
+       << "  \"peak_rss_bytes\": " << peak << ",\n"
+       << "  \"peak_rss_before_load_bytes\": " << peakBeforeLoad << "\n"
+       << "}\n";
+
+  std::cout << json.str();
+  if (!options.outPath.empty())
+    std::ofstream(options.outPath) << json.str();
+
+  return 0;
+}
@@ -0,0 +1,269 @@
+// Compares reading a hydra scene through the pugixml DOM (HydraScene) against
+// hydra_xml::ReadSceneStreaming: wall time, peak heap and whether both produce
+// the same meshes, instances, cameras and lights.
+//
+// usage: scene_parse_bench <scene.xml>
+//        scene_parse_bench --synthetic <instance count, default 200000>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "loader_utils/hydraxml.h"
+#include "loader_utils/hydraxml_stream.h"
+
+
+// operator new/delete below are backed by malloc/free on purpose, gcc can't see that once they're inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace
+{
+  std::size_t g_liveBytes = 0;
+  std::size_t g_peakBytes = 0;
+
+  // every block carries its size in front so frees can be accounted for
+  constexpr std::size_t HEADER_SIZE = 16;
+
+  void* trackedAlloc(std::size_t size)
+  {
+    auto* block = static_cast<std::byte*>(std::malloc(size + HEADER_SIZE));
+    if (block == nullptr)
+      return nullptr;
+    std::memcpy(block, &size, sizeof(size));
+    g_liveBytes += size;
+    g_peakBytes = std::max(g_peakBytes, g_liveBytes);
+    return block + HEADER_SIZE;
+  }
+
+  void trackedFree(void* ptr)
+  {
+    if (ptr == nullptr)
+      return;
+    auto* block = static_cast<std::byte*>(ptr) - HEADER_SIZE;
+    std::size_t size;
+    std::memcpy(&size, block, sizeof(size));
+    g_liveBytes -= size;
+    std::free(block);
+  }
+}
+
+void* operator new(std::size_t size)
+{
+  if (void* ptr = trackedAlloc(size))
+    return ptr;
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { trackedFree(ptr); }
+
+
+namespace
+{
+  struct SceneData
+  {
+    std::vector<std::string> meshLocs;
+    std::map<std::string, std::vector<LiteMath::float4x4>> instances;
+    std::vector<hydra_xml::Camera> cameras;
+    std::vector<LiteMath::float4x4> lights;
+  };
+
+  struct Result
+  {
+    double ms = 0.0;
+    std::size_t peakBytes = 0;
+  };
+
+  // same work SceneManager does with HydraScene, minus loading the meshes
+  SceneData readDom(const std::string& path)
+  {
+    SceneData data;
+    hydra_xml::HydraScene scene;
+    if (scene.LoadState(path) < 0)
+      std::exit(1);
+
+    for (auto loc : scene.MeshFiles())
+    {
+      auto instances = scene.GetAllInstancesOfMeshLoc(loc);
+      if (!instances.empty())
+        data.instances[loc].assign(instances.begin(), instances.end());
+      data.meshLocs.push_back(std::move(loc));
+    }
+    for (auto cam : scene.Cameras())
+      data.cameras.push_back(cam);
+    for (const auto& light : scene.InstancesLights())
+      data.lights.push_back(light.matrix);
+    return data;
+  }
+
+  SceneData readStreaming(const std::string& path)
+  {
+    SceneData data;
+    std::map<std::string, std::string, std::less<>> locById;
+
+    hydra_xml::SceneEvents events;
+    events.onMesh = [&](std::string_view id, const std::string& loc) {
+      locById.emplace(id, loc);
+      data.meshLocs.push_back(loc);
+    };
+    events.onCamera = [&](const hydra_xml::Camera& cam) { data.cameras.push_back(cam); };
+    events.onInstance = [&](uint32_t, std::string_view meshId, const LiteMath::float4x4& matrix) {
+      auto found = locById.find(meshId);
+      if (found != locById.end())
+        data.instances[found->second].push_back(matrix);
+    };
+    events.onLightInstance = [&](const hydra_xml::LightInstance& light) { data.lights.push_back(light.matrix); };
+
+    if (hydra_xml::ReadSceneStreaming(path, events) < 0)
+      std::exit(1);
+    return data;
+  }
+
+  template<typename F>
+  Result measure(const std::string& path, SceneData& out, F&& read)
+  {
+    Result result{ 1e30, 0 };
+    for (int run = 0; run < 3; ++run)
+    {
+      const std::size_t liveBefore = g_liveBytes;
+      g_peakBytes = liveBefore;
+
+      const auto start = std::chrono::steady_clock::now();
+      out = read(path);
+      const auto end = std::chrono::steady_clock::now();
+
+      result.ms = std::min(result.ms, std::chrono::duration<double, std::milli>(end - start).count());
+      result.peakBytes = g_peakBytes - liveBefore;
+    }
+    return result;
+  }
+
+  bool sameFloats(const void* a, const void* b, std::size_t size)
+  {
+    return std::memcmp(a, b, size) == 0;
+  }
+
+  std::size_t countMismatches(const SceneData& dom, const SceneData& stream)
+  {
+    std::size_t mismatches = 0;
+    mismatches += dom.meshLocs != stream.meshLocs;
+    mismatches += dom.cameras.size() != stream.cameras.size();
+    for (std::size_t i = 0; i < std::min(dom.cameras.size(), stream.cameras.size()); ++i)
+      mismatches += !sameFloats(&dom.cameras[i], &stream.cameras[i], sizeof(hydra_xml::Camera));
+    mismatches += dom.lights.size() != stream.lights.size();
+    for (std::size_t i = 0; i < std::min(dom.lights.size(), stream.lights.size()); ++i)
+      mismatches += !sameFloats(&dom.lights[i], &stream.lights[i], sizeof(LiteMath::float4x4));
+
+    mismatches += dom.instances.size() != stream.instances.size();
+    for (const auto& [loc, matrices] : dom.instances)
+    {
+      auto found = stream.instances.find(loc);
+      if (found == stream.instances.end() || found->second.size() != matrices.size()
+        || !sameFloats(matrices.data(), found->second.data(), matrices.size() * sizeof(LiteMath::float4x4)))
+        ++mismatches;
+    }
+    return mismatches;
+  }
+
+  // a scene with every lib HydraScene insists on, a handful of tiny meshes and lots of instances
+  std::string writeSyntheticScene(std::size_t instanceCount)
+  {
+    const auto dir = std::filesystem::temp_directory_path() / "scene_parse_bench";
+    std::filesystem::create_directories(dir / "data");
+
+    constexpr int meshCount = 64;
+    for (int i = 0; i < meshCount; ++i)
+    {
+      char name[64];
+      std::snprintf(name, sizeof(name), "data/chunk_%05d.vsgf", i);
+      std::ofstream(dir / name, std::ios::binary) << "x";
+    }
+
+    const auto path = (dir / "statex_00001.xml").string();
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (out == nullptr)
+      std::exit(1);
+
+    std::fprintf(out, "<?xml version=\"1.0\"?>\n<textures_lib total_chunks=\"%d\" />\n<materials_lib>\n", meshCount);
+    for (int i = 0; i < meshCount; ++i)
+      std::fprintf(out, "  <material id=\"%d\" name=\"mat%d\" type=\"hydra_material\">\n    <diffuse brdf_type=\"lambert\">\n"
+        "      <color val=\"0.5 0.5 0.5\" />\n    </diffuse>\n  </material>\n", i, i);
+    std::fprintf(out, "</materials_lib>\n<geometry_lib total_chunks=\"%d\">\n", meshCount);
+    for (int i = 0; i < meshCount; ++i)
+      std::fprintf(out, "  <mesh id=\"%d\" name=\"mesh%d\" type=\"vsgf\" bytesize=\"1\" loc=\"data/chunk_%05d.vsgf\" offset=\"0\" "
+        "vertNum=\"3\" triNum=\"1\" dl=\"0\" path=\"\" bbox=\"0 1 0 1 0 1\">\n"
+        "    <positions type=\"array4f\" bytesize=\"48\" offset=\"24\" apply=\"vertex\" />\n  </mesh>\n", i, i, i);
+    std::fprintf(out, "</geometry_lib>\n<lights_lib>\n  <light id=\"0\" name=\"sky\" type=\"sky\" shape=\"point\" distribution=\"uniform\" visible=\"1\" mat_id=\"0\">\n"
+      "    <intensity>\n      <color val=\"1 1 1\" />\n      <multiplier val=\"1\" />\n    </intensity>\n  </light>\n</lights_lib>\n");
+    std::fprintf(out, "<cam_lib>\n  <camera id=\"0\" name=\"Camera001\" type=\"uvn\">\n    <fov>45</fov>\n    <nearClipPlane>0.01</nearClipPlane>\n"
+      "    <farClipPlane>1000</farClipPlane>\n    <up>0 1 0</up>\n    <position>0 5 30</position>\n    <look_at>0 0 0</look_at>\n  </camera>\n</cam_lib>\n");
+    std::fprintf(out, "<render_lib>\n  <render_settings type=\"HydraModern\" id=\"0\">\n    <width>1024</width>\n    <height>1024</height>\n"
+      "  </render_settings>\n</render_lib>\n<scenes>\n  <scene id=\"0\" name=\"my scene\" discard=\"1\" bbox=\"-500 500 -500 500 -500 500\">\n");
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> offset(-500.0f, 500.0f);
+    for (std::size_t i = 0; i < instanceCount; ++i)
+      std::fprintf(out, "    <instance id=\"%zu\" mesh_id=\"%zu\" rmap_id=\"-1\" scn_id=\"0\" scn_sid=\"0\" "
+        "matrix=\"%g %g %g %.3f %g %g %g %.3f %g %g %g %.3f 0 0 0 1 \" />\n", i, i % meshCount,
+        unit(rng), unit(rng), unit(rng), offset(rng), unit(rng), unit(rng), unit(rng), offset(rng),
+        unit(rng), unit(rng), unit(rng), offset(rng));
+    std::fprintf(out, "    <instance_light id=\"0\" light_id=\"0\" matrix=\"1 0 0 0 0 1 0 2 0 0 1 0 0 0 0 1 \" lgroup_id=\"-1\" />\n"
+      "  </scene>\n</scenes>\n");
+    std::fclose(out);
+
+    return path;
+  }
+}
+
+int main(int argc, const char** argv)
+{
+  // pugixml allocates with malloc unless told otherwise
+  pugi::set_memory_management_functions(trackedAlloc, trackedFree);
+
+  std::string path;
+  if (argc > 1 && std::strcmp(argv[1], "--synthetic") == 0)
+    path = writeSyntheticScene(argc > 2 ? static_cast<std::size_t>(std::stoul(argv[2])) : 200000);
+  else if (argc > 1)
+    path = argv[1];
+  else
+  {
+    std::fprintf(stderr, "usage: scene_parse_bench <scene.xml> | --synthetic [instance count]\n");
+    return 1;
+  }
+
+  SceneData dom;
+  SceneData stream;
+  const Result domResult    = measure(path, dom, readDom);
+  const Result streamResult = measure(path, stream, readStreaming);
+
+  std::size_t instances = 0;
+  for (const auto& [loc, matrices] : dom.instances)
+    instances += matrices.size();
+
+  const auto fileSize = std::filesystem::file_size(path);
+  const std::size_t mismatches = countMismatches(dom, stream);
+
+  std::printf("%s: %.1f MB, %zu meshes, %zu instances, %zu cameras, %zu lights\n", path.c_str(), double(fileSize) / 1e6,
+    dom.meshLocs.size(), instances, dom.cameras.size(), dom.lights.size());
+  std::printf("%-12s %10s %14s\n", "reader", "ms", "peak heap MB");
+  std::printf("%-12s %10.2f %14.2f\n", "dom", domResult.ms, double(domResult.peakBytes) / 1e6);
+  std::printf("%-12s %10.2f %14.2f\n", "streaming", streamResult.ms, double(streamResult.peakBytes) / 1e6);
+  std::printf("speedup %.2fx, peak heap %.1fx lower, %zu mismatches\n", domResult.ms / streamResult.ms,
+    double(domResult.peakBytes) / double(std::max<std::size_t>(streamResult.peakBytes, 1)), mismatches);
+
+  return mismatches == 0 ? 0 : 1;
+}
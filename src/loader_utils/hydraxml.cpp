@@ -5,6 +5,11 @@
 #include <fstream>
 #include <locale>
 #include <codecvt>
+#include <charconv>
+#include <algorithm>
+#include <limits>
+#include <filesystem>
+#include <string_view>
 
 #if defined(__ANDROID__)
 #define LOGE(...) \
@@ -134,66 +139,252 @@ namespace hydra_xml
 
   void HydraScene::parseInstancedMeshes(pugi::xml_node a_scenelib, pugi::xml_node a_geomlib)
   {
+    struct MeshLoc
+    {
+      std::string loc;
+      std::size_t count = 0;
+      bool checked = false;
+      bool exists  = false;
+    };
+
+    // index geometry_lib once: mesh id -> unique mesh location
+    std::vector<MeshLoc> meshLocs;
+    std::unordered_map<std::wstring_view, std::size_t> locById;
+    std::unordered_map<std::string, std::size_t> locByPath;
+    for (pugi::xml_node meshNode = a_geomlib.first_child(); meshNode != nullptr; meshNode = meshNode.next_sibling())
+    {
+      auto meshLoc = m_libraryRootDir + "/" + ws2s(std::wstring(meshNode.attribute(L"loc").as_string()));
+      auto [locIt, newLoc] = locByPath.try_emplace(std::move(meshLoc), meshLocs.size());
+      if (newLoc)
+        meshLocs.push_back(MeshLoc{ locIt->first });
+
+      // the first node wins, same as find_child_by_attribute
+      locById.try_emplace(meshNode.attribute(L"id").as_string(), locIt->second);
+    }
+
+    // first pass: resolve every instance and count instances per mesh location
+    std::vector<std::pair<pugi::xml_node, std::size_t>> resolved;
     auto scene = a_scenelib.first_child();
     for (pugi::xml_node inst = scene.first_child(); inst != nullptr; inst = inst.next_sibling())
     {
-      if (std::wstring(inst.name()) == L"instance_light")
+      if (std::wstring_view(inst.name()) == L"instance_light")
         break;
 
-      auto mesh_id = inst.attribute(L"mesh_id").as_string();
-      auto matrix = std::wstring(inst.attribute(L"matrix").as_string());
+      auto found = locById.find(inst.attribute(L"mesh_id").as_string());
+      if (found == locById.end())
+        continue;
+
+      auto& meshLoc = meshLocs[found->second];
+      if (!meshLoc.checked)
+      {
+        meshLoc.checked = true;
+#if not defined(__ANDROID__)
+        std::error_code ec;
+        meshLoc.exists = std::filesystem::is_regular_file(meshLoc.loc, ec);
+        if (!meshLoc.exists)
+          LogError("Mesh not found at: " + meshLoc.loc + ". Loader will skip it.");
+#else
+        meshLoc.exists = true;
+#endif
+      }
+
+      if (!meshLoc.exists)
+        continue;
+
+      ++meshLoc.count;
+      resolved.emplace_back(inst, found->second);
+    }
+
+    // second pass: parse matrices straight into their final place
+    std::vector<std::size_t> cursors(meshLocs.size());
+    std::size_t total = m_instanceMatrices.size();
+    for (std::size_t i = 0; i < meshLocs.size(); ++i)
+    {
+      if (meshLocs[i].count == 0)
+        continue;
+
+      auto& range = m_instancesPerMeshLoc[meshLocs[i].loc];
+      range.first = total;
+      range.count = meshLocs[i].count;
+      cursors[i]  = total;
+      total += meshLocs[i].count;
+    }
+
+    m_instanceMatrices.resize(total);
+    m_instanceIds.resize(total);
+    for (const auto& [inst, locId] : resolved)
+    {
+      const std::size_t at = cursors[locId]++;
+      m_instanceMatrices[at] = float4x4FromString(inst.attribute(L"matrix").as_string());
+      m_instanceIds[at]      = inst.attribute(L"id").as_uint();
+    }
+  }
+
+  namespace
+  {
+    template<typename Char> bool isSpace(Char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ','; }
+    template<typename Char> bool isDigit(Char c) { return c >= '0' && c <= '9'; }
 
-      auto meshNode = a_geomlib.find_child_by_attribute(L"id", mesh_id);
+    // powers of ten that are exact in float
+    constexpr float EXACT_POW10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+    constexpr int MAX_EXACT_POW10 = 10;
+    constexpr uint64_t MAX_EXACT_MANTISSA = uint64_t(1) << 24;
 
-      if(meshNode != nullptr)
+    template<typename Char>
+    bool parseFloatSlow(const Char* a_str, float& a_out, const Char*& a_end)
+    {
+      char buffer[64];
+      int len = 0;
+      const Char* p = a_str;
+      for (; *p != 0 && !isSpace(*p) && len < int(sizeof(buffer)); ++p, ++len)
       {
-        auto meshLoc = ws2s(std::wstring(meshNode.attribute(L"loc").as_string()));
-        meshLoc = m_libraryRootDir + "/" + meshLoc;
+        if (static_cast<uint32_t>(*p) > 0x7F)
+          return false;
+        buffer[len] = char(*p);
+      }
 
-#if not defined(__ANDROID__)
-        std::ifstream checkMesh(meshLoc);
-        if(!checkMesh.good())
+      // from_chars doesn't accept a leading '+'
+      const int skip = (len > 0 && buffer[0] == '+') ? 1 : 0;
+      const auto res = std::from_chars(buffer + skip, buffer + len, a_out);
+      if (res.ec == std::errc::invalid_argument)
+        return false;
+
+      // out of float range: go through double, so that overflow becomes inf and underflow becomes zero
+      if (res.ec == std::errc::result_out_of_range)
+      {
+        double wide = 0.0;
+        if (std::from_chars(buffer + skip, buffer + len, wide).ec != std::errc())
+          return false;
+        a_out = float(wide);
+      }
+
+      // skip whatever didn't fit into the buffer
+      a_end = a_str + (res.ptr - buffer);
+      if (res.ptr == buffer + sizeof(buffer))
+        while (*a_end != 0 && !isSpace(*a_end))
+          ++a_end;
+      return true;
+    }
+
+    // Parses one float starting at a_str (no leading whitespace), stores the end of the token to a_end.
+    // Short decimal numbers, which is nearly everything in hydra scenes, are handled exactly
+    // with a single float multiply/divide (Clinger's fast path). Everything else is narrowed
+    // to a small stack buffer and handed to std::from_chars, which is also exact.
+    template<typename Char>
+    bool parseFloat(const Char* a_str, float& a_out, const Char*& a_end)
+    {
+      const Char* p = a_str;
+
+      const bool negative = (*p == '-');
+      if (*p == '-' || *p == '+')
+        ++p;
+
+      uint64_t mantissa = 0;
+      int digits    = 0;
+      int exponent  = 0;
+      bool anyDigit = false;
+
+      for (; isDigit(*p); ++p, anyDigit = true)
+      {
+        if (digits < 19)
         {
-          LogError("Mesh not found at: " + meshLoc + ". Loader will skip it.");
-          continue;
+          mantissa = mantissa * 10 + uint64_t(*p - '0');
+          digits += (mantissa != 0);
         }
         else
-        {
-          checkMesh.close();
-        }
-#endif
+          ++exponent;
+      }
 
-        if(unique_meshes.find(meshLoc) == unique_meshes.end())
+      if (*p == '.')
+      {
+        ++p;
+        for (; isDigit(*p); ++p, anyDigit = true)
         {
-          unique_meshes.emplace(meshLoc);
-          //m_meshloc.push_back(meshLoc);
+          if (digits < 19)
+          {
+            mantissa = mantissa * 10 + uint64_t(*p - '0');
+            digits += (mantissa != 0);
+            --exponent;
+          }
         }
+      }
 
+      if (!anyDigit)
+        return parseFloatSlow(a_str, a_out, a_end);
 
-        if(m_instancesPerMeshLoc.find(meshLoc) != m_instancesPerMeshLoc.end())
-        {
-          m_instancesPerMeshLoc[meshLoc].push_back(float4x4FromString(matrix));
-        }
-        else
+      if (*p == 'e' || *p == 'E')
+      {
+        const Char* q = p + 1;
+        const bool negativeExp = (*q == '-');
+        if (*q == '-' || *q == '+')
+          ++q;
+
+        if (isDigit(*q))
         {
-          std::vector<LiteMath::float4x4> tmp = { float4x4FromString(matrix) };
-          m_instancesPerMeshLoc[meshLoc] = tmp;
+          int e = 0;
+          for (; isDigit(*q); ++q)
+            e = std::min(e * 10 + int(*q - '0'), 100000);
+          exponent += negativeExp ? -e : e;
+          p = q;
         }
       }
+
+      if (digits < 19 && mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POW10 && exponent <= MAX_EXACT_POW10)
+      {
+        float value = float(mantissa);
+        value = exponent < 0 ? value / EXACT_POW10[-exponent] : value * EXACT_POW10[exponent];
+        a_out = negative ? -value : value;
+        a_end = p;
+        return true;
+      }
+
+      return parseFloatSlow(a_str, a_out, a_end);
     }
 
+    template<typename Char>
+    int readFloatsImpl(const Char* a_str, float* a_out, int a_count)
+    {
+      if (a_str == nullptr)
+        return 0;
 
+      int read = 0;
+      const Char* p = a_str;
+      while (read < a_count)
+      {
+        while (isSpace(*p))
+          ++p;
+        if (*p == 0 || !parseFloat(p, a_out[read], p))
+          break;
+        ++read;
+      }
+      return read;
+    }
   }
 
-  LiteMath::float4x4 float4x4FromString(const std::wstring &matrix_str)
+  int readFloats(const wchar_t* a_str, float* a_out, int a_count)
+  {
+    return readFloatsImpl(a_str, a_out, a_count);
+  }
+
+  int readFloats(const char* a_str, float* a_out, int a_count)
+  {
+    return readFloatsImpl(a_str, a_out, a_count);
+  }
+
+  float readFloat(const wchar_t* a_str, float a_default)
+  {
+    float res = a_default;
+    readFloats(a_str, &res, 1);
+    return res;
+  }
+
+  LiteMath::float4x4 float4x4FromString(const wchar_t* matrix_str)
   {
     LiteMath::float4x4 result;
-    std::wstringstream inputStream(matrix_str);
-    
-    float data[16];
-    for(int i = 0; i < 16; i++)
-      inputStream >> data[i];
-    
+
+    float data[16] = {};
+    readFloats(matrix_str, data, 16);
+
     result.set_row(0, LiteMath::float4(data[0],data[1], data[2], data[3]));
     result.set_row(1, LiteMath::float4(data[4],data[5], data[6], data[7]));
     result.set_row(2, LiteMath::float4(data[8],data[9], data[10], data[11]));
@@ -202,28 +393,23 @@ namespace hydra_xml
     return result;
   }
 
+  LiteMath::float4x4 float4x4FromString(const std::wstring &matrix_str)
+  {
+    return float4x4FromString(matrix_str.c_str());
+  }
+
   LiteMath::float3 read3f(pugi::xml_attribute a_attr)
   {
-    LiteMath::float3 res(0, 0, 0);
-    const wchar_t* camPosStr = a_attr.as_string();
-    if (camPosStr != nullptr)
-    {
-      std::wstringstream inputStream(camPosStr);
-      inputStream >> res.x >> res.y >> res.z;
-    }
-    return res;
+    float data[3] = {};
+    readFloats(a_attr.as_string(), data, 3);
+    return LiteMath::float3(data[0], data[1], data[2]);
   }
 
   LiteMath::float3 read3f(pugi::xml_node a_node)
   {
-    LiteMath::float3 res(0,0,0);
-    const wchar_t* camPosStr = a_node.text().as_string();
-    if (camPosStr != nullptr)
-    {
-      std::wstringstream inputStream(camPosStr);
-      inputStream >> res.x >> res.y >> res.z;
-    }
-    return res;
+    float data[3] = {};
+    readFloats(a_node.text().as_string(), data, 3);
+    return LiteMath::float3(data[0], data[1], data[2]);
   }
 
   LiteMath::float3 readval3f(pugi::xml_node a_node)
@@ -265,6 +451,7 @@ namespace hydra_xml
       inst.instId    = instNode.attribute(L"id").as_uint();
       inst.lightId   = instNode.attribute(L"light_id").as_uint(); 
       inst.lightNode = lights[inst.lightId];
+      inst.matrix    = float4x4FromString(instNode.attribute(L"matrix").as_string());
       result.push_back(inst);
     }
     return result;
@@ -6,6 +6,7 @@
 
 #include <vector>
 #include <set>
+#include <span>
 #include <unordered_map>
 //#include <iostream>
 
@@ -18,6 +19,13 @@ namespace hydra_xml
 {
   std::wstring s2ws(const std::string& str);
   std::string  ws2s(const std::wstring& wstr);
+  // locale independent and allocation free; reads up to a_count whitespace separated
+  // floats from a_str and returns how many were actually read
+  int readFloats(const wchar_t* a_str, float* a_out, int a_count);
+  int readFloats(const char* a_str, float* a_out, int a_count);
+  float readFloat(const wchar_t* a_str, float a_default = 0.0f);
+
+  LiteMath::float4x4 float4x4FromString(const wchar_t* matrix_str);
   LiteMath::float4x4 float4x4FromString(const std::wstring &matrix_str);
   LiteMath::float3   read3f(pugi::xml_attribute a_attr);
   LiteMath::float3   read3f(pugi::xml_node a_node);
@@ -143,9 +151,9 @@ namespace hydra_xml
     Camera operator*() const 
     { 
       Camera cam = {};
-      cam.fov       = m_iter->child(L"fov").text().as_float(); 
-      cam.nearPlane = m_iter->child(L"nearClipPlane").text().as_float();
-      cam.farPlane  = m_iter->child(L"farClipPlane").text().as_float();  
+      cam.fov       = readFloat(m_iter->child(L"fov").text().as_string());
+      cam.nearPlane = readFloat(m_iter->child(L"nearClipPlane").text().as_string());
+      cam.farPlane  = readFloat(m_iter->child(L"farClipPlane").text().as_string());
       
       LiteMath::float3 pos    = hydra_xml::read3f(m_iter->child(L"position"));
       LiteMath::float3 lookAt = hydra_xml::read3f(m_iter->child(L"look_at"));
@@ -210,20 +218,32 @@ namespace hydra_xml
     pugi::xml_object_range<CamIterator> Cameras() { return {CamIterator(m_cameraLib.begin()),
                                                             CamIterator(m_cameraLib.end())}; }
 
-    std::vector<LiteMath::float4x4> GetAllInstancesOfMeshLoc(const std::string& a_loc) const 
+    std::span<const LiteMath::float4x4> GetAllInstancesOfMeshLoc(const std::string& a_loc) const 
     { 
       auto pFound = m_instancesPerMeshLoc.find(a_loc);
       if(pFound == m_instancesPerMeshLoc.end())
         return {};
       else
-        return pFound->second; 
+        return std::span(m_instanceMatrices).subspan(pFound->second.first, pFound->second.count); 
     }
+
+    // "id" attributes of the instances above, in the same order
+    std::span<const uint32_t> GetAllInstanceIdsOfMeshLoc(const std::string& a_loc) const
+    {
+      auto pFound = m_instancesPerMeshLoc.find(a_loc);
+      if(pFound == m_instancesPerMeshLoc.end())
+        return {};
+      else
+        return std::span(m_instanceIds).subspan(pFound->second.first, pFound->second.count);
+    }
+
+    // total number of mesh instances over all mesh locations
+    std::size_t InstancesNum() const { return m_instanceMatrices.size(); }
     
   private:
     void parseInstancedMeshes(pugi::xml_node a_scenelib, pugi::xml_node a_geomlib);
     void LogError(const std::string &msg);  
     
-    std::set<std::string> unique_meshes;
     std::string m_libraryRootDir;
     pugi::xml_node m_texturesLib ; 
     pugi::xml_node m_materialsLib; 
@@ -234,7 +254,16 @@ namespace hydra_xml
     pugi::xml_node m_sceneNode   ; 
     pugi::xml_document m_xmlDoc;
 
-    std::unordered_map<std::string, std::vector<LiteMath::float4x4> > m_instancesPerMeshLoc;
+    struct InstanceRange
+    {
+      std::size_t first = 0;
+      std::size_t count = 0;
+    };
+
+    // all instance matrices grouped by mesh location, in scene order within each group
+    std::vector<LiteMath::float4x4> m_instanceMatrices;
+    std::vector<uint32_t> m_instanceIds;
+    std::unordered_map<std::string, InstanceRange> m_instancesPerMeshLoc;
   };
 
   
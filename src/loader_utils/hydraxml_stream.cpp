@@ -0,0 +1,445 @@
+#include "hydraxml_stream.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace hydra_xml
+{
+  namespace
+  {
+    // Minimal pull parser: elements, attributes and text. Comments, processing
+    // instructions, doctype and CDATA are skipped, entities are decoded.
+    class XmlBlockReader
+    {
+    public:
+      static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+      explicit XmlBlockReader(const std::string& path)
+        : m_file(path, std::ios::binary)
+        , m_block(BLOCK_SIZE)
+      {}
+
+      bool IsOpen() const { return m_file.is_open(); }
+
+      int Peek()
+      {
+        if (m_pos == m_end && !Refill())
+          return -1;
+        return static_cast<unsigned char>(m_block[m_pos]);
+      }
+
+      int Get()
+      {
+        const int c = Peek();
+        if (c >= 0)
+          ++m_pos;
+        return c;
+      }
+
+      // consumes everything up to the next '<' (not included), appending it to a_text if given
+      bool SkipText(std::string* a_text)
+      {
+        while (true)
+        {
+          if (m_pos == m_end && !Refill())
+            return false;
+          const char* begin = m_block.data() + m_pos;
+          const char* found = static_cast<const char*>(std::memchr(begin, '<', m_end - m_pos));
+          const std::size_t length = found != nullptr ? std::size_t(found - begin) : m_end - m_pos;
+          if (a_text != nullptr)
+            a_text->append(begin, length);
+          m_pos += length;
+          if (found != nullptr)
+            return true;
+        }
+      }
+
+      // consumes everything up to and including a_delim
+      bool SkipPast(std::string_view a_delim)
+      {
+        std::string tail;
+        for (int c = Get(); c >= 0; c = Get())
+        {
+          tail.push_back(char(c));
+          if (tail.size() > a_delim.size())
+            tail.erase(tail.begin());
+          if (tail == a_delim)
+            return true;
+        }
+        return false;
+      }
+
+    private:
+      bool Refill()
+      {
+        m_file.read(m_block.data(), static_cast<std::streamsize>(m_block.size()));
+        m_end = static_cast<std::size_t>(m_file.gcount());
+        m_pos = 0;
+        return m_end > 0;
+      }
+
+      std::ifstream m_file;
+      std::vector<char> m_block;
+      std::size_t m_pos = 0;
+      std::size_t m_end = 0;
+    };
+
+    bool isXmlSpace(int c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+    void appendUtf8(std::string& a_out, uint32_t a_code)
+    {
+      if (a_code < 0x80)
+        a_out.push_back(char(a_code));
+      else if (a_code < 0x800)
+      {
+        a_out.push_back(char(0xC0 | (a_code >> 6)));
+        a_out.push_back(char(0x80 | (a_code & 0x3F)));
+      }
+      else if (a_code < 0x10000)
+      {
+        a_out.push_back(char(0xE0 | (a_code >> 12)));
+        a_out.push_back(char(0x80 | ((a_code >> 6) & 0x3F)));
+        a_out.push_back(char(0x80 | (a_code & 0x3F)));
+      }
+      else
+      {
+        a_out.push_back(char(0xF0 | (a_code >> 18)));
+        a_out.push_back(char(0x80 | ((a_code >> 12) & 0x3F)));
+        a_out.push_back(char(0x80 | ((a_code >> 6) & 0x3F)));
+        a_out.push_back(char(0x80 | (a_code & 0x3F)));
+      }
+    }
+
+    // in place, unknown entities are kept as is
+    void decodeEntities(std::string& a_str)
+    {
+      if (a_str.find('&') == std::string::npos)
+        return;
+
+      std::string result;
+      result.reserve(a_str.size());
+      for (std::size_t i = 0; i < a_str.size(); ++i)
+      {
+        const std::size_t semicolon = a_str[i] == '&' ? a_str.find(';', i) : std::string::npos;
+        if (semicolon == std::string::npos)
+        {
+          result.push_back(a_str[i]);
+          continue;
+        }
+
+        const std::string_view entity(a_str.data() + i + 1, semicolon - i - 1);
+        if (entity == "lt")        result.push_back('<');
+        else if (entity == "gt")   result.push_back('>');
+        else if (entity == "amp")  result.push_back('&');
+        else if (entity == "quot") result.push_back('"');
+        else if (entity == "apos") result.push_back('\'');
+        else if (entity.size() > 1 && entity[0] == '#')
+        {
+          const bool hex = entity[1] == 'x' || entity[1] == 'X';
+          appendUtf8(result, uint32_t(std::strtoul(std::string(entity.substr(hex ? 2 : 1)).c_str(), nullptr, hex ? 16 : 10)));
+        }
+        else
+        {
+          result.append(a_str, i, semicolon - i + 1);
+        }
+        i = semicolon;
+      }
+      a_str = std::move(result);
+    }
+
+    struct XmlTag
+    {
+      struct Attribute
+      {
+        std::string name;
+        std::string value;
+      };
+
+      std::string name;
+      std::vector<Attribute> attributes;
+      std::size_t attributeCount = 0;
+      bool closing     = false;
+      bool selfClosing = false;
+
+      std::string_view Attr(std::string_view a_name) const
+      {
+        for (std::size_t i = 0; i < attributeCount; ++i)
+          if (attributes[i].name == a_name)
+            return attributes[i].value;
+        return {};
+      }
+    };
+
+    // reads a tag after its '<', returns false on a malformed or truncated tag
+    bool readTag(XmlBlockReader& a_reader, XmlTag& a_tag)
+    {
+      a_tag.name.clear();
+      a_tag.attributeCount = 0;
+      a_tag.closing     = false;
+      a_tag.selfClosing = false;
+
+      if (a_reader.Peek() == '/')
+      {
+        a_reader.Get();
+        a_tag.closing = true;
+      }
+
+      int c = a_reader.Get();
+      for (; c >= 0 && !isXmlSpace(c) && c != '/' && c != '>'; c = a_reader.Get())
+        a_tag.name.push_back(char(c));
+
+      while (true)
+      {
+        while (isXmlSpace(c))
+          c = a_reader.Get();
+
+        if (c == '>')
+          return !a_tag.name.empty();
+        if (c == '/')
+        {
+          a_tag.selfClosing = true;
+          return a_reader.Get() == '>' && !a_tag.name.empty();
+        }
+        if (c < 0)
+          return false;
+
+        if (a_tag.attributeCount == a_tag.attributes.size())
+          a_tag.attributes.emplace_back();
+        auto& attr = a_tag.attributes[a_tag.attributeCount++];
+        attr.name.clear();
+        attr.value.clear();
+
+        for (; c >= 0 && c != '=' && !isXmlSpace(c); c = a_reader.Get())
+          attr.name.push_back(char(c));
+        while (isXmlSpace(c))
+          c = a_reader.Get();
+        if (c != '=')
+          return false;
+
+        c = a_reader.Get();
+        while (isXmlSpace(c))
+          c = a_reader.Get();
+        if (c != '"' && c != '\'')
+          return false;
+
+        const int quote = c;
+        for (c = a_reader.Get(); c >= 0 && c != quote; c = a_reader.Get())
+          attr.value.push_back(char(c));
+        if (c < 0)
+          return false;
+        decodeEntities(attr.value);
+
+        c = a_reader.Get();
+      }
+    }
+
+    LiteMath::float4x4 matrixFrom(std::string_view a_str)
+    {
+      float data[16] = {};
+      readFloats(std::string(a_str).c_str(), data, 16);
+
+      LiteMath::float4x4 result;
+      result.set_row(0, LiteMath::float4(data[0],data[1], data[2], data[3]));
+      result.set_row(1, LiteMath::float4(data[4],data[5], data[6], data[7]));
+      result.set_row(2, LiteMath::float4(data[8],data[9], data[10], data[11]));
+      result.set_row(3, LiteMath::float4(data[12],data[13], data[14], data[15]));
+      return result;
+    }
+
+    uint32_t uintFrom(std::string_view a_str)
+    {
+      return uint32_t(std::strtoul(std::string(a_str).c_str(), nullptr, 10));
+    }
+
+    void readCameraField(Camera& a_cam, std::string_view a_field, const std::string& a_text)
+    {
+      if (a_field == "fov")
+        readFloats(a_text.c_str(), &a_cam.fov, 1);
+      else if (a_field == "nearClipPlane")
+        readFloats(a_text.c_str(), &a_cam.nearPlane, 1);
+      else if (a_field == "farClipPlane")
+        readFloats(a_text.c_str(), &a_cam.farPlane, 1);
+      else if (a_field == "position")
+        readFloats(a_text.c_str(), a_cam.pos, 3);
+      else if (a_field == "look_at")
+        readFloats(a_text.c_str(), a_cam.lookAt, 3);
+      else if (a_field == "up")
+        readFloats(a_text.c_str(), a_cam.up, 3);
+    }
+
+    void logError(const std::string& a_msg)
+    {
+      std::cout << "HydraScene ERROR: " << a_msg << std::endl;
+    }
+  }
+
+  int ReadSceneStreaming(const std::string& path, const SceneEvents& events)
+  {
+    XmlBlockReader reader(path);
+    if (!reader.IsOpen())
+    {
+      logError("Error loading scene from: " + path);
+      return -1;
+    }
+
+    const std::string libraryRootDir = path.substr(0, path.find_last_of('/'));
+
+    std::vector<std::string> openTags;
+    XmlTag tag;
+
+    std::string lib;
+    bool seenGeometry = false;
+    bool seenScenes   = false;
+
+    Camera cam = {};
+    bool inCamera = false;
+    std::string cameraField;
+    std::string text;
+
+    int sceneIndex = -1;
+    bool seenLightInstance = false;
+
+    auto malformed = [&](const char* what) {
+      logError("Malformed scene " + path + ": " + what);
+      return -1;
+    };
+
+    // camera fields are the only element text that is needed
+    while (reader.SkipText(cameraField.empty() ? nullptr : &text))
+    {
+      reader.Get(); // '<'
+
+      const int next = reader.Peek();
+      if (next == '?')
+      {
+        if (!reader.SkipPast("?>"))
+          return malformed("unterminated processing instruction");
+        continue;
+      }
+      if (next == '!')
+      {
+        reader.Get();
+        bool ok = true;
+        if (reader.Peek() == '-')
+          ok = reader.SkipPast("-->");
+        else if (reader.Peek() == '[')
+        {
+          // <![CDATA[ ... ]]>
+          std::string cdata;
+          ok = reader.SkipPast("[CDATA[");
+          for (int c = reader.Get(); ok && c >= 0; c = reader.Get())
+          {
+            cdata.push_back(char(c));
+            if (cdata.size() >= 3 && cdata.compare(cdata.size() - 3, 3, "]]>") == 0)
+              break;
+          }
+          if (!cameraField.empty() && cdata.size() >= 3)
+            text.append(cdata, 0, cdata.size() - 3);
+        }
+        else
+          ok = reader.SkipPast(">");
+        if (!ok)
+          return malformed("unterminated comment or declaration");
+        continue;
+      }
+
+      if (!readTag(reader, tag))
+        return malformed("broken tag");
+
+      if (tag.closing)
+      {
+        if (openTags.empty() || openTags.back() != tag.name)
+          return malformed(("unexpected </" + tag.name + ">").c_str());
+        openTags.pop_back();
+      }
+      else
+      {
+        const std::size_t depth = openTags.size();
+        if (depth == 0)
+        {
+          lib = tag.name;
+          seenGeometry |= lib == "geometry_lib";
+          seenScenes   |= lib == "scenes";
+        }
+        else if (depth == 1 && lib == "geometry_lib" && tag.name == "mesh")
+        {
+          if (events.onMesh)
+            events.onMesh(tag.Attr("id"), libraryRootDir + "/" + std::string(tag.Attr("loc")));
+        }
+        else if (depth == 1 && lib == "cam_lib" && tag.name == "camera")
+        {
+          cam = {};
+          inCamera = true;
+        }
+        else if (depth == 2 && inCamera)
+        {
+          cameraField = tag.name;
+          text.clear();
+        }
+        else if (depth == 1 && lib == "scenes" && tag.name == "scene")
+        {
+          ++sceneIndex;
+          if (sceneIndex == 0 && events.onSceneBegin)
+            events.onSceneBegin(tag.Attr("discard") == "1");
+        }
+        else if (depth == 2 && lib == "scenes" && sceneIndex == 0)
+        {
+          if (tag.name == "instance" && !seenLightInstance)
+          {
+            if (events.onInstance)
+              events.onInstance(uintFrom(tag.Attr("id")), tag.Attr("mesh_id"), matrixFrom(tag.Attr("matrix")));
+          }
+          else if (tag.name == "instance_light")
+          {
+            seenLightInstance = true;
+            LightInstance light;
+            light.instId  = uintFrom(tag.Attr("id"));
+            light.lightId = uintFrom(tag.Attr("light_id"));
+            light.matrix  = matrixFrom(tag.Attr("matrix"));
+            if (events.onLightInstance)
+              events.onLightInstance(light);
+          }
+        }
+
+        if (!tag.selfClosing)
+        {
+          openTags.push_back(tag.name);
+          continue;
+        }
+      }
+
+      // the element has ended, openTags no longer contains it
+      const std::size_t depth = openTags.size();
+      if (depth == 2 && inCamera && !cameraField.empty())
+      {
+        decodeEntities(text);
+        readCameraField(cam, cameraField, text);
+        cameraField.clear();
+      }
+      else if (depth == 1 && inCamera)
+      {
+        inCamera = false;
+        if (events.onCamera)
+          events.onCamera(cam);
+      }
+      else if (depth == 0 && tag.name == "geometry_lib")
+      {
+        if (events.onGeometryLibEnd)
+          events.onGeometryLibEnd();
+      }
+    }
+
+    if (!openTags.empty())
+      return malformed(("unterminated <" + openTags.back() + ">").c_str());
+
+    if (!seenGeometry || !seenScenes)
+    {
+      logError("Loaded state (" + path + ") doesn't have one of (geometry_lib, scenes)");
+      return -1;
+    }
+
+    return 0;
+  }
+}
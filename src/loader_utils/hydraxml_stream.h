@@ -0,0 +1,38 @@
+#ifndef HYDRAXML_STREAM_H
+#define HYDRAXML_STREAM_H
+
+#include "hydraxml.h"
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace hydra_xml
+{
+  // Callbacks for ReadSceneStreaming, any of them may be left empty.
+  // Strings passed to them are only valid for the duration of the call.
+  struct SceneEvents
+  {
+    // a geometry_lib entry, loc is already prefixed with the scene directory
+    std::function<void(std::string_view id, const std::string& loc)> onMesh;
+    // closing </geometry_lib>, every onMesh has been delivered by now
+    std::function<void()> onGeometryLibEnd;
+    std::function<void(const Camera& cam)> onCamera;
+    // opening tag of the first scene; in change files discard means the scene was
+    // cleared and every instance that is still alive is listed again
+    std::function<void(bool discard)> onSceneBegin;
+    // instances of the first scene, in file order; like HydraScene, mesh instances
+    // that come after the first instance_light (light geometry) are skipped
+    std::function<void(uint32_t instId, std::string_view meshId, const LiteMath::float4x4& matrix)> onInstance;
+    // instNode/lightNode are left empty, there is no DOM to point into
+    std::function<void(const LightInstance& light)> onLightInstance;
+  };
+
+  // Single pass over a hydra scene xml that never builds a DOM. The file is read in fixed
+  // size blocks and only geometry_lib, cam_lib and scenes are looked at, so memory use is
+  // bounded by the largest single tag instead of the file size.
+  // Returns 0 on success and -1 if the file can't be read or is malformed.
+  int ReadSceneStreaming(const std::string& path, const SceneEvents& events);
+}
+
+#endif //HYDRAXML_STREAM_H
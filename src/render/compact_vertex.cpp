@@ -0,0 +1,130 @@
+#include "compact_vertex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+namespace
+{
+  uint16_t toHalf(float value)
+  {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const uint32_t sign     = (bits >> 16) & 0x8000u;
+    const int32_t  exponent = static_cast<int32_t>((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa       = bits & 0x7fffffu;
+
+    if (((bits >> 23) & 0xffu) == 0xffu)
+      return static_cast<uint16_t>(sign | 0x7c00u | (mantissa != 0 ? 0x200u : 0u));
+    if (exponent >= 31)
+      return static_cast<uint16_t>(sign | 0x7c00u);
+    if (exponent <= 0)
+    {
+      if (exponent < -10)
+        return static_cast<uint16_t>(sign);
+      // subnormal half
+      mantissa |= 0x800000u;
+      const uint32_t shift = static_cast<uint32_t>(14 - exponent);
+      uint32_t half = mantissa >> shift;
+      if ((mantissa >> (shift - 1)) & 1u)
+        ++half;
+      return static_cast<uint16_t>(sign | half);
+    }
+
+    // a carry out of the mantissa correctly bumps the exponent
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u)
+      ++half;
+    return static_cast<uint16_t>(half);
+  }
+
+  // unit vector -> point of the octahedron unfolded onto [-1, 1]^2
+  void octahedral(const float* n, float& x, float& y)
+  {
+    const float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+    if (l1 == 0.0f)
+    {
+      x = y = 0.0f;
+      return;
+    }
+
+    x = n[0] / l1;
+    y = n[1] / l1;
+    if (n[2] < 0.0f)
+    {
+      const float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+      const float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+      x = foldedX;
+      y = foldedY;
+    }
+  }
+
+  int32_t snorm(float v, float scale)
+  {
+    return static_cast<int32_t>(std::round(std::clamp(v, -1.0f, 1.0f) * scale));
+  }
+
+  // same as DecodeNormal in unpack_attributes.h
+  void decodePackedNormal(float packed, float* n)
+  {
+    uint32_t data;
+    std::memcpy(&data, &packed, sizeof(data));
+
+    const uint32_t encX = data & 0x0000ffffu;
+    const uint32_t encY = (data & 0xffff0000u) >> 16;
+    const float sign    = (encX & 0x0001u) != 0 ? -1.0f : 1.0f;
+
+    const int usX = static_cast<int>(encX & 0x0000fffeu);
+    const int usY = static_cast<int>(encY & 0x0000ffffu);
+    const int sX  = usX <= 32767 ? usX : usX - 65536;
+    const int sY  = usY <= 32767 ? usY : usY - 65536;
+
+    n[0] = static_cast<float>(sX) * (1.0f / 32767.0f);
+    n[1] = static_cast<float>(sY) * (1.0f / 32767.0f);
+    n[2] = sign * std::sqrt(std::max(1.0f - n[0] * n[0] - n[1] * n[1], 0.0f));
+  }
+}
+
+CompactVertex packCompactVertex(const float* pos, const float* norm, const float* tang, const float* uv,
+  const LiteMath::Box4f& bbox)
+{
+  CompactVertex result;
+
+  const float boxMin[3] = { bbox.boxMin.x, bbox.boxMin.y, bbox.boxMin.z };
+  const float boxMax[3] = { bbox.boxMax.x, bbox.boxMax.y, bbox.boxMax.z };
+  for (int i = 0; i < 3; ++i)
+  {
+    const float extent = boxMax[i] - boxMin[i];
+    const float t = extent > 0.0f ? (pos[i] - boxMin[i]) / extent : 0.0f;
+    result.position[i] = static_cast<uint16_t>(std::round(std::clamp(t, 0.0f, 1.0f) * 65535.0f));
+  }
+
+  float x, y;
+  octahedral(norm, x, y);
+  result.normal[0] = static_cast<int16_t>(snorm(x, 32767.0f));
+  result.normal[1] = static_cast<int16_t>(snorm(y, 32767.0f));
+
+  octahedral(tang, x, y);
+  const auto tangX = static_cast<uint32_t>(snorm(x, 127.0f)) & 0xffu;
+  const auto tangY = static_cast<uint32_t>(snorm(y, 127.0f)) & 0xffu;
+  result.tangent = static_cast<uint16_t>(tangX | (tangY << 8));
+
+  result.texCoord[0] = toHalf(uv[0]);
+  result.texCoord[1] = toHalf(uv[1]);
+
+  return result;
+}
+
+void compactFrom8F(const float* src, std::size_t count, const LiteMath::Box4f& bbox, CompactVertex* dst)
+{
+  for (std::size_t i = 0; i < count; ++i, src += 8)
+  {
+    float norm[3];
+    float tang[3];
+    decodePackedNormal(src[3], norm);
+    decodePackedNormal(src[6], tang);
+    dst[i] = packCompactVertex(src, norm, tang, src + 4, bbox);
+  }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../loader_utils/LiteMath.h"
+
+
+// Vertex of SceneManager's VertexFormat::Compact, half the size of a Mesh8F vertex.
+// Decoded by static_mesh_compact.vert, which gets the bbox from the mesh infos buffer.
+struct CompactVertex
+{
+  uint16_t position[3]; // unorm, relative to the mesh bbox
+  uint16_t tangent;     // octahedral, snorm8 x in the low byte and y in the high one
+  int16_t  normal[2];   // octahedral, snorm16
+  uint16_t texCoord[2]; // half floats
+};
+
+static_assert(sizeof(CompactVertex) == 16);
+
+// only xyz of pos, norm and tang are read, a zero normal/tangent decodes to +z like in Mesh8F
+CompactVertex packCompactVertex(const float* pos, const float* norm, const float* tang, const float* uv,
+  const LiteMath::Box4f& bbox);
+
+// converts count vertices laid out like Mesh8F (see VsgfView::EncodeVertices8F)
+void compactFrom8F(const float* src, std::size_t count, const LiteMath::Box4f& bbox, CompactVertex* dst);
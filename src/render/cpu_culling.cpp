@@ -0,0 +1,277 @@
+#include "cpu_culling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define CPU_CULLING_X86 1
+  #include <immintrin.h>
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+    // MSVC takes AVX intrinsics anywhere, the runtime check is all it needs
+    #define CPU_CULLING_AVX_TARGET
+  #else
+    #define CPU_CULLING_AVX_TARGET __attribute__((target("avx")))
+  #endif
+#else
+  #define CPU_CULLING_X86 0
+#endif
+
+
+namespace
+{
+  // big enough to not feel the hand-out atomic, small enough to balance on a few threads
+  constexpr std::size_t CHUNK_SIZE = 16 * 1024;
+
+  struct CullInput
+  {
+    const glm::mat4& projView;
+    std::span<const GpuInstanceInfo> instances;
+    std::span<const glm::mat4> matrices;
+    std::span<const LiteMath::Box4f> meshBoxes;
+
+    const LiteMath::Box4f* BoxOf(std::size_t i) const
+    {
+      const auto& info = instances[i];
+      if (!info.renderMark || info.mesh_id >= meshBoxes.size())
+        return nullptr;
+      return &meshBoxes[info.mesh_id];
+    }
+  };
+
+  using CullRange = void (*)(const CullInput&, std::size_t, std::size_t, std::vector<uint32_t>&);
+
+  void cullRangeScalar(const CullInput& in, std::size_t first, std::size_t last, std::vector<uint32_t>& out)
+  {
+    const glm::mat4& pv = in.projView;
+    for (std::size_t i = first; i < last; ++i)
+    {
+      const LiteMath::Box4f* box = in.BoxOf(i);
+      if (box == nullptr)
+        continue;
+      const glm::mat4& m = in.matrices[i];
+
+      bool left = true, right = true, top = true, bottom = true, front = true, back = true;
+      for (uint32_t j = 0; j < 8; ++j)
+      {
+        const float cx = (j & 4) ? box->boxMax.x : box->boxMin.x;
+        const float cy = (j & 2) ? box->boxMax.y : box->boxMin.y;
+        const float cz = (j & 1) ? box->boxMax.z : box->boxMin.z;
+
+        float world[3];
+        for (int k = 0; k < 3; ++k)
+          world[k] = m[0][k] * cx + m[1][k] * cy + m[2][k] * cz + m[3][k];
+
+        float clip[4];
+        for (int k = 0; k < 4; ++k)
+          clip[k] = pv[0][k] * world[0] + pv[1][k] * world[1] + pv[2][k] * world[2] + pv[3][k];
+
+        const float w = std::abs(clip[3]);
+        const float x = clip[0] / w;
+        const float y = clip[1] / w;
+        const float z = clip[2] / w;
+        left   = left   && x < -1;
+        right  = right  && x > 1;
+        top    = top    && y < -1;
+        bottom = bottom && y > 1;
+        front  = front  && z > 1;
+        back   = back   && z < 0;
+      }
+
+      if (!(left || right || top || bottom || front || back))
+        out.push_back(static_cast<uint32_t>(i));
+    }
+  }
+
+#if CPU_CULLING_X86
+  // lanes 0-3 are corners with x = min, 4-7 with x = max
+  void cullRangeSse(const CullInput& in, std::size_t first, std::size_t last, std::vector<uint32_t>& out)
+  {
+    const float* pv = &in.projView[0][0];
+    __m128 P[16];
+    for (int k = 0; k < 16; ++k)
+      P[k] = _mm_set1_ps(pv[k]);
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+
+    for (std::size_t i = first; i < last; ++i)
+    {
+      const LiteMath::Box4f* box = in.BoxOf(i);
+      if (box == nullptr)
+        continue;
+      const float* m = &in.matrices[i][0][0];
+
+      const __m128 cy = _mm_set_ps(box->boxMax.y, box->boxMax.y, box->boxMin.y, box->boxMin.y);
+      const __m128 cz = _mm_set_ps(box->boxMax.z, box->boxMin.z, box->boxMax.z, box->boxMin.z);
+
+      int left = 0, right = 0, top = 0, bottom = 0, front = 0, back = 0;
+      for (int half = 0; half < 2; ++half)
+      {
+        const __m128 cx = _mm_set1_ps(half ? box->boxMax.x : box->boxMin.x);
+
+        __m128 world[3];
+        for (int k = 0; k < 3; ++k)
+          world[k] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_set1_ps(m[k]), cx),
+            _mm_mul_ps(_mm_set1_ps(m[4 + k]), cy)),
+            _mm_mul_ps(_mm_set1_ps(m[8 + k]), cz)),
+            _mm_set1_ps(m[12 + k]));
+
+        __m128 clip[4];
+        for (int k = 0; k < 4; ++k)
+          clip[k] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(P[k], world[0]),
+            _mm_mul_ps(P[4 + k], world[1])),
+            _mm_mul_ps(P[8 + k], world[2])),
+            P[12 + k]);
+
+        const __m128 w = _mm_andnot_ps(signBit, clip[3]);
+        const __m128 x = _mm_div_ps(clip[0], w);
+        const __m128 y = _mm_div_ps(clip[1], w);
+        const __m128 z = _mm_div_ps(clip[2], w);
+
+        const int shift = half * 4;
+        left   |= _mm_movemask_ps(_mm_cmplt_ps(x, minusOne)) << shift;
+        right  |= _mm_movemask_ps(_mm_cmpgt_ps(x, one)) << shift;
+        top    |= _mm_movemask_ps(_mm_cmplt_ps(y, minusOne)) << shift;
+        bottom |= _mm_movemask_ps(_mm_cmpgt_ps(y, one)) << shift;
+        front  |= _mm_movemask_ps(_mm_cmpgt_ps(z, one)) << shift;
+        back   |= _mm_movemask_ps(_mm_cmplt_ps(z, zero)) << shift;
+      }
+
+      // outside if all 8 corners are past the same plane
+      if (left != 0xFF && right != 0xFF && top != 0xFF && bottom != 0xFF && front != 0xFF && back != 0xFF)
+        out.push_back(static_cast<uint32_t>(i));
+    }
+  }
+
+  // corner j is in lane j, same numbering as the scalar loop
+  CPU_CULLING_AVX_TARGET
+  void cullRangeAvx(const CullInput& in, std::size_t first, std::size_t last, std::vector<uint32_t>& out)
+  {
+    const float* pv = &in.projView[0][0];
+    __m256 P[16];
+    for (int k = 0; k < 16; ++k)
+      P[k] = _mm256_set1_ps(pv[k]);
+
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minusOne = _mm256_set1_ps(-1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+    for (std::size_t i = first; i < last; ++i)
+    {
+      const LiteMath::Box4f* box = in.BoxOf(i);
+      if (box == nullptr)
+        continue;
+      const float* m = &in.matrices[i][0][0];
+
+      const __m256 cx = _mm256_blend_ps(_mm256_set1_ps(box->boxMin.x), _mm256_set1_ps(box->boxMax.x), 0xF0);
+      const __m256 cy = _mm256_blend_ps(_mm256_set1_ps(box->boxMin.y), _mm256_set1_ps(box->boxMax.y), 0xCC);
+      const __m256 cz = _mm256_blend_ps(_mm256_set1_ps(box->boxMin.z), _mm256_set1_ps(box->boxMax.z), 0xAA);
+
+      __m256 world[3];
+      for (int k = 0; k < 3; ++k)
+        world[k] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+          _mm256_mul_ps(_mm256_set1_ps(m[k]), cx),
+          _mm256_mul_ps(_mm256_set1_ps(m[4 + k]), cy)),
+          _mm256_mul_ps(_mm256_set1_ps(m[8 + k]), cz)),
+          _mm256_set1_ps(m[12 + k]));
+
+      __m256 clip[4];
+      for (int k = 0; k < 4; ++k)
+        clip[k] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+          _mm256_mul_ps(P[k], world[0]),
+          _mm256_mul_ps(P[4 + k], world[1])),
+          _mm256_mul_ps(P[8 + k], world[2])),
+          P[12 + k]);
+
+      const __m256 w = _mm256_andnot_ps(signBit, clip[3]);
+      const __m256 x = _mm256_div_ps(clip[0], w);
+      const __m256 y = _mm256_div_ps(clip[1], w);
+      const __m256 z = _mm256_div_ps(clip[2], w);
+
+      // ordered compares, a NaN corner is never past a plane, same as in GLSL
+      if (_mm256_movemask_ps(_mm256_cmp_ps(x, minusOne, _CMP_LT_OQ)) != 0xFF
+        && _mm256_movemask_ps(_mm256_cmp_ps(x, one, _CMP_GT_OQ)) != 0xFF
+        && _mm256_movemask_ps(_mm256_cmp_ps(y, minusOne, _CMP_LT_OQ)) != 0xFF
+        && _mm256_movemask_ps(_mm256_cmp_ps(y, one, _CMP_GT_OQ)) != 0xFF
+        && _mm256_movemask_ps(_mm256_cmp_ps(z, one, _CMP_GT_OQ)) != 0xFF
+        && _mm256_movemask_ps(_mm256_cmp_ps(z, zero, _CMP_LT_OQ)) != 0xFF)
+        out.push_back(static_cast<uint32_t>(i));
+    }
+  }
+#endif
+}
+
+CpuFrustumCuller::Isa CpuFrustumCuller::DetectIsa()
+{
+#if CPU_CULLING_X86
+  #if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    // the OS has to save the upper halves of the registers too
+    if (avx && osxsave && (_xgetbv(0) & 6) == 6)
+      return Isa::Avx;
+  #else
+    if (__builtin_cpu_supports("avx"))
+      return Isa::Avx;
+  #endif
+  // part of x86-64 itself
+  return Isa::Sse;
+#else
+  return Isa::Scalar;
+#endif
+}
+
+const char* CpuFrustumCuller::IsaName(Isa isa)
+{
+  switch (isa)
+  {
+  case Isa::Scalar: return "scalar";
+  case Isa::Sse:    return "sse";
+  case Isa::Avx:    return "avx";
+  }
+  return "unknown";
+}
+
+CpuFrustumCuller::CpuFrustumCuller(std::size_t threadCount, Isa isa)
+  : m_threadCount(std::max<std::size_t>(threadCount, 1))
+  , m_isa(std::min(isa, DetectIsa()))
+{
+}
+
+void CpuFrustumCuller::Cull(const glm::mat4& projView, std::span<const GpuInstanceInfo> instances,
+  std::span<const glm::mat4> matrices, std::span<const LiteMath::Box4f> meshBoxes, std::vector<uint32_t>& visible)
+{
+  const CullInput input{projView, instances, matrices, meshBoxes};
+  const std::size_t count = std::min(instances.size(), matrices.size());
+  const std::size_t chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+  CullRange cullRange = cullRangeScalar;
+#if CPU_CULLING_X86
+  if (m_isa == Isa::Sse)
+    cullRange = cullRangeSse;
+  else if (m_isa == Isa::Avx)
+    cullRange = cullRangeAvx;
+#endif
+
+  if (m_chunkVisible.size() < chunks)
+    m_chunkVisible.resize(chunks);
+
+  parallelFor(chunks, m_threadCount, [&](std::size_t c) {
+    auto& out = m_chunkVisible[c];
+    out.clear();
+    cullRange(input, c * CHUNK_SIZE, std::min(count, (c + 1) * CHUNK_SIZE), out);
+  });
+
+  // chunks are in instance order, so the result is too
+  visible.clear();
+  for (std::size_t c = 0; c < chunks; ++c)
+    visible.insert(visible.end(), m_chunkVisible[c].begin(), m_chunkVisible[c].end());
+}
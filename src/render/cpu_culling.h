@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene_mgr.h"
+#include "../utils/parallel.h"
+
+
+// Frustum culling of static mesh instances on the CPU, straight from SceneManager's instance
+// matrices and mesh bboxes. A fallback for devices where culling.comp is slow, and a reference
+// to check its output against: the test is the same one, done in the same order
+// (world space corners first, then projView, divide by |w|) and, on x86, without FMA.
+// The 8 corners of a box fill the 8 lanes of an AVX register, SSE does them in two halves.
+class CpuFrustumCuller
+{
+public:
+  enum class Isa
+  {
+    Scalar,
+    Sse,
+    Avx,
+  };
+
+  // the best one this CPU and build can run
+  static Isa DetectIsa();
+  static const char* IsaName(Isa isa);
+
+  explicit CpuFrustumCuller(std::size_t threadCount = defaultWorkerCount(), Isa isa = DetectIsa());
+
+  // Indices of the visible instances in increasing order, the set culling.comp puts into
+  // the mapping buffer with CULL_PASS_ALL. Instances with renderMark unset or a mesh_id
+  // past the end of meshBoxes are skipped, same as on the GPU.
+  void Cull(const glm::mat4& projView, std::span<const GpuInstanceInfo> instances,
+    std::span<const glm::mat4> matrices, std::span<const LiteMath::Box4f> meshBoxes,
+    std::vector<uint32_t>& visible);
+
+  Isa GetIsa() const { return m_isa; }
+  std::size_t ThreadCount() const { return m_threadCount; }
+
+private:
+  std::size_t m_threadCount;
+  Isa m_isa;
+
+  // one per chunk, kept around so culling every frame doesn't allocate
+  std::vector<std::vector<uint32_t>> m_chunkVisible;
+};
@@ -0,0 +1,665 @@
+#include "gpu_allocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <sstream>
+
+#include "vk_utils.h"
+
+
+namespace
+{
+  thread_local const char* t_currentTag = GpuAllocator::UNTAGGED;
+
+  VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+  {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+  }
+
+  // Four classes per power of two below 1 MB (at most 25% slack), 64 KB steps above.
+  // Reloading a scene with slightly different sizes then lands in the holes the old one left.
+  VkDeviceSize sizeClass(VkDeviceSize size)
+  {
+    constexpr VkDeviceSize MIN_CLASS  = 256;
+    constexpr VkDeviceSize LARGE      = 1024 * 1024;
+    constexpr VkDeviceSize LARGE_STEP = 64 * 1024;
+
+    if (size <= MIN_CLASS)
+      return MIN_CLASS;
+    if (size > LARGE)
+      return alignUp(size, LARGE_STEP);
+    return alignUp(size, std::bit_floor(size) / 4);
+  }
+
+  void writeJsonString(std::ostream& out, const std::string& str)
+  {
+    out << '"';
+    for (char c : str)
+    {
+      if (c == '"' || c == '\\')
+        out << '\\';
+      out << c;
+    }
+    out << '"';
+  }
+}
+
+void writeStatsJson(std::ostream& out, const GpuAllocatorStats& stats)
+{
+  out << "{\n";
+  out << "  \"deviceAllocations\": " << stats.deviceAllocations << ",\n";
+  out << "  \"maxDeviceAllocations\": " << stats.maxDeviceAllocations << ",\n";
+  out << "  \"allocateCalls\": " << stats.allocateCalls << ",\n";
+  out << "  \"hasBudget\": " << (stats.hasBudget ? "true" : "false") << ",\n";
+
+  out << "  \"heaps\": [";
+  for (std::size_t i = 0; i < stats.heaps.size(); ++i)
+  {
+    const auto& heap = stats.heaps[i];
+    out << (i > 0 ? ",\n" : "\n")
+        << "    { \"heapSize\": " << heap.heapSize
+        << ", \"deviceLocal\": " << ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "true" : "false")
+        << ", \"blockBytes\": " << heap.blockBytes
+        << ", \"usedBytes\": " << heap.usedBytes
+        << ", \"blocks\": " << heap.blocks
+        << ", \"allocations\": " << heap.allocations
+        << ", \"budget\": " << heap.budget
+        << ", \"usage\": " << heap.usage << " }";
+  }
+  out << "\n  ],\n";
+
+  out << "  \"tags\": [";
+  for (std::size_t i = 0; i < stats.tags.size(); ++i)
+  {
+    const auto& tag = stats.tags[i];
+    out << (i > 0 ? ",\n" : "\n") << "    { \"name\": ";
+    writeJsonString(out, tag.name);
+    out << ", \"bytes\": " << tag.bytes
+        << ", \"peakBytes\": " << tag.peakBytes
+        << ", \"allocations\": " << tag.allocations << " }";
+  }
+  out << "\n  ]\n";
+  out << "}\n";
+}
+
+GpuAllocator::TagScope::TagScope(const char* a_tag)
+  : m_previous(t_currentTag)
+{
+  t_currentTag = a_tag;
+}
+
+GpuAllocator::TagScope::~TagScope()
+{
+  t_currentTag = m_previous;
+}
+
+GpuAllocator::GpuAllocator(VkDevice a_device, VkPhysicalDevice a_physDevice, VkDeviceSize a_blockSize)
+  : m_device(a_device)
+  , m_physDevice(a_physDevice)
+  , m_blockSize(a_blockSize)
+{
+  vkGetPhysicalDeviceMemoryProperties(a_physDevice, &m_memProps);
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(a_physDevice, &props);
+  m_maxAllocations = props.limits.maxMemoryAllocationCount;
+
+  // pool 0 stands for the general blocks
+  m_pools.emplace_back();
+}
+
+GpuAllocator::~GpuAllocator()
+{
+  std::size_t leaked = 0;
+  for (const auto& block : m_blocks)
+    leaked += block->allocations;
+  if (leaked > 0)
+  {
+    std::stringstream ss;
+    ss << "[GpuAllocator::~GpuAllocator] " << leaked << " allocations were never freed";
+    vk_utils::logWarning(ss.str());
+  }
+
+  while (!m_blocks.empty())
+    DestroyBlock(m_blocks.back().get());
+}
+
+GpuAllocation GpuAllocator::Allocate(const VkMemoryRequirements& a_memReq, VkMemoryPropertyFlags a_props,
+  Resource a_resource, PoolId a_pool)
+{
+  std::lock_guard lock(m_mutex);
+
+  const VkMemoryPropertyFlags props = a_pool != GENERAL_POOL ? a_props | m_pools[a_pool].props : a_props;
+  const uint32_t memoryType = FindMemoryType(a_memReq.memoryTypeBits, props);
+  if (a_pool != GENERAL_POOL)
+    return AllocateLinear(m_pools[a_pool], a_pool, memoryType, a_memReq, a_resource);
+
+  const VkDeviceSize blockSize = BlockSizeFor(memoryType, m_blockSize);
+  if (a_memReq.size >= blockSize / 2)
+  {
+    Block* block = CreateBlock(memoryType, a_memReq.size, a_resource, GENERAL_POOL, true);
+    block->freeRanges.clear();
+    return MakeSlot(block, 0, a_memReq.size);
+  }
+
+  const VkDeviceSize size = sizeClass(a_memReq.size);
+  VkDeviceSize offset = 0;
+  for (const auto& block : m_blocks)
+  {
+    if (block->pool != GENERAL_POOL || block->dedicated || block->memoryType != memoryType || block->resource != a_resource)
+      continue;
+    if (PlaceInBlock(*block, size, a_memReq.alignment, offset))
+      return MakeSlot(block.get(), offset, size);
+  }
+
+  Block* block = CreateBlock(memoryType, blockSize, a_resource, GENERAL_POOL, false);
+  PlaceInBlock(*block, size, a_memReq.alignment, offset);
+  return MakeSlot(block, offset, size);
+}
+
+void GpuAllocator::Free(GpuAllocation& a_alloc)
+{
+  if (!a_alloc.IsValid())
+    return;
+
+  std::lock_guard lock(m_mutex);
+
+  Slot& slot = m_slots[a_alloc.slot];
+  if (slot.generation != a_alloc.generation || slot.block == nullptr)
+  {
+    vk_utils::logWarning("[GpuAllocator::Free] stale allocation handle");
+    a_alloc = {};
+    return;
+  }
+
+  Block& block = *slot.block;
+  block.used -= slot.size;
+  --block.allocations;
+  Account(slot.tag, slot.size, false);
+
+  if (block.pool == GENERAL_POOL && !block.dedicated)
+  {
+    auto [it, inserted] = block.freeRanges.emplace(slot.offset, slot.size);
+    auto next = std::next(it);
+    if (next != block.freeRanges.end() && it->first + it->second == next->first)
+    {
+      it->second += next->second;
+      block.freeRanges.erase(next);
+    }
+    if (it != block.freeRanges.begin())
+    {
+      auto prev = std::prev(it);
+      if (prev->first + prev->second == it->first)
+      {
+        prev->second += it->second;
+        block.freeRanges.erase(it);
+      }
+    }
+  }
+
+  // linear blocks only go away with their pool
+  if (block.allocations == 0 && block.dedicated)
+    DestroyBlock(&block);
+  else if (block.allocations == 0 && block.pool == GENERAL_POOL)
+    ReleaseEmptyBlocks(true);
+
+  slot.block = nullptr;
+  ++slot.generation;
+  m_freeSlots.push_back(a_alloc.slot);
+  a_alloc = {};
+}
+
+GpuAllocationInfo GpuAllocator::Info(GpuAllocation a_alloc) const
+{
+  if (!a_alloc.IsValid())
+    return {};
+
+  std::lock_guard lock(m_mutex);
+
+  const Slot& slot = m_slots[a_alloc.slot];
+  if (slot.generation != a_alloc.generation || slot.block == nullptr)
+    return {};
+
+  return GpuAllocationInfo{
+    slot.block->memory, slot.offset, slot.size,
+    slot.block->mapped != nullptr ? slot.block->mapped + slot.offset : nullptr
+  };
+}
+
+GpuAllocation GpuAllocator::AllocateAndBind(const std::vector<VkBuffer>& a_buffers, VkMemoryPropertyFlags a_props,
+  std::vector<VkDeviceSize>* a_offsets)
+{
+  if (a_buffers.empty())
+    return {};
+
+  // same packing as allocateAndBindWithPadding, every buffer at its own alignment
+  std::vector<VkDeviceSize> offsets(a_buffers.size());
+  VkMemoryRequirements groupReq{ 0, 1, ~0u };
+  for (std::size_t i = 0; i < a_buffers.size(); ++i)
+  {
+    VkMemoryRequirements memReq;
+    vkGetBufferMemoryRequirements(m_device, a_buffers[i], &memReq);
+
+    offsets[i] = alignUp(groupReq.size, memReq.alignment);
+    groupReq.size = offsets[i] + memReq.size;
+    groupReq.alignment = std::max(groupReq.alignment, memReq.alignment);
+    groupReq.memoryTypeBits &= memReq.memoryTypeBits;
+  }
+
+  if (groupReq.memoryTypeBits == 0)
+    RUN_TIME_ERROR("[GpuAllocator::AllocateAndBind] buffers have no memory type in common");
+
+  GpuAllocation alloc = Allocate(groupReq, a_props, Resource::Buffer);
+  const auto info = Info(alloc);
+  for (std::size_t i = 0; i < a_buffers.size(); ++i)
+    VK_CHECK_RESULT(vkBindBufferMemory(m_device, a_buffers[i], info.memory, info.offset + offsets[i]));
+
+  if (a_offsets != nullptr)
+    *a_offsets = std::move(offsets);
+  return alloc;
+}
+
+void GpuAllocator::CreateImage(uint32_t a_width, uint32_t a_height, VkFormat a_format, VkImageUsageFlags a_usage,
+  vk_utils::VulkanImageMem* a_pImgMem, const VkImageCreateInfo* a_pImageCreateInfo,
+  const VkImageViewCreateInfo* a_pViewCreateInfo, PoolId a_pool)
+{
+  VkImageCreateInfo imageInfo{
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType = VK_IMAGE_TYPE_2D,
+    .format = a_format,
+    .extent = VkExtent3D{ a_width, a_height, 1 },
+    .mipLevels = 1,
+    .arrayLayers = 1,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .usage = a_usage,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+  if (a_pImageCreateInfo != nullptr)
+    imageInfo = *a_pImageCreateInfo;
+
+  VK_CHECK_RESULT(vkCreateImage(m_device, &imageInfo, nullptr, &a_pImgMem->image));
+
+  VkMemoryRequirements memReq;
+  vkGetImageMemoryRequirements(m_device, a_pImgMem->image, &memReq);
+  GpuAllocation alloc = Allocate(memReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, Resource::Image, a_pool);
+  const auto info = Info(alloc);
+  VK_CHECK_RESULT(vkBindImageMemory(m_device, a_pImgMem->image, info.memory, info.offset));
+
+  // owned by us, so a stray vk_utils::deleteImg doesn't free the whole block
+  a_pImgMem->mem    = VK_NULL_HANDLE;
+  a_pImgMem->format = imageInfo.format;
+
+  VkImageViewCreateInfo viewInfo{
+    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+    .format = imageInfo.format,
+    .subresourceRange = VkImageSubresourceRange{
+      .aspectMask = a_pImgMem->aspectMask,
+      .baseMipLevel = 0,
+      .levelCount = imageInfo.mipLevels,
+      .baseArrayLayer = 0,
+      .layerCount = imageInfo.arrayLayers,
+    },
+  };
+  if (a_pViewCreateInfo != nullptr)
+    viewInfo = *a_pViewCreateInfo;
+  viewInfo.image = a_pImgMem->image;
+
+  VK_CHECK_RESULT(vkCreateImageView(m_device, &viewInfo, nullptr, &a_pImgMem->view));
+
+  std::lock_guard lock(m_mutex);
+  m_images[a_pImgMem->image] = alloc;
+}
+
+void GpuAllocator::DestroyImage(vk_utils::VulkanImageMem* a_pImgMem)
+{
+  GpuAllocation alloc;
+  {
+    std::lock_guard lock(m_mutex);
+    if (auto it = m_images.find(a_pImgMem->image); it != m_images.end())
+    {
+      alloc = it->second;
+      m_images.erase(it);
+    }
+  }
+
+  vk_utils::deleteImg(m_device, a_pImgMem);
+  Free(alloc);
+}
+
+GpuAllocator::PoolId GpuAllocator::CreateLinearPool(VkMemoryPropertyFlags a_props, VkDeviceSize a_blockSize)
+{
+  std::lock_guard lock(m_mutex);
+
+  auto pool = std::find_if(m_pools.begin() + 1, m_pools.end(), [](const LinearPool& p) { return !p.alive; });
+  if (pool == m_pools.end())
+    pool = m_pools.insert(m_pools.end(), LinearPool{});
+
+  *pool = LinearPool{ a_props, a_blockSize, 0, true };
+  return static_cast<PoolId>(pool - m_pools.begin());
+}
+
+void GpuAllocator::ResetLinearPool(PoolId a_pool)
+{
+  std::lock_guard lock(m_mutex);
+
+  auto& pool = m_pools[a_pool];
+  std::vector<Block*> blocks;
+  uint32_t live = 0;
+  for (const auto& block : m_blocks)
+  {
+    if (block->pool != a_pool)
+      continue;
+    blocks.push_back(block.get());
+    live += block->allocations;
+  }
+
+  if (live > 0)
+  {
+    std::stringstream ss;
+    ss << "[GpuAllocator::ResetLinearPool] pool " << a_pool << " still has " << live << " allocations, not resetting";
+    vk_utils::logWarning(ss.str());
+    return;
+  }
+
+  // a chain means the pool was too small last time, next time it gets one block that fits
+  if (blocks.size() > 1)
+  {
+    for (auto* block : blocks)
+      DestroyBlock(block);
+    pool.blockSize = std::max(pool.blockSize, pool.highWater);
+  }
+  else
+  {
+    for (auto* block : blocks)
+      block->top = 0;
+  }
+  pool.highWater = 0;
+}
+
+void GpuAllocator::DestroyLinearPool(PoolId a_pool)
+{
+  ResetLinearPool(a_pool);
+
+  std::lock_guard lock(m_mutex);
+  for (std::size_t i = m_blocks.size(); i-- > 0;)
+  {
+    if (m_blocks[i]->pool == a_pool && m_blocks[i]->allocations == 0)
+      DestroyBlock(m_blocks[i].get());
+  }
+  m_pools[a_pool].alive = false;
+}
+
+void GpuAllocator::Trim()
+{
+  std::lock_guard lock(m_mutex);
+  ReleaseEmptyBlocks(false);
+}
+
+void GpuAllocator::TrackImage(VkImage a_image)
+{
+  VkMemoryRequirements memReq;
+  vkGetImageMemoryRequirements(m_device, a_image, &memReq);
+
+  std::lock_guard lock(m_mutex);
+  const uint32_t tag = CurrentTag();
+  auto [it, inserted] = m_trackedImages.emplace(a_image, std::make_pair(tag, memReq.size));
+  if (inserted)
+    Account(tag, memReq.size, true);
+}
+
+void GpuAllocator::UntrackImage(VkImage a_image)
+{
+  std::lock_guard lock(m_mutex);
+  if (auto it = m_trackedImages.find(a_image); it != m_trackedImages.end())
+  {
+    Account(it->second.first, it->second.second, false);
+    m_trackedImages.erase(it);
+  }
+}
+
+GpuAllocatorStats GpuAllocator::Stats() const
+{
+  std::lock_guard lock(m_mutex);
+
+  GpuAllocatorStats stats;
+  stats.heaps.resize(m_memProps.memoryHeapCount);
+  for (uint32_t i = 0; i < m_memProps.memoryHeapCount; ++i)
+  {
+    stats.heaps[i].heapSize = m_memProps.memoryHeaps[i].size;
+    stats.heaps[i].flags    = m_memProps.memoryHeaps[i].flags;
+  }
+
+  for (const auto& block : m_blocks)
+  {
+    auto& heap = stats.heaps[m_memProps.memoryTypes[block->memoryType].heapIndex];
+    heap.blockBytes  += block->size;
+    heap.usedBytes   += block->used;
+    heap.allocations += block->allocations;
+    ++heap.blocks;
+  }
+
+  if (m_memoryBudget)
+  {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+    };
+    VkPhysicalDeviceMemoryProperties2 props{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+      .pNext = &budget,
+    };
+    vkGetPhysicalDeviceMemoryProperties2(m_physDevice, &props);
+    for (uint32_t i = 0; i < m_memProps.memoryHeapCount; ++i)
+    {
+      stats.heaps[i].budget = budget.heapBudget[i];
+      stats.heaps[i].usage  = budget.heapUsage[i];
+    }
+  }
+
+  stats.deviceAllocations    = static_cast<uint32_t>(m_blocks.size());
+  stats.maxDeviceAllocations = m_maxAllocations;
+  stats.allocateCalls        = m_allocateCalls;
+  stats.hasBudget            = m_memoryBudget;
+  stats.tags                 = m_tags;
+  return stats;
+}
+
+uint32_t GpuAllocator::FindMemoryType(uint32_t a_typeBits, VkMemoryPropertyFlags a_props) const
+{
+  for (uint32_t i = 0; i < m_memProps.memoryTypeCount; ++i)
+  {
+    if ((a_typeBits & (1u << i)) && (m_memProps.memoryTypes[i].propertyFlags & a_props) == a_props)
+      return i;
+  }
+
+  RUN_TIME_ERROR("[GpuAllocator::FindMemoryType] no suitable memory type");
+  return 0;
+}
+
+VkDeviceSize GpuAllocator::BlockSizeFor(uint32_t a_memoryType, VkDeviceSize a_blockSize) const
+{
+  // small heaps (BAR, integrated carve-outs) would be eaten by a couple of blocks
+  const VkDeviceSize heapSize = m_memProps.memoryHeaps[m_memProps.memoryTypes[a_memoryType].heapIndex].size;
+  return std::min(a_blockSize, std::max<VkDeviceSize>(heapSize / 8, 1024 * 1024));
+}
+
+GpuAllocator::Block* GpuAllocator::CreateBlock(uint32_t a_memoryType, VkDeviceSize a_size, Resource a_resource,
+  PoolId a_pool, bool a_dedicated)
+{
+  VkMemoryAllocateInfo allocateInfo{
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .allocationSize = a_size,
+    .memoryTypeIndex = a_memoryType,
+  };
+
+  if (m_blocks.size() >= m_maxAllocations)
+    ReleaseEmptyBlocks(false);
+
+  auto block = std::make_unique<Block>();
+  VkResult result = vkAllocateMemory(m_device, &allocateInfo, nullptr, &block->memory);
+  if (result != VK_SUCCESS)
+  {
+    // spare blocks of other types may be what's in the way
+    ReleaseEmptyBlocks(false);
+    result = vkAllocateMemory(m_device, &allocateInfo, nullptr, &block->memory);
+  }
+  VK_CHECK_RESULT(result);
+  ++m_allocateCalls;
+
+  block->size       = a_size;
+  block->memoryType = a_memoryType;
+  block->resource   = a_resource;
+  block->pool       = a_pool;
+  block->dedicated  = a_dedicated;
+  block->freeRanges.emplace(0, a_size);
+
+  if (m_memProps.memoryTypes[a_memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+  {
+    void* mapped = nullptr;
+    VK_CHECK_RESULT(vkMapMemory(m_device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+    block->mapped = static_cast<std::byte*>(mapped);
+  }
+
+  m_blocks.push_back(std::move(block));
+  return m_blocks.back().get();
+}
+
+void GpuAllocator::DestroyBlock(Block* a_block)
+{
+  if (a_block->mapped != nullptr)
+    vkUnmapMemory(m_device, a_block->memory);
+  vkFreeMemory(m_device, a_block->memory, nullptr);
+
+  auto it = std::find_if(m_blocks.begin(), m_blocks.end(), [a_block](const auto& b) { return b.get() == a_block; });
+  m_blocks.erase(it);
+}
+
+bool GpuAllocator::PlaceInBlock(Block& a_block, VkDeviceSize a_size, VkDeviceSize a_alignment, VkDeviceSize& a_offset)
+{
+  // best fit, the smallest hole that still takes it
+  auto best = a_block.freeRanges.end();
+  for (auto it = a_block.freeRanges.begin(); it != a_block.freeRanges.end(); ++it)
+  {
+    const VkDeviceSize start = alignUp(it->first, a_alignment);
+    if (start + a_size > it->first + it->second)
+      continue;
+    if (best == a_block.freeRanges.end() || it->second < best->second)
+      best = it;
+  }
+  if (best == a_block.freeRanges.end())
+    return false;
+
+  const VkDeviceSize rangeStart = best->first;
+  const VkDeviceSize rangeEnd   = best->first + best->second;
+  a_offset = alignUp(rangeStart, a_alignment);
+
+  a_block.freeRanges.erase(best);
+  if (a_offset > rangeStart)
+    a_block.freeRanges.emplace(rangeStart, a_offset - rangeStart);
+  if (a_offset + a_size < rangeEnd)
+    a_block.freeRanges.emplace(a_offset + a_size, rangeEnd - a_offset - a_size);
+  return true;
+}
+
+GpuAllocation GpuAllocator::MakeSlot(Block* a_block, VkDeviceSize a_offset, VkDeviceSize a_size)
+{
+  a_block->used += a_size;
+  ++a_block->allocations;
+
+  uint32_t index;
+  if (!m_freeSlots.empty())
+  {
+    index = m_freeSlots.back();
+    m_freeSlots.pop_back();
+  }
+  else
+  {
+    index = static_cast<uint32_t>(m_slots.size());
+    m_slots.emplace_back();
+  }
+
+  Slot& slot  = m_slots[index];
+  slot.block  = a_block;
+  slot.offset = a_offset;
+  slot.size   = a_size;
+  slot.tag    = CurrentTag();
+  Account(slot.tag, a_size, true);
+  return GpuAllocation{ index, slot.generation };
+}
+
+GpuAllocation GpuAllocator::AllocateLinear(LinearPool& a_pool, PoolId a_poolId, uint32_t a_memoryType,
+  const VkMemoryRequirements& a_memReq, Resource a_resource)
+{
+  a_pool.highWater += a_memReq.size + a_memReq.alignment;
+
+  // only the newest block of the chain is bumped
+  Block* current = nullptr;
+  for (const auto& block : m_blocks)
+  {
+    if (block->pool == a_poolId && block->memoryType == a_memoryType && block->resource == a_resource)
+      current = block.get();
+  }
+
+  VkDeviceSize offset = current != nullptr ? alignUp(current->top, a_memReq.alignment) : 0;
+  if (current == nullptr || offset + a_memReq.size > current->size)
+  {
+    current = CreateBlock(a_memoryType, std::max(a_pool.blockSize, a_memReq.size), a_resource, a_poolId, false);
+    offset = 0;
+  }
+
+  current->top = offset + a_memReq.size;
+  return MakeSlot(current, offset, a_memReq.size);
+}
+
+void GpuAllocator::ReleaseEmptyBlocks(bool a_keepSpare)
+{
+  std::vector<std::pair<uint32_t, Resource>> spared;
+  for (std::size_t i = 0; i < m_blocks.size();)
+  {
+    Block& block = *m_blocks[i];
+    if (block.allocations > 0 || block.pool != GENERAL_POOL)
+    {
+      ++i;
+      continue;
+    }
+
+    const auto key = std::make_pair(block.memoryType, block.resource);
+    if (a_keepSpare && std::find(spared.begin(), spared.end(), key) == spared.end())
+    {
+      spared.push_back(key);
+      ++i;
+      continue;
+    }
+    DestroyBlock(&block);
+  }
+}
+
+uint32_t GpuAllocator::CurrentTag()
+{
+  // a handful of tags at most, nothing to index
+  for (std::size_t i = 0; i < m_tags.size(); ++i)
+  {
+    if (m_tags[i].name == t_currentTag)
+      return static_cast<uint32_t>(i);
+  }
+  m_tags.push_back(GpuTagStats{ .name = t_currentTag });
+  return static_cast<uint32_t>(m_tags.size() - 1);
+}
+
+void GpuAllocator::Account(uint32_t a_tag, VkDeviceSize a_size, bool a_add)
+{
+  auto& tag = m_tags[a_tag];
+  if (a_add)
+  {
+    tag.bytes += a_size;
+    ++tag.allocations;
+    tag.peakBytes = std::max(tag.peakBytes, tag.bytes);
+  }
+  else
+  {
+    tag.bytes -= a_size;
+    --tag.allocations;
+  }
+}
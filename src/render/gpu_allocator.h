@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_images.h"
+
+
+// Names a piece of memory owned by GpuAllocator. Where it lives is only known through
+// GpuAllocator::Info, so the allocator stays free to move things around, and a handle
+// that outlived its allocation is caught by the generation check instead of aliasing.
+struct GpuAllocation
+{
+  uint32_t slot = UINT32_MAX;
+  uint32_t generation = 0;
+
+  bool IsValid() const { return slot != UINT32_MAX; }
+};
+
+struct GpuAllocationInfo
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  // host visible blocks stay mapped for their whole life
+  std::byte* mapped = nullptr;
+};
+
+struct GpuHeapStats
+{
+  VkDeviceSize heapSize   = 0;
+  VkMemoryHeapFlags flags = 0;
+  VkDeviceSize blockBytes = 0; // taken from the driver
+  VkDeviceSize usedBytes  = 0; // handed out, including size class rounding
+  uint32_t blocks      = 0;
+  uint32_t allocations = 0;
+  // VK_EXT_memory_budget, zero when it's not enabled. Usage is the whole process as the
+  // driver sees it, so it also covers memory that didn't come from the allocator.
+  VkDeviceSize budget = 0;
+  VkDeviceSize usage  = 0;
+};
+
+// What one subsystem holds, see GpuAllocator::TagScope
+struct GpuTagStats
+{
+  std::string name;
+  VkDeviceSize bytes     = 0;
+  VkDeviceSize peakBytes = 0;
+  uint32_t allocations   = 0;
+};
+
+struct GpuAllocatorStats
+{
+  // indexed like VkPhysicalDeviceMemoryProperties::memoryHeaps
+  std::vector<GpuHeapStats> heaps;
+  uint32_t deviceAllocations    = 0; // live VkDeviceMemory objects
+  uint32_t maxDeviceAllocations = 0; // VkPhysicalDeviceLimits::maxMemoryAllocationCount
+  uint64_t allocateCalls        = 0; // vkAllocateMemory calls over the whole lifetime
+  bool hasBudget = false;
+  // in order of first use
+  std::vector<GpuTagStats> tags;
+};
+
+void writeStatsJson(std::ostream& out, const GpuAllocatorStats& stats);
+
+// Sub-allocates everything from a few large VkDeviceMemory blocks instead of one
+// vkAllocateMemory per resource group.
+//  - general allocations are rounded up to size classes and placed best fit into shared
+//    blocks, buffers and images never share a block so bufferImageGranularity can't bite;
+//    anything of half a block or more gets a dedicated block
+//  - linear pools bump allocate and are released as a whole, for things that are always
+//    recreated together (render targets on resize)
+// Every allocation is accounted to the tag that was current on the calling thread.
+// All methods are thread safe.
+class GpuAllocator
+{
+public:
+  using PoolId = uint32_t;
+  static constexpr PoolId GENERAL_POOL = 0;
+  static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+  static constexpr const char* UNTAGGED = "untagged";
+
+  // Allocations made on this thread while the scope is alive go to a_tag, scopes nest.
+  // a_tag has to outlive the scope, string literals are what it's meant for.
+  class TagScope
+  {
+  public:
+    explicit TagScope(const char* a_tag);
+    ~TagScope();
+
+    TagScope(const TagScope&) = delete;
+    TagScope& operator=(const TagScope&) = delete;
+
+  private:
+    const char* m_previous;
+  };
+
+  enum class Resource
+  {
+    Buffer,
+    Image,
+  };
+
+  GpuAllocator(VkDevice a_device, VkPhysicalDevice a_physDevice, VkDeviceSize a_blockSize = DEFAULT_BLOCK_SIZE);
+  ~GpuAllocator();
+
+  GpuAllocator(const GpuAllocator&) = delete;
+  GpuAllocator& operator=(const GpuAllocator&) = delete;
+
+  GpuAllocation Allocate(const VkMemoryRequirements& a_memReq, VkMemoryPropertyFlags a_props,
+    Resource a_resource, PoolId a_pool = GENERAL_POOL);
+  // resets a_alloc, freeing an invalid handle does nothing
+  void Free(GpuAllocation& a_alloc);
+  GpuAllocationInfo Info(GpuAllocation a_alloc) const;
+
+  // Drop-in for vk_utils::allocateAndBindWithPadding: one allocation for the whole group,
+  // each buffer bound at its own aligned offset (returned in a_offsets if needed).
+  GpuAllocation AllocateAndBind(const std::vector<VkBuffer>& a_buffers,
+    VkMemoryPropertyFlags a_props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    std::vector<VkDeviceSize>* a_offsets = nullptr);
+
+  // Drop-in for vk_utils::createImgAllocAndBind with the memory coming from a_pool.
+  // a_pImgMem->aspectMask has to be set up front, the same as there.
+  void CreateImage(uint32_t a_width, uint32_t a_height, VkFormat a_format, VkImageUsageFlags a_usage,
+    vk_utils::VulkanImageMem* a_pImgMem, const VkImageCreateInfo* a_pImageCreateInfo = nullptr,
+    const VkImageViewCreateInfo* a_pViewCreateInfo = nullptr, PoolId a_pool = GENERAL_POOL);
+  // replaces vk_utils::deleteImg for images made by CreateImage
+  void DestroyImage(vk_utils::VulkanImageMem* a_pImgMem);
+
+  PoolId CreateLinearPool(VkMemoryPropertyFlags a_props, VkDeviceSize a_blockSize = DEFAULT_BLOCK_SIZE);
+  // Everything allocated from the pool has to be freed (or at least unused) by now.
+  // If the pool had to chain blocks, they are replaced with a single one big enough for all of it.
+  void ResetLinearPool(PoolId a_pool);
+  void DestroyLinearPool(PoolId a_pool);
+
+  // frees blocks with nothing left in them, normally one spare per memory type is kept around
+  void Trim();
+
+  // For images whose memory the allocator doesn't own (vk_utils texture helpers), so they
+  // still show up under the current tag. Untrack before the image is destroyed.
+  void TrackImage(VkImage a_image);
+  void UntrackImage(VkImage a_image);
+
+  // the device has to be created with VK_EXT_memory_budget for this
+  void EnableMemoryBudget(bool a_enable) { m_memoryBudget = a_enable; }
+
+  GpuAllocatorStats Stats() const;
+
+private:
+  struct Block
+  {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    std::byte* mapped = nullptr;
+    uint32_t memoryType = 0;
+    Resource resource = Resource::Buffer;
+    PoolId pool = GENERAL_POOL;
+    bool dedicated = false;
+
+    // general blocks: offset -> size, neighbours are always merged
+    std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+    // linear pool blocks: everything below top is taken
+    VkDeviceSize top = 0;
+
+    VkDeviceSize used = 0;
+    uint32_t allocations = 0;
+  };
+
+  struct Slot
+  {
+    Block* block = nullptr;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t generation = 0;
+    uint32_t tag = 0;
+  };
+
+  struct LinearPool
+  {
+    VkMemoryPropertyFlags props = 0;
+    VkDeviceSize blockSize = 0;
+    // bytes taken since the last reset, the next reset makes one block of at least that much
+    VkDeviceSize highWater = 0;
+    bool alive = false;
+  };
+
+  uint32_t FindMemoryType(uint32_t a_typeBits, VkMemoryPropertyFlags a_props) const;
+  VkDeviceSize BlockSizeFor(uint32_t a_memoryType, VkDeviceSize a_blockSize) const;
+  Block* CreateBlock(uint32_t a_memoryType, VkDeviceSize a_size, Resource a_resource, PoolId a_pool, bool a_dedicated);
+  void DestroyBlock(Block* a_block);
+  bool PlaceInBlock(Block& a_block, VkDeviceSize a_size, VkDeviceSize a_alignment, VkDeviceSize& a_offset);
+  GpuAllocation MakeSlot(Block* a_block, VkDeviceSize a_offset, VkDeviceSize a_size);
+  GpuAllocation AllocateLinear(LinearPool& a_pool, PoolId a_poolId, uint32_t a_memoryType,
+    const VkMemoryRequirements& a_memReq, Resource a_resource);
+  void ReleaseEmptyBlocks(bool a_keepSpare);
+  uint32_t CurrentTag();
+  void Account(uint32_t a_tag, VkDeviceSize a_size, bool a_add);
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  VkPhysicalDevice m_physDevice = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties m_memProps{};
+  VkDeviceSize m_blockSize = 0;
+  uint32_t m_maxAllocations = 0;
+  uint64_t m_allocateCalls = 0;
+  bool m_memoryBudget = false;
+
+  mutable std::mutex m_mutex;
+  std::vector<std::unique_ptr<Block>> m_blocks;
+  std::vector<Slot> m_slots;
+  std::vector<uint32_t> m_freeSlots;
+  std::vector<LinearPool> m_pools;
+  std::unordered_map<VkImage, GpuAllocation> m_images;
+  std::vector<GpuTagStats> m_tags;
+  // tracked images: tag and size
+  std::unordered_map<VkImage, std::pair<uint32_t, VkDeviceSize>> m_trackedImages;
+};
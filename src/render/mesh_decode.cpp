@@ -0,0 +1,122 @@
+#include "mesh_decode.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <span>
+
+
+namespace
+{
+  uint64_t hashBytes(uint64_t h, std::span<const std::byte> bytes)
+  {
+    constexpr uint64_t K = 0x9E3779B97F4A7C15ull;
+
+    std::size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t))
+    {
+      uint64_t word;
+      std::memcpy(&word, bytes.data() + i, sizeof(word));
+      h = (h ^ word) * K;
+      h ^= h >> 29;
+    }
+
+    uint64_t tail = 0;
+    if (i < bytes.size())
+      std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+    h = (h ^ tail ^ bytes.size()) * K;
+    return h ^ (h >> 32);
+  }
+
+  template<typename... Streams>
+  uint64_t hashStreams(const Streams&... streams)
+  {
+    uint64_t h = 0;
+    ((h = hashBytes(h, std::as_bytes(std::span(streams)))), ...);
+    return h;
+  }
+
+  template<typename T>
+  bool sameBytes(std::span<const T> a, std::span<const T> b)
+  {
+    return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size_bytes()) == 0);
+  }
+}
+
+
+LiteMath::Box4f computeMeshBbox(const cmesh::SimpleMesh& mesh)
+{
+  LiteMath::Box4f meshBox;
+  const auto* positions = reinterpret_cast<const LiteMath::float4*>(mesh.vPos4f.data());
+  for (std::size_t i = 0; i < mesh.VerticesNum(); ++i)
+  {
+    meshBox.include(positions[i]);
+  }
+  return meshBox;
+}
+
+MappedMesh mapMeshFile(const std::string& meshPath, bool optimize)
+{
+  using Clock = std::chrono::steady_clock;
+  auto msBetween = [](Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<float, std::milli>(to - from).count();
+  };
+
+  MappedMesh result;
+  const std::string path = optimize ? optimizeMeshFile(meshPath, result.optimize) : meshPath;
+
+  const auto start = Clock::now();
+  auto file = std::make_shared<VsgfView>(path);
+  if (file->IsOpen())
+  {
+    const auto mapped = Clock::now();
+    result.bbox = file->ComputeBbox();
+    const auto bounded = Clock::now();
+    result.hash = hashMeshPayload(*file);
+    result.file = std::move(file);
+
+    result.bboxMs   = msBetween(mapped, bounded);
+    result.decodeMs = msBetween(start, mapped) + msBetween(bounded, Clock::now());
+  }
+  return result;
+}
+
+uint64_t hashMeshPayload(const cmesh::SimpleMesh& mesh)
+{
+  return hashStreams(mesh.vPos4f, mesh.vNorm4f, mesh.vTang4f, mesh.vTexCoord2f, mesh.indices);
+}
+
+uint64_t hashMeshPayload(const VsgfView& mesh)
+{
+  return hashStreams(mesh.Positions(), mesh.Normals(), mesh.Tangents(), mesh.TexCoords(), mesh.Indices());
+}
+
+bool samePayload(const VsgfView& a, const VsgfView& b)
+{
+  return sameBytes(a.Positions(), b.Positions())
+    && sameBytes(a.Normals(), b.Normals())
+    && sameBytes(a.Tangents(), b.Tangents())
+    && sameBytes(a.TexCoords(), b.TexCoords())
+    && sameBytes(a.Indices(), b.Indices());
+}
+
+bool readMeshFileCounts(const std::string& meshPath, uint32_t& vertNum, uint32_t& indNum)
+{
+  // same layout as cmesh::LoadMeshFromVSGF expects
+  struct VsgfHeader
+  {
+    uint64_t fileSizeInBytes;
+    uint32_t verticesNum;
+    uint32_t indicesNum;
+    uint32_t materialsNum;
+    uint32_t flags;
+  } header{};
+
+  std::ifstream input(meshPath, std::ios::binary);
+  if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    return false;
+
+  vertNum = header.verticesNum;
+  indNum  = header.indicesNum;
+  return vertNum > 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <geom/cmesh.h>
+
+#include "mesh_optimize.h"
+#include "vsgf_view.h"
+#include "../loader_utils/LiteMath.h"
+
+
+LiteMath::Box4f computeMeshBbox(const cmesh::SimpleMesh& mesh);
+
+// CPU half of SceneManager::AddMeshFromFile. The file stays mapped and is encoded straight
+// into staging memory when it gets uploaded. Doesn't touch any shared state, so it is safe
+// to produce on worker threads.
+struct MappedMesh
+{
+  std::shared_ptr<const VsgfView> file;
+  LiteMath::Box4f bbox;
+  uint64_t hash = 0;
+
+  // time it took to map + hash and to compute bbox, for load statistics
+  float decodeMs = 0.0f;
+  float bboxMs   = 0.0f;
+
+  MeshOptimizeStats optimize;
+};
+
+// returns a mesh with a null file if the file can't be loaded,
+// with optimize the vertex cache optimized copy is mapped instead (see optimizeMeshFile)
+MappedMesh mapMeshFile(const std::string& meshPath, bool optimize = false);
+
+// Content hash of all vertex attributes and indices, used to find byte-identical meshes.
+// A file without normals/tangents hashes differently from a SimpleMesh with zeros there.
+uint64_t hashMeshPayload(const cmesh::SimpleMesh& mesh);
+uint64_t hashMeshPayload(const VsgfView& mesh);
+
+bool samePayload(const VsgfView& a, const VsgfView& b);
+
+// reads only the VSGF header, so sizes are known long before the mesh is decoded
+bool readMeshFileCounts(const std::string& meshPath, uint32_t& vertNum, uint32_t& indNum);
@@ -0,0 +1,331 @@
+#include "mesh_optimize.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "vsgf_view.h"
+
+
+namespace
+{
+  constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+  bool validIndices(std::span<const uint32_t> indices, uint32_t vertNum)
+  {
+    if (indices.empty() || indices.size() % 3 != 0)
+      return false;
+    for (auto index : indices)
+    {
+      if (index >= vertNum)
+        return false;
+    }
+    return true;
+  }
+
+  // Both reorderings in one go. Returns the triangle order, vertexRemap and the final
+  // index buffer, or false if the indices can't be trusted.
+  bool reorder(std::span<const uint32_t> indices, uint32_t vertNum,
+    std::vector<uint32_t>& triangleOrder, std::vector<uint32_t>& vertexRemap, std::vector<uint32_t>& result)
+  {
+    if (!validIndices(indices, vertNum))
+      return false;
+
+    triangleOrder = optimizeTriangleOrder(indices, vertNum);
+
+    result.resize(indices.size());
+    for (std::size_t t = 0; t < triangleOrder.size(); ++t)
+    {
+      for (std::size_t k = 0; k < 3; ++k)
+        result[t * 3 + k] = indices[triangleOrder[t] * 3 + k];
+    }
+
+    vertexRemap = optimizeVertexOrder(result, vertNum);
+    for (auto& index : result)
+      index = vertexRemap[index];
+
+    return true;
+  }
+
+  // stream of vertNum elements, components values each, moved to their new places
+  template<typename T>
+  void scatterVertices(const T* src, std::size_t components, const std::vector<uint32_t>& remap, T* dst)
+  {
+    for (std::size_t v = 0; v < remap.size(); ++v)
+      std::memcpy(dst + remap[v] * components, src + v * components, components * sizeof(T));
+  }
+
+  template<typename T>
+  void remapStream(std::vector<T>& stream, std::size_t components, const std::vector<uint32_t>& remap)
+  {
+    if (stream.size() != remap.size() * components)
+      return;
+    const std::vector<T> src = stream;
+    scatterVertices(src.data(), components, remap, stream.data());
+  }
+
+  bool isUpToDate(const std::string& optimizedPath, const std::string& sourcePath)
+  {
+    std::error_code ec;
+    const auto source = std::filesystem::last_write_time(sourcePath, ec);
+    if (ec)
+      return false;
+    const auto optimized = std::filesystem::last_write_time(optimizedPath, ec);
+    return !ec && optimized >= source;
+  }
+
+  float msSince(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+}
+
+VertexCacheStats measureVertexCache(std::span<const uint32_t> indices, uint32_t vertNum, uint32_t cacheSize)
+{
+  VertexCacheStats stats;
+  stats.triangles = indices.size() / 3;
+  stats.vertices  = vertNum;
+
+  // a vertex is still cached if less than cacheSize misses happened since it was loaded
+  std::vector<uint32_t> loadedAt(vertNum, 0);
+  uint32_t time = cacheSize + 1;
+  for (auto index : indices)
+  {
+    if (index < vertNum && time - loadedAt[index] > cacheSize)
+    {
+      loadedAt[index] = time++;
+      ++stats.misses;
+    }
+  }
+  return stats;
+}
+
+std::vector<uint32_t> optimizeTriangleOrder(std::span<const uint32_t> indices, uint32_t vertNum, uint32_t cacheSize)
+{
+  const std::size_t triNum = indices.size() / 3;
+
+  // vertex -> triangles using it, a degenerate triangle is listed once per corner
+  std::vector<uint32_t> liveTriangles(vertNum, 0);
+  for (auto index : indices)
+    ++liveTriangles[index];
+
+  std::vector<uint32_t> adjacencyStart(vertNum + 1, 0);
+  for (uint32_t v = 0; v < vertNum; ++v)
+    adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (std::size_t i = 0; i < indices.size(); ++i)
+      adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  std::vector<uint32_t> loadedAt(vertNum, 0);
+  uint32_t time = cacheSize + 1;
+
+  std::vector<char> emitted(triNum, 0);
+  std::vector<uint32_t> deadEnds;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> order;
+  order.reserve(triNum);
+
+  uint32_t cursor = 0;
+  uint32_t fan = vertNum > 0 ? 0 : NO_VERTEX;
+  while (fan != NO_VERTEX)
+  {
+    // emit everything around the fanning vertex that isn't out yet
+    candidates.clear();
+    for (uint32_t a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; ++a)
+    {
+      const uint32_t t = adjacency[a];
+      if (emitted[t])
+        continue;
+      emitted[t] = 1;
+      order.push_back(t);
+
+      for (std::size_t k = 0; k < 3; ++k)
+      {
+        const uint32_t v = indices[t * 3 + k];
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        --liveTriangles[v];
+        if (time - loadedAt[v] > cacheSize)
+          loadedAt[v] = time++;
+      }
+    }
+
+    // next fan around the oldest candidate that would still be in cache once its triangles are out
+    fan = NO_VERTEX;
+    int64_t bestPriority = -1;
+    for (auto v : candidates)
+    {
+      if (liveTriangles[v] == 0)
+        continue;
+      int64_t priority = 0;
+      if (time - loadedAt[v] + 2 * liveTriangles[v] <= cacheSize)
+        priority = time - loadedAt[v];
+      if (priority > bestPriority)
+      {
+        bestPriority = priority;
+        fan = v;
+      }
+    }
+
+    // dead end: something recently used, or just the next vertex with triangles left
+    while (fan == NO_VERTEX && !deadEnds.empty())
+    {
+      const uint32_t v = deadEnds.back();
+      deadEnds.pop_back();
+      if (liveTriangles[v] > 0)
+        fan = v;
+    }
+    if (fan == NO_VERTEX)
+    {
+      while (cursor < vertNum && liveTriangles[cursor] == 0)
+        ++cursor;
+      if (cursor < vertNum)
+        fan = cursor;
+    }
+  }
+
+  return order;
+}
+
+std::vector<uint32_t> optimizeVertexOrder(std::span<const uint32_t> indices, uint32_t vertNum)
+{
+  std::vector<uint32_t> remap(vertNum, NO_VERTEX);
+  uint32_t next = 0;
+  for (auto index : indices)
+  {
+    if (remap[index] == NO_VERTEX)
+      remap[index] = next++;
+  }
+
+  // keeps the vertex count, so headers and bounds stay valid
+  for (auto& newId : remap)
+  {
+    if (newId == NO_VERTEX)
+      newId = next++;
+  }
+  return remap;
+}
+
+MeshOptimizeStats optimizeMesh(cmesh::SimpleMesh& mesh)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const auto vertNum = static_cast<uint32_t>(mesh.VerticesNum());
+
+  MeshOptimizeStats stats;
+  if (vertNum == 0)
+    return stats;
+
+  std::vector<uint32_t> triangleOrder;
+  std::vector<uint32_t> vertexRemap;
+  std::vector<uint32_t> indices;
+  if (!reorder(mesh.indices, vertNum, triangleOrder, vertexRemap, indices))
+  {
+    stats.result = MeshOptimizeStats::Result::Failed;
+    return stats;
+  }
+
+  stats.before = measureVertexCache(mesh.indices, vertNum);
+  stats.after  = measureVertexCache(indices, vertNum);
+
+  mesh.indices.assign(indices.begin(), indices.end());
+  if (mesh.matIndices.size() == triangleOrder.size())
+  {
+    const auto matIndices = mesh.matIndices;
+    for (std::size_t t = 0; t < triangleOrder.size(); ++t)
+      mesh.matIndices[t] = matIndices[triangleOrder[t]];
+  }
+
+  remapStream(mesh.vPos4f, 4, vertexRemap);
+  remapStream(mesh.vNorm4f, 4, vertexRemap);
+  remapStream(mesh.vTang4f, 4, vertexRemap);
+  remapStream(mesh.vTexCoord2f, 2, vertexRemap);
+
+  stats.result = MeshOptimizeStats::Result::Optimized;
+  stats.ms = msSince(start);
+  return stats;
+}
+
+std::string optimizeMeshFile(const std::string& meshPath, MeshOptimizeStats& stats)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const std::string optimizedPath = optimizedMeshPath(meshPath);
+
+  stats = {};
+  if (isUpToDate(optimizedPath, meshPath))
+  {
+    stats.result = MeshOptimizeStats::Result::Reused;
+    stats.ms = msSince(start);
+    return optimizedPath;
+  }
+
+  const VsgfView source(meshPath);
+  if (!source.IsOpen())
+    return meshPath;
+
+  std::vector<uint32_t> triangleOrder;
+  std::vector<uint32_t> vertexRemap;
+  std::vector<uint32_t> indices;
+  if (!reorder(source.Indices(), source.VerticesNum(), triangleOrder, vertexRemap, indices))
+  {
+    stats.result = MeshOptimizeStats::Result::Failed;
+    stats.ms = msSince(start);
+    return meshPath;
+  }
+
+  stats.before = measureVertexCache(source.Indices(), source.VerticesNum());
+  stats.after  = measureVertexCache(indices, source.VerticesNum());
+
+  // same file with every stream rewritten in place, header and anything unknown stay as they were
+  const auto bytes = source.Bytes();
+  std::vector<std::byte> optimized(bytes.begin(), bytes.end());
+  auto at = [&](auto stream) {
+    return optimized.data() + (reinterpret_cast<const std::byte*>(stream.data()) - bytes.data());
+  };
+  auto scatter = [&](std::span<const float> stream, std::size_t components) {
+    if (!stream.empty())
+      scatterVertices(reinterpret_cast<const std::byte*>(stream.data()), components * sizeof(float), vertexRemap, at(stream));
+  };
+
+  scatter(source.Positions(), 4);
+  scatter(source.Normals(), 4);
+  scatter(source.Tangents(), 4);
+  scatter(source.TexCoords(), 2);
+  std::memcpy(at(source.Indices()), indices.data(), indices.size() * sizeof(uint32_t));
+
+  const auto materialIds = source.MaterialIds();
+  if (!materialIds.empty())
+  {
+    std::byte* dst = at(materialIds);
+    for (std::size_t t = 0; t < triangleOrder.size(); ++t)
+      std::memcpy(dst + t * sizeof(uint32_t), &materialIds[triangleOrder[t]], sizeof(uint32_t));
+  }
+
+  // written aside and renamed, so that a half written copy is never picked up
+  const std::string tmpPath = optimizedPath + ".tmp";
+  bool written = false;
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    written = out.write(reinterpret_cast<const char*>(optimized.data()), static_cast<std::streamsize>(optimized.size()))
+      && out.flush();
+  }
+
+  std::error_code ec;
+  if (written)
+    std::filesystem::rename(tmpPath, optimizedPath, ec);
+  if (!written || ec)
+  {
+    std::filesystem::remove(tmpPath, ec);
+    stats.result = MeshOptimizeStats::Result::Failed;
+    stats.ms = msSince(start);
+    return meshPath;
+  }
+
+  stats.result = MeshOptimizeStats::Result::Optimized;
+  stats.ms = msSince(start);
+  return optimizedPath;
+}
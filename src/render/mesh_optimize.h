@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <geom/cmesh.h>
+
+
+// Import-time reordering of mesh geometry: triangles are put in an order friendly to the
+// post-transform vertex cache (Tipsify, Sander et al. 2007), then vertices are renumbered
+// in the order they are first used so that vertex fetch walks memory linearly.
+// Nothing here touches shared state, so meshes can be optimized on worker threads.
+
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+// FIFO cache simulation, plain counts so that stats of several meshes can be summed up
+struct VertexCacheStats
+{
+  uint64_t misses    = 0;
+  uint64_t triangles = 0;
+  uint64_t vertices  = 0;
+
+  // average cache miss ratio: transformed vertices per triangle, 0.5 is the best a regular grid gets
+  float Acmr() const { return triangles ? float(misses) / float(triangles) : 0.0f; }
+  // average transform to vertex ratio: 1.0 means every vertex is transformed exactly once
+  float Atvr() const { return vertices ? float(misses) / float(vertices) : 0.0f; }
+
+  VertexCacheStats& operator+=(const VertexCacheStats& other)
+  {
+    misses    += other.misses;
+    triangles += other.triangles;
+    vertices  += other.vertices;
+    return *this;
+  }
+};
+
+VertexCacheStats measureVertexCache(std::span<const uint32_t> indices, uint32_t vertNum,
+  uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// returns triangle ids in the order they should be drawn
+std::vector<uint32_t> optimizeTriangleOrder(std::span<const uint32_t> indices, uint32_t vertNum,
+  uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// returns the new id of every vertex, vertices nothing refers to are moved to the end
+std::vector<uint32_t> optimizeVertexOrder(std::span<const uint32_t> indices, uint32_t vertNum);
+
+struct MeshOptimizeStats
+{
+  enum class Result
+  {
+    Skipped,   // optimization is off or the mesh is empty
+    Optimized,
+    Reused,    // an up to date optimized copy was already on disk
+    Failed,    // bad indices or the optimized copy couldn't be written, the source is used as is
+  };
+
+  Result result = Result::Skipped;
+  // only known for meshes that were optimized right now
+  VertexCacheStats before;
+  VertexCacheStats after;
+  float ms = 0.0f;
+};
+
+// in place, material ids follow their triangles
+MeshOptimizeStats optimizeMesh(cmesh::SimpleMesh& mesh);
+
+// the optimized copy of a VSGF file lives right next to it
+inline std::string optimizedMeshPath(const std::string& meshPath) { return meshPath + ".opt"; }
+
+// Makes sure an optimized copy of meshPath exists and is newer than the source, writing it if
+// needed. Returns the file to load: the copy, or meshPath itself if it couldn't be produced.
+std::string optimizeMeshFile(const std::string& meshPath, MeshOptimizeStats& stats);
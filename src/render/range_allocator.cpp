@@ -0,0 +1,85 @@
+#include "range_allocator.h"
+
+#include <cassert>
+#include <iterator>
+
+
+RangeAllocator::RangeAllocator(uint32_t a_capacity)
+{
+  Grow(a_capacity);
+}
+
+uint32_t RangeAllocator::Allocate(uint32_t a_size)
+{
+  if (a_size == 0)
+    return 0;
+
+  auto best = m_free.end();
+  for (auto it = m_free.begin(); it != m_free.end(); ++it)
+  {
+    if (it->second >= a_size && (best == m_free.end() || it->second < best->second))
+      best = it;
+  }
+  if (best == m_free.end())
+    return NO_SPACE;
+
+  const uint32_t offset = best->first;
+  const uint32_t rest   = best->second - a_size;
+  m_free.erase(best);
+  if (rest > 0)
+    m_free.emplace(offset + a_size, rest);
+
+  m_used += a_size;
+  return offset;
+}
+
+void RangeAllocator::Free(uint32_t a_offset, uint32_t a_size)
+{
+  if (a_size == 0)
+    return;
+
+  assert(a_offset + a_size <= m_capacity);
+  m_used -= a_size;
+
+  auto [it, inserted] = m_free.emplace(a_offset, a_size);
+  assert(inserted);
+
+  auto next = std::next(it);
+  if (next != m_free.end() && it->first + it->second == next->first)
+  {
+    it->second += next->second;
+    m_free.erase(next);
+  }
+  if (it != m_free.begin())
+  {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second == it->first)
+    {
+      prev->second += it->second;
+      m_free.erase(it);
+    }
+  }
+}
+
+void RangeAllocator::Grow(uint32_t a_capacity)
+{
+  if (a_capacity <= m_capacity)
+    return;
+
+  const uint32_t oldCapacity = m_capacity;
+  m_capacity = a_capacity;
+  // goes through Free so that it merges with a free tail
+  m_used += a_capacity - oldCapacity;
+  Free(oldCapacity, a_capacity - oldCapacity);
+}
+
+uint32_t RangeAllocator::End() const
+{
+  if (!m_free.empty())
+  {
+    const auto& [offset, size] = *m_free.rbegin();
+    if (offset + size == m_capacity)
+      return offset;
+  }
+  return m_capacity;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+
+// Hands out ranges of a linear space of Capacity() elements, best fit over a free list
+// whose neighbours are always merged. The space can only grow, which extends its tail.
+// Knows nothing about what is stored there, SceneManager uses it for vertex and index buffers.
+class RangeAllocator
+{
+public:
+  static constexpr uint32_t NO_SPACE = UINT32_MAX;
+
+  explicit RangeAllocator(uint32_t a_capacity = 0);
+
+  // offset of a_size free elements, or NO_SPACE if there is no hole that big
+  uint32_t Allocate(uint32_t a_size);
+  void Free(uint32_t a_offset, uint32_t a_size);
+  void Grow(uint32_t a_capacity);
+
+  uint32_t Capacity() const { return m_capacity; }
+  uint32_t Used() const { return m_used; }
+  // one past the last allocated element, everything from here to Capacity() is free
+  uint32_t End() const;
+
+private:
+  // offset -> size
+  std::map<uint32_t, uint32_t> m_free;
+  uint32_t m_capacity = 0;
+  uint32_t m_used = 0;
+};
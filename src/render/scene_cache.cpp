@@ -0,0 +1,261 @@
+#include "scene_cache.h"
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "vk_utils.h"
+
+
+namespace
+{
+  enum Section : uint32_t
+  {
+    SECTION_SOURCES = 0,
+    SECTION_MESH_INFOS,
+    SECTION_MESH_BBOXES,
+    SECTION_MESH_HASHES,
+    SECTION_INSTANCE_INFOS,
+    SECTION_INSTANCE_MATRICES,
+    SECTION_CAMERAS,
+    SECTION_LIGHTS,
+    SECTION_HYDRA_MESH_IDS,
+    SECTION_HYDRA_INSTANCE_IDS,
+    SECTION_VERTICES,
+    SECTION_INDICES,
+    SECTION_COUNT
+  };
+
+  struct SceneCacheHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t transpose;
+    uint32_t sourceCount;
+    uint32_t optimizedMeshes;
+    uint32_t padding;
+    uint64_t sectionOffsets[SECTION_COUNT];
+    uint64_t sectionSizes[SECTION_COUNT];
+  };
+
+  // every section starts at a multiple of this, so typed spans over the mapping are aligned
+  constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+  struct SourceStamp
+  {
+    uint64_t size  = 0;
+    int64_t  mtime = 0;
+  };
+
+  bool stampFile(const std::string& path, SourceStamp& stamp)
+  {
+    std::error_code ec;
+    stamp.size = std::filesystem::file_size(path, ec);
+    if (ec)
+      return false;
+    stamp.mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    return !ec;
+  }
+
+  template<typename T>
+  std::span<const T> sectionAs(const std::byte* base, const SceneCacheHeader& header, Section section)
+  {
+    return { reinterpret_cast<const T*>(base + header.sectionOffsets[section]),
+      static_cast<std::size_t>(header.sectionSizes[section] / sizeof(T)) };
+  }
+
+  template<typename T>
+  std::span<const std::byte> bytesOf(std::span<const T> data)
+  {
+    return std::as_bytes(data);
+  }
+}
+
+std::unique_ptr<SceneCache> SceneCache::Open(const std::string& cachePath, bool transpose, bool optimizedMeshes)
+{
+  MappedFile file(cachePath);
+  if (!file.IsOpen())
+    return nullptr;
+
+  auto reject = [&cachePath](const char* reason) {
+    std::stringstream ss;
+    ss << "[SceneCache::Open] ignoring " << cachePath << ": " << reason;
+    vk_utils::logWarning(ss.str());
+    return nullptr;
+  };
+
+  if (file.Size() < sizeof(SceneCacheHeader))
+    return reject("file is truncated");
+
+  SceneCacheHeader header;
+  std::memcpy(&header, file.Data(), sizeof(header));
+
+  if (header.magic != MAGIC || header.version != VERSION)
+    return reject("unknown format version");
+
+  if (header.transpose != static_cast<uint32_t>(transpose)
+    || header.optimizedMeshes != static_cast<uint32_t>(optimizedMeshes))
+    return nullptr;
+
+  for (uint32_t i = 0; i < SECTION_COUNT; ++i)
+  {
+    if (header.sectionOffsets[i] % SECTION_ALIGNMENT != 0
+      || header.sectionOffsets[i] > file.Size()
+      || header.sectionSizes[i] > file.Size() - header.sectionOffsets[i])
+      return reject("section table is corrupted");
+  }
+
+  // sources: {u64 size, i64 mtime, u32 pathLength, char path[pathLength]} each
+  const std::byte* src    = file.Data() + header.sectionOffsets[SECTION_SOURCES];
+  const std::byte* srcEnd = src + header.sectionSizes[SECTION_SOURCES];
+  for (uint32_t i = 0; i < header.sourceCount; ++i)
+  {
+    SourceStamp recorded;
+    uint32_t pathLength = 0;
+    if (srcEnd - src < static_cast<std::ptrdiff_t>(sizeof(recorded) + sizeof(pathLength)))
+      return reject("source table is corrupted");
+    std::memcpy(&recorded, src, sizeof(recorded));
+    std::memcpy(&pathLength, src + sizeof(recorded), sizeof(pathLength));
+    src += sizeof(recorded) + sizeof(pathLength);
+
+    if (srcEnd - src < static_cast<std::ptrdiff_t>(pathLength))
+      return reject("source table is corrupted");
+    std::string path(reinterpret_cast<const char*>(src), pathLength);
+    src += pathLength;
+
+    SourceStamp current;
+    if (!stampFile(path, current) || current.size != recorded.size || current.mtime != recorded.mtime)
+      return nullptr;
+  }
+
+  std::unique_ptr<SceneCache> cache(new SceneCache());
+  const std::byte* base = file.Data();
+  cache->m_data = SceneCacheData{
+    .meshInfos        = sectionAs<MeshInfo>(base, header, SECTION_MESH_INFOS),
+    .meshBboxes       = sectionAs<LiteMath::Box4f>(base, header, SECTION_MESH_BBOXES),
+    .meshHashes       = sectionAs<uint64_t>(base, header, SECTION_MESH_HASHES),
+    .instanceInfos    = sectionAs<GpuInstanceInfo>(base, header, SECTION_INSTANCE_INFOS),
+    .instanceMatrices = sectionAs<glm::mat4>(base, header, SECTION_INSTANCE_MATRICES),
+    .cameras          = sectionAs<hydra_xml::Camera>(base, header, SECTION_CAMERAS),
+    .lights           = sectionAs<SceneCacheLight>(base, header, SECTION_LIGHTS),
+    .hydraMeshIds     = sectionAs<SceneCacheHydraId>(base, header, SECTION_HYDRA_MESH_IDS),
+    .hydraInstanceIds = sectionAs<SceneCacheHydraId>(base, header, SECTION_HYDRA_INSTANCE_IDS),
+    .vertices         = sectionAs<std::byte>(base, header, SECTION_VERTICES),
+    .indices          = sectionAs<std::byte>(base, header, SECTION_INDICES),
+  };
+
+  if (cache->m_data.meshInfos.size() != cache->m_data.meshBboxes.size()
+    || cache->m_data.meshInfos.size() != cache->m_data.meshHashes.size()
+    || cache->m_data.instanceInfos.size() != cache->m_data.instanceMatrices.size())
+    return reject("section sizes don't match");
+
+  cache->m_file = std::move(file);
+  return cache;
+}
+
+bool SceneCache::Write(const std::string& cachePath, bool transpose, bool optimizedMeshes,
+  const std::vector<std::string>& sourceFiles, const SceneCacheData& data)
+{
+  auto streamOf = [](std::span<const std::byte> bytes) {
+    return Stream{ bytes.size(), [bytes](std::ostream& out) {
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+      } };
+  };
+
+  return Write(cachePath, transpose, optimizedMeshes, sourceFiles, data, streamOf(data.vertices), streamOf(data.indices));
+}
+
+bool SceneCache::Write(const std::string& cachePath, bool transpose, bool optimizedMeshes,
+  const std::vector<std::string>& sourceFiles, const SceneCacheData& data,
+  const Stream& vertices, const Stream& indices)
+{
+  std::vector<std::byte> sources;
+  for (const auto& path : sourceFiles)
+  {
+    SourceStamp stamp;
+    if (!stampFile(path, stamp))
+      return false;
+
+    const auto pathLength = static_cast<uint32_t>(path.size());
+    const auto at = sources.size();
+    sources.resize(at + sizeof(stamp) + sizeof(pathLength) + pathLength);
+    std::memcpy(sources.data() + at, &stamp, sizeof(stamp));
+    std::memcpy(sources.data() + at + sizeof(stamp), &pathLength, sizeof(pathLength));
+    std::memcpy(sources.data() + at + sizeof(stamp) + sizeof(pathLength), path.data(), pathLength);
+  }
+
+  const std::array<std::span<const std::byte>, SECTION_COUNT> sections{
+    std::span<const std::byte>(sources),
+    bytesOf(data.meshInfos),
+    bytesOf(data.meshBboxes),
+    bytesOf(data.meshHashes),
+    bytesOf(data.instanceInfos),
+    bytesOf(data.instanceMatrices),
+    bytesOf(data.cameras),
+    bytesOf(data.lights),
+    bytesOf(data.hydraMeshIds),
+    bytesOf(data.hydraInstanceIds),
+    {},
+    {},
+  };
+
+  std::array<uint64_t, SECTION_COUNT> sizes;
+  for (uint32_t i = 0; i < SECTION_COUNT; ++i)
+    sizes[i] = sections[i].size();
+  sizes[SECTION_VERTICES] = vertices.size;
+  sizes[SECTION_INDICES]  = indices.size;
+
+  SceneCacheHeader header{};
+  header.magic       = MAGIC;
+  header.version     = VERSION;
+  header.transpose   = static_cast<uint32_t>(transpose);
+  header.sourceCount = static_cast<uint32_t>(sourceFiles.size());
+  header.optimizedMeshes = static_cast<uint32_t>(optimizedMeshes);
+
+  uint64_t offset = sizeof(header);
+  for (uint32_t i = 0; i < SECTION_COUNT; ++i)
+  {
+    offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+    header.sectionOffsets[i] = offset;
+    header.sectionSizes[i]   = sizes[i];
+    offset += sizes[i];
+  }
+
+  // write next to the destination and rename, so a crash never leaves a half-written cache behind
+  const std::string tmpPath = cachePath + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+
+    const char zeros[SECTION_ALIGNMENT] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    for (uint32_t i = 0; i < SECTION_COUNT; ++i)
+    {
+      out.write(zeros, static_cast<std::streamsize>(header.sectionOffsets[i] - written));
+      if (i == SECTION_VERTICES)
+        vertices.write(out);
+      else if (i == SECTION_INDICES)
+        indices.write(out);
+      else
+        out.write(reinterpret_cast<const char*>(sections[i].data()), static_cast<std::streamsize>(sections[i].size()));
+      written = header.sectionOffsets[i] + sizes[i];
+    }
+
+    if (!out)
+      return false;
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, cachePath, ec);
+  if (ec)
+  {
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "scene_mgr.h"
+#include "../utils/mapped_file.h"
+
+
+struct SceneCacheLight
+{
+  uint32_t instId;
+  uint32_t lightId;
+  uint32_t padding[2];
+  LiteMath::float4x4 matrix;
+};
+
+// hydra "id" attribute -> mesh or instance id in SceneManager
+struct SceneCacheHydraId
+{
+  uint32_t hydraId;
+  uint32_t id;
+};
+
+// Everything SceneManager::LoadSceneXML produces for a scene, in the form
+// LoadGeoDataOnGPU consumes it. When coming from SceneCache::Open all spans
+// point straight into the mapped cache file.
+struct SceneCacheData
+{
+  std::span<const MeshInfo> meshInfos;
+  std::span<const LiteMath::Box4f> meshBboxes;
+  std::span<const uint64_t> meshHashes;
+  std::span<const GpuInstanceInfo> instanceInfos;
+  std::span<const glm::mat4> instanceMatrices;
+  std::span<const hydra_xml::Camera> cameras;
+  std::span<const SceneCacheLight> lights;
+  std::span<const SceneCacheHydraId> hydraMeshIds;
+  std::span<const SceneCacheHydraId> hydraInstanceIds;
+  std::span<const std::byte> vertices;
+  std::span<const std::byte> indices;
+};
+
+// Versioned binary dump of a loaded hydra scene, stored next to the scene xml.
+// The cache records size and modification time of the xml and of every mesh file
+// it was built from and is rejected as soon as any of them changes.
+class SceneCache
+{
+public:
+  static constexpr uint32_t MAGIC   = 0x43535356u; // "VSSC"
+  static constexpr uint32_t VERSION = 3u;
+
+  static std::string PathFor(const std::string& scenePath) { return scenePath + ".cache"; }
+
+  // returns nullptr if there is no cache or it is stale/incompatible,
+  // optimizedMeshes tells whether the geometry went through optimizeMeshFile
+  static std::unique_ptr<SceneCache> Open(const std::string& cachePath, bool transpose, bool optimizedMeshes);
+
+  static bool Write(const std::string& cachePath, bool transpose, bool optimizedMeshes,
+    const std::vector<std::string>& sourceFiles, const SceneCacheData& data);
+
+  // Geometry produced while writing, so that it never has to be gathered in memory.
+  // write must put out exactly size bytes.
+  struct Stream
+  {
+    std::size_t size = 0;
+    std::function<void(std::ostream&)> write;
+  };
+
+  // data.vertices and data.indices are ignored
+  static bool Write(const std::string& cachePath, bool transpose, bool optimizedMeshes,
+    const std::vector<std::string>& sourceFiles, const SceneCacheData& data,
+    const Stream& vertices, const Stream& indices);
+
+  const SceneCacheData& Data() const { return m_data; }
+
+private:
+  SceneCache() = default;
+
+  MappedFile m_file;
+  SceneCacheData m_data;
+};
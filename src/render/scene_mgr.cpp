@@ -1,10 +1,24 @@
 #include <map>
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
 #include <random>
+#include <thread>
 #include "scene_mgr.h"
+#include "scene_cache.h"
+#include "mesh_decode.h"
+#include "../utils/parallel.h"
 #include "vk_utils.h"
 #include "vk_buffers.h"
 #include "../loader_utils/hydraxml.h"
+#include "../loader_utils/hydraxml_stream.h"
 #include "perlin.h"
 
 
@@ -22,71 +36,808 @@ VkTransformMatrixKHR transformMatrixFromFloat4x4(const LiteMath::float4x4 &m)
   return transformMatrix;
 }
 
+namespace
+{
+  uint32_t hydraIdFrom(std::string_view str)
+  {
+    uint32_t id = UINT32_MAX;
+    std::from_chars(str.data(), str.data() + str.size(), id);
+    return id;
+  }
+
+  // indices are local to a mesh, so anything up to 65536 vertices fits into 16 bits
+  constexpr uint32_t MAX_INDEX16_VERTICES = 1u << 16;
+
+  bool fitsIndex16(uint32_t vertNum)
+  {
+    return vertNum <= MAX_INDEX16_VERTICES;
+  }
+
+  std::size_t gpuIndexSize(uint32_t vertNum)
+  {
+    return fitsIndex16(vertNum) ? sizeof(uint16_t) : sizeof(uint32_t);
+  }
+
+  // re-sending a few untouched instances in between is cheaper than another copy region
+  constexpr uint32_t MAX_INSTANCE_GAP = 16;
+
+  // fill function for StagingRing::Upload, instance matrices go to the GPU as 3x4
+  auto packTransforms(const glm::mat4* matrices)
+  {
+    return [matrices](std::size_t first, std::size_t count, std::byte* dst) {
+      auto* out = reinterpret_cast<GpuInstanceTransform*>(dst);
+      for (std::size_t j = 0; j < count; ++j)
+      {
+        const glm::mat4 rows = glm::transpose(matrices[first + j]);
+        out[j] = GpuInstanceTransform{ { rows[0], rows[1], rows[2] } };
+      }
+    };
+  }
+
+  // geometry buffers are copied from into bigger ones when they grow
+  constexpr VkBufferUsageFlags GEO_VERTEX_USAGE = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+    | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  constexpr VkBufferUsageFlags GEO_INDEX_USAGE = VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+    | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+  double msSince(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+}
+
 SceneManager::SceneManager(VkDevice a_device, VkPhysicalDevice a_physDevice,
-  uint32_t a_transferQId, uint32_t a_graphicsQId, bool)
+  uint32_t a_transferQId, uint32_t a_graphicsQId, bool, std::shared_ptr<GpuAllocator> a_allocator)
   : m_device(a_device)
   , m_physDevice(a_physDevice)
   , m_transferQId(a_transferQId)
   , m_graphicsQId(a_graphicsQId)
+  , m_pAllocator(std::move(a_allocator))
 {
+  if (m_pAllocator == nullptr)
+    m_pAllocator = std::make_shared<GpuAllocator>(m_device, m_physDevice);
+
   vkGetDeviceQueue(m_device, m_transferQId, 0, &m_transferQ);
   vkGetDeviceQueue(m_device, m_graphicsQId, 0, &m_graphicsQ);
   VkDeviceSize scratchMemSize = 64 * 1024 * 1024;
   m_pCopyHelper = std::make_shared<vk_utils::PingPongCopyHelper>(m_physDevice, m_device, m_transferQ, m_transferQId, scratchMemSize);
   m_pMeshData   = std::make_shared<Mesh8F>();
+  // geometry goes through here, see UploadMeshGeometry
+  VkDeviceSize stagingSize = 32 * 1024 * 1024;
+  // and is owned by the graphics queue, which reads it
+  {
+    GpuAllocator::TagScope tag("staging");
+    m_pStagingRing = std::make_unique<StagingRing>(*m_pAllocator, m_device, m_transferQ, m_transferQId, m_graphicsQId,
+      stagingSize);
+  }
+  m_graphicsCmdPool = vk_utils::createCommandPool(m_device, m_graphicsQId, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+}
 
+SceneManager::~SceneManager()
+{
+  DestroyScene();
+  vkDestroyCommandPool(m_device, m_graphicsCmdPool, nullptr);
+}
+
+std::unique_ptr<SceneCache> SceneManager::OpenSceneCache(const std::string &scenePath, bool transpose) const
+{
+  // the cache only describes a whole scene, so it can't be used on top of already loaded meshes
+  if (!m_useSceneCache || !m_meshInfos.empty())
+    return nullptr;
+  return SceneCache::Open(SceneCache::PathFor(scenePath), transpose, m_optimizeMeshes);
 }
 
 bool SceneManager::LoadSceneXML(const std::string &scenePath, bool transpose)
 {
-  auto hscene_main = std::make_shared<hydra_xml::HydraScene>();
-  auto res         = hscene_main->LoadState(scenePath);
+  const auto start = std::chrono::steady_clock::now();
+  return LoadSceneXML(scenePath, transpose, OpenSceneCache(scenePath, transpose), start);
+}
+
+bool SceneManager::LoadSceneXML(const std::string &scenePath, bool transpose, std::unique_ptr<SceneCache> cache,
+  std::chrono::steady_clock::time_point start)
+{
+  m_loadStats = SceneLoadStats{};
+  const VkDeviceSize uploadedBefore = m_pStagingRing->BytesUploaded();
+  const uint32_t submitsBefore = m_pStagingRing->Submits();
+
+  auto uploadToGPU = [&]() {
+    const auto uploadStart = std::chrono::steady_clock::now();
+    LoadGeoDataOnGPU();
+    m_loadStats.gpuUploadMs   = msSince(uploadStart);
+    m_loadStats.bytesUploaded = m_pStagingRing->BytesUploaded() - uploadedBefore;
+    m_loadStats.uploadSubmits = m_pStagingRing->Submits() - submitsBefore;
+    m_loadStats.totalMs       = msSince(start);
+  };
+
+  if (cache)
+  {
+    LoadFromSceneCache(std::move(cache));
+    m_loadStats.cacheMs   = msSince(start);
+    m_loadStats.fromCache = true;
+    uploadToGPU();
+    return true;
+  }
+
+  // a missing or stale cache is written again once the scene is loaded
+  const bool canUseCache = m_useSceneCache && m_meshInfos.empty();
+  const std::string cachePath = SceneCache::PathFor(scenePath);
+  if (canUseCache)
+    m_loadStats.cacheMs = msSince(start);
+
+  const std::size_t firstCamera = m_sceneCameras.size();
+  const std::size_t firstLight  = m_sceneLights.size();
+
+  std::vector<std::string> meshFiles;
+  const auto streamStart = std::chrono::steady_clock::now();
+  StreamSceneXML(scenePath, transpose, meshFiles);
+  // mesh decoding happens inside the xml pass, AppendMeshFiles times it separately
+  m_loadStats.xmlParseMs = msSince(streamStart) - m_loadStats.meshDecodeMs;
+
+  LogMeshDedupStats();
+  LogMeshOptimizeStats();
+
+  if (canUseCache)
+  {
+    const auto cacheStart = std::chrono::steady_clock::now();
+    std::vector<std::string> sourceFiles = { scenePath };
+    sourceFiles.insert(sourceFiles.end(), meshFiles.begin(), meshFiles.end());
+    WriteSceneCache(cachePath, transpose, sourceFiles, firstCamera, firstLight);
+    m_loadStats.cacheMs += msSince(cacheStart);
+  }
+
+  uploadToGPU();
+
+  return true;
+}
+
+void SceneManager::StreamSceneXML(const std::string &scenePath, bool transpose, std::vector<std::string> &meshFiles)
+{
+  // hydra mesh id -> index into meshFiles, several ids may share a file
+  std::unordered_map<std::string, std::size_t> fileById;
+  std::unordered_map<std::string, std::size_t> fileByLoc;
+  std::vector<uint32_t> meshIdByFile;
+
+  struct PendingInstance
+  {
+    uint32_t instId;
+    std::string meshId;
+    LiteMath::float4x4 matrix;
+  };
+  // only if scenes came before geometry_lib, which hydra never writes
+  std::vector<PendingInstance> pendingInstances;
+
+  auto instance = [&](uint32_t instId, std::string_view hydraId, const LiteMath::float4x4& lmMat) {
+    auto found = fileById.find(std::string(hydraId));
+    if (found == fileById.end())
+      return;
+    const auto mat = lmToGlm(lmMat);
+    m_instanceByHydraId.insert_or_assign(instId,
+      InstanceMesh(meshIdByFile[found->second], transpose ? glm::transpose(mat) : mat));
+  };
+
+  auto loadMeshes = [&]() {
+    AppendMeshFiles(meshFiles, meshIdByFile);
+
+    for (const auto& pending : pendingInstances)
+      instance(pending.instId, pending.meshId, pending.matrix);
+    pendingInstances.clear();
+  };
+
+  hydra_xml::SceneEvents events;
+  events.onMesh = [&](std::string_view hydraId, const std::string& loc) {
+    auto [it, newLoc] = fileByLoc.try_emplace(loc, meshFiles.size());
+    if (newLoc)
+      meshFiles.push_back(loc);
+    // the first entry wins, same as HydraScene
+    fileById.try_emplace(std::string(hydraId), it->second);
+  };
+  events.onGeometryLibEnd = loadMeshes;
+  events.onInstance = [&](uint32_t instId, std::string_view hydraId, const LiteMath::float4x4& lmMat) {
+    if (meshIdByFile.size() < meshFiles.size())
+      pendingInstances.push_back(PendingInstance{ instId, std::string(hydraId), lmMat });
+    else
+      instance(instId, hydraId, lmMat);
+  };
+  events.onCamera = [&](const hydra_xml::Camera& cam) {
+    m_sceneCameras.push_back(cam);
+  };
+  events.onLightInstance = [&](const hydra_xml::LightInstance& light) {
+    m_sceneLights.push_back(light);
+  };
 
-  if(res < 0)
+  if (hydra_xml::ReadSceneStreaming(scenePath, events) < 0)
   {
     RUN_TIME_ERROR("LoadSceneXML error");
-    return false;
   }
 
-  for(auto loc : hscene_main->MeshFiles())
+  loadMeshes();
+
+  for (const auto& [hydraId, file] : fileById)
+    m_meshByHydraId.insert_or_assign(hydraIdFrom(hydraId), meshIdByFile[file]);
+}
+
+void SceneManager::AppendMeshFiles(const std::vector<std::string> &files, std::vector<uint32_t> &meshIds)
+{
+  // map and compute bounds on a worker pool, one window at a time,
+  // then append in file order to keep offsets stable
+  const auto start = std::chrono::steady_clock::now();
+  const std::size_t workers = defaultWorkerCount();
+  const std::size_t window  = workers * 4;
+  std::vector<MappedMesh> decoded;
+  for (std::size_t first = meshIds.size(); first < files.size(); first += window)
   {
-    auto meshId    = AddMeshFromFile(loc);
-    auto instancesLM = hscene_main->GetAllInstancesOfMeshLoc(loc);
-    for (auto& lmMat : instancesLM)
+    const std::size_t count = std::min(window, files.size() - first);
+    decoded.clear();
+    decoded.resize(count);
+    parallelFor(count, workers, [&](std::size_t i) {
+      decoded[i] = mapMeshFile(files[first + i], m_optimizeMeshes);
+    });
+
+    for (std::size_t i = 0; i < count; ++i)
     {
-      const auto mat = lmToGlm(lmMat);
-      InstanceMesh(meshId, transpose ? glm::transpose(mat) : mat);
+      if (decoded[i].file == nullptr)
+        RUN_TIME_ERROR(("can't load mesh at " + files[first + i]).c_str());
+      AccountMeshOptimize(decoded[i].optimize, files[first + i]);
+      meshIds.push_back(AppendMesh(decoded[i]));
+      m_loadStats.decodeCpuMs += decoded[i].decodeMs;
+      m_loadStats.bboxCpuMs   += decoded[i].bboxMs;
     }
   }
+  m_loadStats.meshDecodeMs += msSince(start);
+}
+
+struct SceneManager::AsyncLoad
+{
+  struct Instance
+  {
+    uint32_t instId;
+    glm::mat4 matrix;
+  };
+  // one entry per distinct file in geometry_lib order, with the hydra ids and instances
+  // that refer to it, so nothing of the xml has to be kept around while meshes stream in
+  std::vector<std::string> meshFiles;
+  std::vector<std::vector<uint32_t>> meshHydraIds;
+  std::vector<std::vector<Instance>> meshInstances;
+  std::size_t instancesNum = 0;
+  bool transpose = true;
+  bool optimizeMeshes = false;
+
+  std::string cachePath;
+  std::string scenePath;
+  bool writeCache = false;
+  std::size_t firstCamera = 0;
+  std::size_t firstLight  = 0;
+
+  LoadProgressCallback onProgress;
+  LoadCompletionCallback onComplete;
+
+  // render thread only: index of the next mesh file to become resident
+  std::size_t nextMesh = 0;
+
+  // decoded meshes in file order, produced by the worker
+  std::mutex mutex;
+  std::condition_variable consumed;
+  std::deque<MappedMesh> ready;
+  std::exception_ptr error;
+  std::atomic<bool> cancel{false};
+
+  std::thread worker;
+};
+
+void SceneManager::CollectSceneXML(const std::string &scenePath, AsyncLoad &load)
+{
+  std::unordered_map<std::string, std::size_t> fileById;
+  std::unordered_map<std::string, std::size_t> fileByLoc;
 
-  for(auto cam : hscene_main->Cameras())
+  struct PendingInstance
   {
+    uint32_t instId;
+    std::string meshId;
+    glm::mat4 matrix;
+  };
+  // only if scenes came before geometry_lib, which hydra never writes
+  std::vector<PendingInstance> pendingInstances;
+
+  auto instance = [&](uint32_t instId, std::string_view hydraId, const glm::mat4& matrix) {
+    auto found = fileById.find(std::string(hydraId));
+    if (found == fileById.end())
+      return;
+    load.meshInstances[found->second].push_back(AsyncLoad::Instance{ instId, matrix });
+    ++load.instancesNum;
+  };
+
+  bool geometryLibDone = false;
+  hydra_xml::SceneEvents events;
+  events.onMesh = [&](std::string_view hydraId, const std::string& loc) {
+    auto [it, newLoc] = fileByLoc.try_emplace(loc, load.meshFiles.size());
+    if (newLoc)
+    {
+      load.meshFiles.push_back(loc);
+      load.meshHydraIds.emplace_back();
+      load.meshInstances.emplace_back();
+    }
+    // the first entry wins, same as HydraScene
+    if (fileById.try_emplace(std::string(hydraId), it->second).second)
+      load.meshHydraIds[it->second].push_back(hydraIdFrom(hydraId));
+  };
+  events.onGeometryLibEnd = [&]() {
+    geometryLibDone = true;
+  };
+  events.onInstance = [&](uint32_t instId, std::string_view hydraId, const LiteMath::float4x4& lmMat) {
+    const auto mat = lmToGlm(lmMat);
+    if (geometryLibDone)
+      instance(instId, hydraId, load.transpose ? glm::transpose(mat) : mat);
+    else
+      pendingInstances.push_back(PendingInstance{ instId, std::string(hydraId), load.transpose ? glm::transpose(mat) : mat });
+  };
+  events.onCamera = [&](const hydra_xml::Camera& cam) {
     m_sceneCameras.push_back(cam);
+  };
+  events.onLightInstance = [&](const hydra_xml::LightInstance& light) {
+    m_sceneLights.push_back(light);
+  };
+
+  if (hydra_xml::ReadSceneStreaming(scenePath, events) < 0)
+  {
+    RUN_TIME_ERROR("LoadSceneXML error");
   }
 
-  for (auto light : hscene_main->InstancesLights())
+  for (const auto& pending : pendingInstances)
+    instance(pending.instId, pending.meshId, pending.matrix);
+}
+
+void SceneManager::AddSceneMesh(AsyncLoad &load, MappedMesh &mesh)
+{
+  const std::size_t file = load.nextMesh;
+  if(mesh.file == nullptr)
+    RUN_TIME_ERROR(("can't load mesh at " + load.meshFiles[file]).c_str());
+
+  auto meshId = AppendMesh(mesh);
+  mesh = {};
+  for (const uint32_t hydraId : load.meshHydraIds[file])
+    m_meshByHydraId.insert_or_assign(hydraId, meshId);
+
+  for (const auto& inst : load.meshInstances[file])
+    m_instanceByHydraId.insert_or_assign(inst.instId, InstanceMesh(meshId, inst.matrix));
+  // nothing refers to them anymore
+  load.meshInstances[file] = {};
+}
+
+bool SceneManager::LoadSceneXMLAsync(const std::string &scenePath, bool transpose,
+  LoadProgressCallback onProgress, LoadCompletionCallback onComplete)
+{
+  if (m_pAsyncLoad)
   {
-    m_sceneLights.push_back(light);
+    vk_utils::logWarning("[SceneManager::LoadSceneXMLAsync] another scene is still loading");
+    return false;
   }
 
-  /*
-  // quick and dirty hacks
-  auto randS = [] () { return float(rand()) / float(RAND_MAX) * 2.f - 1.f; };
-  auto randU = [] () { return float(rand()) / float(RAND_MAX); };
-  for (std::size_t i = 0; i < 200; ++i)
+  // a valid cache loads faster than the first streamed frame would take
+  const auto start = std::chrono::steady_clock::now();
+  if (auto cache = OpenSceneCache(scenePath, transpose))
+  {
+    const bool res = LoadSceneXML(scenePath, transpose, std::move(cache), start);
+    if (onProgress)
+      onProgress(MeshesNum(), MeshesNum());
+    if (onComplete)
+      onComplete();
+    return res;
+  }
+
+  auto load = std::make_unique<AsyncLoad>();
+  load->transpose   = transpose;
+  load->optimizeMeshes = m_optimizeMeshes;
+  load->scenePath   = scenePath;
+  load->cachePath   = SceneCache::PathFor(scenePath);
+  load->writeCache  = m_meshInfos.empty();
+  load->firstCamera = m_sceneCameras.size();
+  load->firstLight  = m_sceneLights.size();
+  load->onProgress  = std::move(onProgress);
+  load->onComplete  = std::move(onComplete);
+  CollectSceneXML(scenePath, *load);
+
+  // headers are tiny, so the whole scene can be sized up front and GPU buffers never have to grow;
+  // they are still one open and read per file, so that happens on a worker pool
+  std::vector<std::array<uint32_t, 2>> counts(load->meshFiles.size());
+  parallelFor(counts.size(), defaultWorkerCount(), [&](std::size_t i) {
+    if (!readMeshFileCounts(load->meshFiles[i], counts[i][0], counts[i][1]))
+      RUN_TIME_ERROR(("can't load mesh at " + load->meshFiles[i]).c_str());
+  });
+
+  uint64_t vertices  = 0;
+  uint64_t indices   = 0;
+  uint64_t indices16 = 0;
+  for (const auto& [vertNum, indNum] : counts)
+  {
+    vertices += vertNum;
+    (fitsIndex16(vertNum) ? indices16 : indices) += indNum;
+  }
+
+  m_meshCapacity     = MeshesNum() + static_cast<uint32_t>(load->meshFiles.size());
+  m_instanceCapacity = InstancesNum() + static_cast<uint32_t>(load->instancesNum);
+  m_instanceInfos.reserve(m_instanceCapacity);
+  m_instanceMatrices.reserve(m_instanceCapacity);
+  m_vertexHeap.Grow(static_cast<uint32_t>(m_vertexHeap.End() + vertices));
+  m_indexHeap.Grow(static_cast<uint32_t>(m_indexHeap.End() + indices));
+  m_index16Heap.Grow(static_cast<uint32_t>(m_index16Heap.End() + indices16));
+
+  LoadGeoDataOnGPU();
+
+  load->worker = std::thread([load = load.get()]() {
+    // leave a core to the render thread
+    const std::size_t workers = std::max<std::size_t>(defaultWorkerCount() - 1, 1);
+    const std::size_t window  = workers * 4;
+    std::vector<MappedMesh> decoded;
+    try
+    {
+      for (std::size_t first = 0; first < load->meshFiles.size() && !load->cancel; first += window)
+      {
+        const std::size_t count = std::min(window, load->meshFiles.size() - first);
+        decoded.clear();
+        decoded.resize(count);
+        parallelFor(count, workers, [&](std::size_t i) {
+          decoded[i] = mapMeshFile(load->meshFiles[first + i], load->optimizeMeshes);
+        });
+
+        // don't run ahead of the uploads by more than a window
+        std::unique_lock lock(load->mutex);
+        load->consumed.wait(lock, [&]() { return load->cancel || load->ready.size() < window; });
+        for (auto& mesh : decoded)
+          load->ready.push_back(std::move(mesh));
+      }
+    }
+    catch (...)
+    {
+      std::lock_guard lock(load->mutex);
+      load->error = std::current_exception();
+    }
+  });
+
+  m_pAsyncLoad = std::move(load);
+
+  if (m_pAsyncLoad->meshFiles.empty())
+    FinishAsyncLoad();
+
+  return true;
+}
+
+bool SceneManager::UpdateAsyncLoad()
+{
+  if (!m_pAsyncLoad)
+    return false;
+
+  auto& load = *m_pAsyncLoad;
+
+  // upload budget per call, so that a frame never stalls on a huge batch
+  constexpr std::size_t UPLOAD_BUDGET = 32 * 1024 * 1024;
+
+  std::vector<MappedMesh> batch;
+  std::exception_ptr error;
+  {
+    std::lock_guard lock(load.mutex);
+    std::size_t bytes = 0;
+    while (!load.ready.empty() && bytes < UPLOAD_BUDGET)
+    {
+      if (const auto& file = load.ready.front().file)
+        bytes += file->VerticesNum() * GpuVertexSize() + file->IndicesNum() * gpuIndexSize(file->VerticesNum());
+      batch.push_back(std::move(load.ready.front()));
+      load.ready.pop_front();
+    }
+    error = load.error;
+  }
+  load.consumed.notify_one();
+
+  if (error)
+  {
+    FinishAsyncLoad();
+    std::rethrow_exception(error);
+  }
+
+  if (batch.empty())
+    return false;
+
+  const uint32_t firstMesh     = MeshesNum();
+  const uint32_t firstInstance = InstancesNum();
+  for (auto& mesh : batch)
+  {
+    AccountMeshOptimize(mesh.optimize, load.meshFiles[load.nextMesh]);
+    AddSceneMesh(load, mesh);
+    ++load.nextMesh;
+  }
+
+  // the frame that draws these waits for them on the GPU, see RecordUploadAcquire
+  UploadResidentRange(firstMesh, firstInstance);
+  m_pStagingRing->SubmitAsync();
+
+  if (load.onProgress)
+    load.onProgress(static_cast<uint32_t>(load.nextMesh), static_cast<uint32_t>(load.meshFiles.size()));
+
+  if (load.nextMesh == load.meshFiles.size())
+    FinishAsyncLoad();
+
+  return true;
+}
+
+void SceneManager::FinishAsyncLoad()
+{
+  if (!m_pAsyncLoad)
+    return;
+
+  auto load = std::move(m_pAsyncLoad);
+  {
+    std::lock_guard lock(load->mutex);
+    load->cancel = true;
+  }
+  load->consumed.notify_all();
+  if (load->worker.joinable())
+    load->worker.join();
+
+  if (load->nextMesh != load->meshFiles.size())
+    return;
+
+  LogMeshDedupStats();
+  LogMeshOptimizeStats();
+
+  if (load->writeCache)
+  {
+    std::vector<std::string> sourceFiles = { load->scenePath };
+    sourceFiles.insert(sourceFiles.end(), load->meshFiles.begin(), load->meshFiles.end());
+    WriteSceneCache(load->cachePath, load->transpose, sourceFiles, load->firstCamera, load->firstLight);
+  }
+
+  if (load->onComplete)
+    load->onComplete();
+}
+
+SceneChangeStats SceneManager::ApplySceneChange(const std::string &changePath, bool transpose)
+{
+  SceneChangeStats stats;
+  if (m_pAsyncLoad)
+  {
+    vk_utils::logWarning("[SceneManager::ApplySceneChange] can't apply a change while a scene is still loading");
+    return stats;
+  }
+
+  struct ChangedInstance
+  {
+    uint32_t instId;
+    uint32_t hydraMeshId;
+    glm::mat4 matrix;
+  };
+
+  // change files are small, so everything is collected first and meshes are loaded in one go
+  std::vector<std::string> meshFiles;
+  std::vector<uint32_t> meshHydraIds;
+  std::vector<ChangedInstance> changedInstances;
+  bool discard = false;
+
+  hydra_xml::SceneEvents events;
+  events.onMesh = [&](std::string_view hydraId, const std::string& loc) {
+    meshFiles.push_back(loc);
+    meshHydraIds.push_back(hydraIdFrom(hydraId));
+  };
+  events.onSceneBegin = [&](bool a_discard) {
+    discard = a_discard;
+  };
+  events.onInstance = [&](uint32_t instId, std::string_view hydraMeshId, const LiteMath::float4x4& lmMat) {
+    const auto mat = lmToGlm(lmMat);
+    changedInstances.push_back(ChangedInstance{ instId, hydraIdFrom(hydraMeshId), transpose ? glm::transpose(mat) : mat });
+  };
+
+  if (hydra_xml::ReadSceneStreaming(changePath, events) < 0)
+  {
+    RUN_TIME_ERROR("ApplySceneChange error");
+  }
+
+  const uint32_t firstMesh     = MeshesNum();
+  const uint32_t firstInstance = InstancesNum();
+
+  // unchanged meshes hydra lists again resolve to the resident copy by content
+  std::vector<uint32_t> meshIds;
+  AppendMeshFiles(meshFiles, meshIds);
+  for (std::size_t i = 0; i < meshIds.size(); ++i)
+    m_meshByHydraId.insert_or_assign(meshHydraIds[i], meshIds[i]);
+  stats.meshesAdded = MeshesNum() - firstMesh;
+
+  std::vector<uint32_t> dirtyInstances;
+  std::vector<bool> listed(discard ? firstInstance : 0, false);
+  for (const auto& changed : changedInstances)
+  {
+    auto mesh = m_meshByHydraId.find(changed.hydraMeshId);
+    if (mesh == m_meshByHydraId.end())
+    {
+      std::stringstream ss;
+      ss << "[SceneManager::ApplySceneChange] instance " << changed.instId << " refers to unknown mesh " << changed.hydraMeshId;
+      vk_utils::logWarning(ss.str());
+      continue;
+    }
+
+    auto [inst, isNew] = m_instanceByHydraId.try_emplace(changed.instId, InstancesNum());
+    if (isNew)
+    {
+      InstanceMesh(mesh->second, changed.matrix);
+      ++stats.instancesAdded;
+      continue;
+    }
+
+    const uint32_t instId = inst->second;
+    if (instId < listed.size())
+      listed[instId] = true;
+
+    auto& info = m_instanceInfos[instId];
+    if (info.mesh_id != mesh->second || !info.renderMark || m_instanceMatrices[instId] != changed.matrix)
+    {
+      info.mesh_id    = mesh->second;
+      info.renderMark = true;
+      m_instanceMatrices[instId] = changed.matrix;
+      dirtyInstances.push_back(instId);
+      ++stats.instancesPatched;
+    }
+  }
+
+  // instances that didn't come from hydra are never hidden
+  if (discard)
+  {
+    for (const auto& [hydraId, instId] : m_instanceByHydraId)
+    {
+      if (instId < listed.size() && !listed[instId] && m_instanceInfos[instId].renderMark)
+      {
+        m_instanceInfos[instId].renderMark = false;
+        dirtyInstances.push_back(instId);
+        ++stats.instancesHidden;
+      }
+    }
+  }
+
+  // geometry that didn't fit is moved into bigger buffers on the GPU, only running out of
+  // mesh or instance slots recreates everything, since draw slots and bindings depend on them
+  if (MeshesNum() > m_meshCapacity || InstancesNum() > m_instanceCapacity)
+  {
+    // leave headroom, so that a stream of small edits doesn't reallocate on every one
+    auto grow = [](uint32_t& capacity, uint32_t needed) {
+      if (needed > capacity)
+        capacity = std::max(needed, capacity + capacity / 2);
+    };
+    grow(m_meshCapacity, MeshesNum());
+    grow(m_instanceCapacity, InstancesNum());
+
+    FreeGeoBuffers();
+    LoadGeoDataOnGPU();
+    stats.buffersReallocated = true;
+    return stats;
+  }
+
+  GrowGeometryBuffers();
+  UploadResidentRange(firstMesh, firstInstance);
+  UploadInstanceRanges(dirtyInstances);
+  m_pStagingRing->SubmitAsync();
+
+  return stats;
+}
+
+void SceneManager::LoadFromSceneCache(std::unique_ptr<SceneCache> cache)
+{
+  const auto& data = cache->Data();
+
+  m_meshInfos.assign(data.meshInfos.begin(), data.meshInfos.end());
+  m_meshBboxes.assign(data.meshBboxes.begin(), data.meshBboxes.end());
+  m_instanceInfos.assign(data.instanceInfos.begin(), data.instanceInfos.end());
+  m_instanceMatrices.assign(data.instanceMatrices.begin(), data.instanceMatrices.end());
+  m_sceneCameras.insert(m_sceneCameras.end(), data.cameras.begin(), data.cameras.end());
+
+  for (const auto& light : data.lights)
   {
     m_sceneLights.emplace_back(hydra_xml::LightInstance{
-        0, 0,
+        light.instId, light.lightId,
         {}, {},
-        LiteMath::translate4x4(float3{randS() * 100, randU() * 10, randS() * 100})
+        light.matrix
       });
   }
-  */
 
-  LoadGeoDataOnGPU();
-  hscene_main = nullptr;
+  // ids and hashes are what lets changes and later loads find these meshes again
+  for (std::size_t i = 0; i < data.meshHashes.size(); ++i)
+    m_meshesByHash.emplace(data.meshHashes[i], static_cast<uint32_t>(i));
+  for (const auto& [hydraId, meshId] : data.hydraMeshIds)
+    m_meshByHydraId.emplace(hydraId, meshId);
+  for (const auto& [hydraId, instId] : data.hydraInstanceIds)
+    m_instanceByHydraId.emplace(hydraId, instId);
+
+  // the cache keeps geometry back to back in mesh order, as Mesh8F vertices and 32 bit indices
+  // whatever the GPU layout is, so buffer offsets are worked out again
+  m_meshSources.resize(m_meshInfos.size());
+  std::size_t vertexDataOffset = 0;
+  std::size_t indexDataOffset  = 0;
+  for (std::size_t i = 0; i < m_meshInfos.size(); ++i)
+  {
+    auto& info = m_meshInfos[i];
+    m_meshSources[i].vertexDataOffset = vertexDataOffset;
+    m_meshSources[i].indexDataOffset  = indexDataOffset;
+    vertexDataOffset += info.m_vertNum * m_pMeshData->SingleVertexSize();
+    indexDataOffset  += info.m_indNum * m_pMeshData->SingleIndexSize();
 
-  return true;
+    PlaceMeshGeometry(info);
+  }
+
+  m_pSceneCache = std::move(cache);
+}
+
+void SceneManager::WriteSceneCache(const std::string& cachePath, bool transpose,
+  const std::vector<std::string>& sourceFiles, std::size_t firstCamera, std::size_t firstLight)
+{
+  std::vector<SceneCacheLight> lights;
+  lights.reserve(m_sceneLights.size() - firstLight);
+  for (std::size_t i = firstLight; i < m_sceneLights.size(); ++i)
+  {
+    const auto& light = m_sceneLights[i];
+    lights.emplace_back(SceneCacheLight{ light.instId, light.lightId, {}, light.matrix });
+  }
+
+  std::vector<uint64_t> meshHashes(m_meshInfos.size());
+  for (const auto& [hash, meshId] : m_meshesByHash)
+    meshHashes[meshId] = hash;
+
+  auto sortedIds = [](const std::unordered_map<uint32_t, uint32_t>& byHydraId) {
+    std::vector<SceneCacheHydraId> result;
+    result.reserve(byHydraId.size());
+    for (const auto& [hydraId, id] : byHydraId)
+      result.push_back(SceneCacheHydraId{ hydraId, id });
+    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.hydraId < b.hydraId; });
+    return result;
+  };
+  const auto hydraMeshIds     = sortedIds(m_meshByHydraId);
+  const auto hydraInstanceIds = sortedIds(m_instanceByHydraId);
+
+  const SceneCacheData data{
+    .meshInfos        = m_meshInfos,
+    .meshBboxes       = m_meshBboxes,
+    .meshHashes       = meshHashes,
+    .instanceInfos    = m_instanceInfos,
+    .instanceMatrices = m_instanceMatrices,
+    .cameras          = std::span(m_sceneCameras).subspan(firstCamera),
+    .lights           = lights,
+    .hydraMeshIds     = hydraMeshIds,
+    .hydraInstanceIds = hydraInstanceIds,
+  };
+
+  // geometry is written mesh by mesh straight from its source, same as UploadMeshGeometry does
+  const std::size_t vertexSize = m_pMeshData->SingleVertexSize();
+  const std::size_t indexSize  = m_pMeshData->SingleIndexSize();
+
+  const SceneCache::Stream vertices{ std::size_t(m_totalVertices) * vertexSize, [&](std::ostream& out) {
+      std::vector<float> encoded;
+      for (std::size_t i = 0; i < m_meshInfos.size(); ++i)
+      {
+        const auto& info   = m_meshInfos[i];
+        const auto& source = m_meshSources[i];
+        const char* bytes  = reinterpret_cast<const char*>(m_pMeshData->VertexData()) + source.vertexDataOffset;
+        if (source.file)
+        {
+          encoded.resize(info.m_vertNum * vertexSize / sizeof(float));
+          source.file->EncodeVertices8F(0, info.m_vertNum, encoded.data());
+          bytes = reinterpret_cast<const char*>(encoded.data());
+        }
+        out.write(bytes, static_cast<std::streamsize>(info.m_vertNum * vertexSize));
+      }
+    } };
+
+  const SceneCache::Stream indices{ (std::size_t(m_totalIndices) + m_totalIndices16) * indexSize, [&](std::ostream& out) {
+      for (std::size_t i = 0; i < m_meshInfos.size(); ++i)
+      {
+        const auto& info   = m_meshInfos[i];
+        const auto& source = m_meshSources[i];
+        const char* bytes  = source.file
+          ? reinterpret_cast<const char*>(source.file->Indices().data())
+          : reinterpret_cast<const char*>(m_pMeshData->IndexData()) + source.indexDataOffset;
+        out.write(bytes, static_cast<std::streamsize>(info.m_indNum * indexSize));
+      }
+    } };
+
+  if (!SceneCache::Write(cachePath, transpose, m_optimizeMeshes, sourceFiles, data, vertices, indices))
+  {
+    std::stringstream ss;
+    ss << "[SceneManager::LoadSceneXML] failed to write scene cache to " << cachePath;
+    vk_utils::logWarning(ss.str());
+  }
 }
 
 hydra_xml::Camera SceneManager::GetCamera(uint32_t camId) const
@@ -126,23 +877,12 @@ void SceneManager::LoadSingleTriangle()
   VkDeviceSize vertexBufSize = sizeof(Vertex) * vertices.size();
   VkDeviceSize indexBufSize  = sizeof(uint32_t) * indices.size();
   
-  VkMemoryRequirements vertMemReq, idxMemReq; 
-  m_geoVertBuf = vk_utils::createBuffer(m_device, vertexBufSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &vertMemReq);
-  m_geoIdxBuf  = vk_utils::createBuffer(m_device, indexBufSize,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &idxMemReq);
-
-  size_t pad = vk_utils::getPaddedSize(vertMemReq.size, idxMemReq.alignment);
+  m_geoVertBuf = vk_utils::createBuffer(m_device, vertexBufSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_geoIdxBuf  = vk_utils::createBuffer(m_device, indexBufSize,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
 
-  VkMemoryAllocateInfo allocateInfo = {};
-  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocateInfo.pNext           = nullptr;
-  allocateInfo.allocationSize  = pad + idxMemReq.size;
-  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(vertMemReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_physDevice);
+  GpuAllocator::TagScope tag("geometry");
+  m_geoMemAlloc = m_pAllocator->AllocateAndBind({m_geoVertBuf, m_geoIdxBuf});
 
-
-  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_geoMemAlloc));
-
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_geoVertBuf, m_geoMemAlloc, 0));
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_geoIdxBuf,  m_geoMemAlloc, pad));
   m_pCopyHelper->UpdateBuffer(m_geoVertBuf, 0, vertices.data(),  vertexBufSize);
   m_pCopyHelper->UpdateBuffer(m_geoIdxBuf,  0, indices.data(), indexBufSize);
 }
@@ -151,45 +891,305 @@ void SceneManager::LoadSingleTriangle()
 
 uint32_t SceneManager::AddMeshFromFile(const std::string& meshPath)
 {
-  //@TODO: other file formats
-  auto data = cmesh::LoadMeshFromVSGF(meshPath.c_str());
+  auto mesh = mapMeshFile(meshPath, m_optimizeMeshes);
 
-  if(data.VerticesNum() == 0)
+  if(mesh.file == nullptr)
     RUN_TIME_ERROR(("can't load mesh at " + meshPath).c_str());
+  AccountMeshOptimize(mesh.optimize, meshPath);
 
-  return AddMeshFromData(data);
+  const uint32_t firstMesh = MeshesNum();
+  const uint32_t meshId = AppendMesh(mesh);
+  UploadAddedMeshes(firstMesh);
+  return meshId;
 }
 
 uint32_t SceneManager::AddMeshFromData(cmesh::SimpleMesh &meshData)
+{
+  if (m_optimizeMeshes)
+    AccountMeshOptimize(optimizeMesh(meshData), "<mesh data>");
+
+  const uint32_t firstMesh = MeshesNum();
+  const uint32_t meshId = AppendMesh(meshData, computeMeshBbox(meshData), hashMeshPayload(meshData));
+  UploadAddedMeshes(firstMesh);
+  return meshId;
+}
+
+void SceneManager::UploadAddedMeshes(uint32_t firstMesh)
+{
+  // before the first upload and during an async load the meshes go up with everything else
+  if (m_geoVertBuf == VK_NULL_HANDLE || IsLoading() || firstMesh == MeshesNum())
+    return;
+
+  if (MeshesNum() > m_meshCapacity)
+  {
+    m_meshCapacity = std::max(MeshesNum(), m_meshCapacity + m_meshCapacity / 2);
+    FreeGeoBuffers();
+    LoadGeoDataOnGPU();
+    return;
+  }
+
+  GrowGeometryBuffers();
+  UploadResidentRange(firstMesh, InstancesNum());
+  m_pStagingRing->SubmitAsync();
+}
+
+void SceneManager::RemoveMesh(uint32_t meshId)
+{
+  assert(meshId < m_meshInfos.size());
+  assert(!IsLoading());
+  if (IsMeshRemoved(meshId))
+    return;
+
+  auto& info = m_meshInfos[meshId];
+  const bool index16 = fitsIndex16(info.m_vertNum);
+  m_vertexHeap.Free(static_cast<uint32_t>(info.m_vertexOffset), info.m_vertNum);
+  (index16 ? m_index16Heap : m_indexHeap).Free(info.m_indexOffset, info.m_indNum);
+  m_totalVertices -= info.m_vertNum;
+  (index16 ? m_totalIndices16 : m_totalIndices) -= info.m_indNum;
+
+  // the vertex count stays, it decides the index class and with it the draw slot,
+  // an empty index range is what makes the mesh draw nothing
+  info.m_indNum = 0;
+
+  std::erase_if(m_meshesByHash, [meshId](const auto& entry) { return entry.second == meshId; });
+  std::erase_if(m_meshByHydraId, [meshId](const auto& entry) { return entry.second == meshId; });
+
+  for (uint32_t instId = 0; instId < InstancesNum(); ++instId)
+  {
+    if (m_instanceInfos[instId].mesh_id == meshId && m_instanceInfos[instId].renderMark)
+      UnmarkInstance(instId);
+  }
+
+  if (m_meshInfoBuf == VK_NULL_HANDLE)
+    return;
+
+  // instances are only hidden on the next RecordInstanceUpdates, so the draw is emptied right away
+  // and the freed ranges can be handed out again by the next addition
+  const GpuMeshInfo gpuInfo = MakeGpuMeshInfo(meshId);
+  m_pStagingRing->UploadData(m_meshInfoBuf, meshId * sizeof(GpuMeshInfo), &gpuInfo, sizeof(gpuInfo));
+  m_pStagingRing->SubmitAsync();
+}
+
+uint32_t SceneManager::AppendMesh(const cmesh::SimpleMesh &meshData, const LiteMath::Box4f &bbox, uint64_t hash)
 {
   assert(meshData.VerticesNum() > 0);
   assert(meshData.IndicesNum() > 0);
 
+  const auto vertNum = (uint32_t)meshData.VerticesNum();
+  const auto indNum  = (uint32_t)meshData.IndicesNum();
+  if (auto duplicate = FindDuplicateMesh(hash, vertNum, indNum, nullptr, &meshData); duplicate != UINT32_MAX)
+    return duplicate;
+
+  m_meshSources.push_back(MeshSource{
+      nullptr, m_pMeshData->VertexDataSize(), m_pMeshData->IndexDataSize()
+    });
   m_pMeshData->Append(meshData);
 
-  MeshInfo info;
-  info.m_vertNum = (uint32_t)meshData.VerticesNum();
-  info.m_indNum  = (uint32_t)meshData.IndicesNum();
+  const auto meshId = AppendMeshInfo(vertNum, indNum, bbox);
+  m_meshesByHash.emplace(hash, meshId);
+  return meshId;
+}
 
-  info.m_vertexOffset = m_totalVertices;
-  info.m_indexOffset  = m_totalIndices;
+uint32_t SceneManager::AppendMesh(const MappedMesh &mesh)
+{
+  assert(mesh.file != nullptr);
+  // the file is encoded in Mesh8F (or compact) layout on upload
+  assert(m_pMeshData->SingleVertexSize() == 8 * sizeof(float));
 
-  info.m_vertexBufOffset = info.m_vertexOffset * m_pMeshData->SingleVertexSize();
-  info.m_indexBufOffset  = info.m_indexOffset  * m_pMeshData->SingleIndexSize();
+  const auto vertNum = mesh.file->VerticesNum();
+  const auto indNum  = mesh.file->IndicesNum();
+  if (auto duplicate = FindDuplicateMesh(mesh.hash, vertNum, indNum, mesh.file.get(), nullptr); duplicate != UINT32_MAX)
+    return duplicate;
 
-  m_totalVertices += (uint32_t)meshData.VerticesNum();
-  m_totalIndices  += (uint32_t)meshData.IndicesNum();
+  m_meshSources.push_back(MeshSource{ mesh.file });
 
-  m_meshInfos.push_back(info);
-  LiteMath::Box4f meshBox;
-  for (uint32_t i = 0; i < meshData.VerticesNum(); ++i) {
-    meshBox.include(reinterpret_cast<LiteMath::float4*>(meshData.vPos4f.data())[i]);
+  const auto meshId = AppendMeshInfo(vertNum, indNum, mesh.bbox);
+  m_meshesByHash.emplace(mesh.hash, meshId);
+  return meshId;
+}
+
+uint32_t SceneManager::FindDuplicateMesh(uint64_t hash, uint32_t vertNum, uint32_t indNum, const VsgfView* file,
+  const cmesh::SimpleMesh* meshData)
+{
+  ++m_dedupStats.meshesAdded;
+
+  // the new mesh as Mesh8F, only encoded once a candidate needs it
+  Mesh8F encoded;
+  std::vector<float> encodedFile;
+  MeshBytes bytes;
+
+  // the hash only picks the candidates, a mesh is shared only if its geometry is the same
+  auto [first, last] = m_meshesByHash.equal_range(hash);
+  for (auto it = first; it != last; ++it)
+  {
+    const auto& info = m_meshInfos[it->second];
+    if (info.m_vertNum != vertNum || info.m_indNum != indNum)
+      continue;
+
+    const auto& candidate = m_meshSources[it->second].file;
+    if (file != nullptr && candidate != nullptr)
+    {
+      if (!samePayload(*file, *candidate))
+        continue;
+    }
+    else
+    {
+      if (bytes.vertices.empty())
+      {
+        if (file != nullptr)
+        {
+          encodedFile.resize(vertNum * m_pMeshData->SingleVertexSize() / sizeof(float));
+          file->EncodeVertices8F(0, vertNum, encodedFile.data());
+          bytes = { std::as_bytes(std::span(encodedFile)), std::as_bytes(file->Indices()) };
+        }
+        else
+        {
+          encoded.Append(*meshData);
+          bytes = { { reinterpret_cast<const std::byte*>(encoded.VertexData()), encoded.VertexDataSize() },
+                    { reinterpret_cast<const std::byte*>(encoded.IndexData()), encoded.IndexDataSize() } };
+        }
+      }
+
+      std::vector<float> candidateScratch;
+      const MeshBytes other = MeshGeometryBytes(it->second, candidateScratch);
+      if (!std::ranges::equal(bytes.vertices, other.vertices) || !std::ranges::equal(bytes.indices, other.indices))
+        continue;
+    }
+
+    ++m_dedupStats.duplicates;
+    m_dedupStats.bytesSaved += vertNum * GpuVertexSize() + indNum * gpuIndexSize(vertNum);
+    return it->second;
+  }
+
+  return UINT32_MAX;
+}
+
+SceneManager::MeshBytes SceneManager::MeshGeometryBytes(uint32_t meshId, std::vector<float>& scratch)
+{
+  const auto& info   = m_meshInfos[meshId];
+  const auto& source = m_meshSources[meshId];
+  const std::size_t vertexBytes = info.m_vertNum * m_pMeshData->SingleVertexSize();
+  const std::size_t indexBytes  = info.m_indNum * m_pMeshData->SingleIndexSize();
+
+  if (source.file)
+  {
+    scratch.resize(vertexBytes / sizeof(float));
+    source.file->EncodeVertices8F(0, info.m_vertNum, scratch.data());
+    return { std::as_bytes(std::span(scratch)), std::as_bytes(source.file->Indices()) };
+  }
+
+  const std::size_t cachedMeshes = m_pSceneCache ? m_pSceneCache->Data().meshInfos.size() : 0;
+  const std::byte* vertices;
+  const std::byte* indices;
+  if (meshId < cachedMeshes)
+  {
+    vertices = m_pSceneCache->Data().vertices.data() + source.vertexDataOffset;
+    indices  = m_pSceneCache->Data().indices.data() + source.indexDataOffset;
+  }
+  else
+  {
+    vertices = reinterpret_cast<const std::byte*>(m_pMeshData->VertexData()) + source.vertexDataOffset;
+    indices  = reinterpret_cast<const std::byte*>(m_pMeshData->IndexData()) + source.indexDataOffset;
+  }
+  return { { vertices, vertexBytes }, { indices, indexBytes } };
+}
+
+void SceneManager::LogMeshDedupStats() const
+{
+  if (m_dedupStats.duplicates == 0)
+    return;
+
+  std::cout << "[SceneManager] " << m_dedupStats.duplicates << " of " << m_dedupStats.meshesAdded
+    << " meshes were duplicates, " << m_dedupStats.bytesSaved / (1024 * 1024) << " MB of geometry saved" << std::endl;
+}
+
+void SceneManager::AccountMeshOptimize(const MeshOptimizeStats &stats, const std::string &meshPath)
+{
+  switch (stats.result)
+  {
+  case MeshOptimizeStats::Result::Skipped:
+    return;
+  case MeshOptimizeStats::Result::Optimized:
+    ++m_optimizeTotals.optimized;
+    m_optimizeTotals.before += stats.before;
+    m_optimizeTotals.after  += stats.after;
+    break;
+  case MeshOptimizeStats::Result::Reused:
+    ++m_optimizeTotals.reused;
+    break;
+  case MeshOptimizeStats::Result::Failed:
+  {
+    ++m_optimizeTotals.failed;
+    std::stringstream ss;
+    ss << "[SceneManager::AccountMeshOptimize] couldn't optimize " << meshPath << ", using it as is";
+    vk_utils::logWarning(ss.str());
+    break;
+  }
   }
-  m_meshBboxes.push_back(meshBox);
+  m_optimizeTotals.cpuMs += stats.ms;
+}
+
+void SceneManager::LogMeshOptimizeStats() const
+{
+  const auto& totals = m_optimizeTotals;
+  if (totals.optimized + totals.reused + totals.failed == 0)
+    return;
+
+  std::cout << "[SceneManager] vertex cache: " << totals.optimized << " meshes optimized, "
+    << totals.reused << " reused from disk, " << totals.failed << " failed, " << totals.cpuMs << " ms";
+  if (totals.optimized > 0)
+  {
+    std::cout << "; ACMR " << totals.before.Acmr() << " -> " << totals.after.Acmr()
+      << ", ATVR " << totals.before.Atvr() << " -> " << totals.after.Atvr();
+  }
+  std::cout << std::endl;
+}
+
+uint32_t SceneManager::AppendMeshInfo(uint32_t vertNum, uint32_t indNum, const LiteMath::Box4f &bbox)
+{
+  MeshInfo info;
+  info.m_vertNum = vertNum;
+  info.m_indNum  = indNum;
+  PlaceMeshGeometry(info);
+
+  m_meshInfos.push_back(info);
+  m_meshBboxes.push_back(bbox);
 
   return (uint32_t)m_meshInfos.size() - 1;
 }
 
+void SceneManager::PlaceMeshGeometry(MeshInfo &info)
+{
+  const bool index16 = fitsIndex16(info.m_vertNum);
+  uint32_t& totalIndices = index16 ? m_totalIndices16 : m_totalIndices;
+
+  info.m_vertexOffset = AllocateGeometry(m_vertexHeap, info.m_vertNum);
+  info.m_indexOffset  = AllocateGeometry(index16 ? m_index16Heap : m_indexHeap, info.m_indNum);
+
+  info.m_vertexBufOffset = info.m_vertexOffset * GpuVertexSize();
+  info.m_indexBufOffset  = info.m_indexOffset  * gpuIndexSize(info.m_vertNum);
+
+  m_totalVertices += info.m_vertNum;
+  totalIndices    += info.m_indNum;
+
+  const auto index32Meshes = static_cast<uint32_t>(m_meshDrawRanks.size()) - m_index16Meshes;
+  m_meshDrawRanks.push_back(index16 ? m_index16Meshes++ : index32Meshes);
+}
+
+uint32_t SceneManager::AllocateGeometry(RangeAllocator &heap, uint32_t size)
+{
+  uint32_t offset = heap.Allocate(size);
+  if (offset == RangeAllocator::NO_SPACE)
+  {
+    // while nothing is on the GPU meshes are packed back to back, which the scene cache relies on,
+    // afterwards leave headroom so that adding meshes one by one doesn't copy the buffers every time
+    const uint32_t headroom = m_geoVertBuf != VK_NULL_HANDLE ? heap.Capacity() + heap.Capacity() / 2 : 0;
+    heap.Grow(std::max(heap.End() + size, headroom));
+    offset = heap.Allocate(size);
+  }
+  return offset;
+}
+
 void SceneManager::AddLandscape()
 {
   constexpr std::size_t width = 1024;
@@ -225,6 +1225,7 @@ void SceneManager::AddLandscape()
     }
   }
   
+  GpuAllocator::TagScope tag("landscape");
   auto& landscape = m_landscapes.emplace_back(
     Landscape{
       .heightmap = vk_utils::allocateColorTextureFromDataLDR(m_device, m_physDevice,
@@ -235,9 +1236,8 @@ void SceneManager::AddLandscape()
         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT),
     });
 
-  landscape.allocation = vk_utils::allocateAndBindWithPadding(m_device, m_physDevice,
-    {landscape.tileMinMaxHeights},
-    VkMemoryAllocateFlags{});
+  landscape.allocation = m_pAllocator->AllocateAndBind({landscape.tileMinMaxHeights});
+  m_pAllocator->TrackImage(landscape.heightmap.image);
   
   m_pCopyHelper->UpdateBuffer(landscape.tileMinMaxHeights, 0,
     tileHeights.data(), tileHeights.size() * sizeof(tileHeights[0]));
@@ -279,6 +1279,7 @@ uint32_t SceneManager::InstanceMesh(const uint32_t meshId,
   const glm::mat4& matrix, bool markForRender)
 {
   assert(meshId < m_meshInfos.size());
+  assert(!IsMeshRemoved(meshId));
 
   //@TODO: maybe move
   m_instanceMatrices.push_back(matrix);
@@ -291,16 +1292,182 @@ uint32_t SceneManager::InstanceMesh(const uint32_t meshId,
   return static_cast<uint32_t>(m_instanceMatrices.size() - 1);
 }
 
+void SceneManager::SetInstanceMatrix(const uint32_t instId, const glm::mat4& matrix)
+{
+  assert(instId < m_instanceMatrices.size());
+  m_instanceMatrices[instId] = matrix;
+  MarkInstanceDirty(instId, INSTANCE_MATRIX_DIRTY);
+}
+
 void SceneManager::MarkInstance(const uint32_t instId)
 {
   assert(instId < m_instanceInfos.size());
   m_instanceInfos[instId].renderMark = true;
+  MarkInstanceDirty(instId, INSTANCE_INFO_DIRTY);
 }
 
 void SceneManager::UnmarkInstance(const uint32_t instId)
 {
   assert(instId < m_instanceInfos.size());
   m_instanceInfos[instId].renderMark = false;
+  MarkInstanceDirty(instId, INSTANCE_INFO_DIRTY);
+}
+
+void SceneManager::MarkInstanceDirty(const uint32_t instId, const uint8_t bits)
+{
+  // not on the GPU yet, goes there whole with the appended range
+  if (instId >= m_gpuInstances)
+    return;
+
+  if (m_instanceDirty.size() < m_gpuInstances)
+    m_instanceDirty.resize(m_gpuInstances, 0);
+  if (m_instanceDirty[instId] == 0)
+    m_dirtyInstances.push_back(instId);
+  m_instanceDirty[instId] |= bits;
+}
+
+void SceneManager::SetFramesInFlight(const uint32_t frames)
+{
+  if (frames == m_framesInFlight)
+    return;
+  // slots are laid out for the old count, the ring is made again on the next update
+  FreeInstanceUpdateRing();
+  m_framesInFlight = std::max(frames, 1u);
+}
+
+InstanceUpdateStats SceneManager::RecordInstanceUpdates(VkCommandBuffer a_cmdBuff, const uint32_t a_frame)
+{
+  InstanceUpdateStats stats;
+  if (m_instanceMatricesBuffer == VK_NULL_HANDLE)
+    return stats;
+
+  const uint32_t gpuEnd = std::min(InstancesNum(), m_instanceCapacity);
+  stats.pending = InstancesNum() - gpuEnd;
+  if (stats.pending > 0 && !m_instanceOverflowWarned)
+  {
+    std::stringstream ss;
+    ss << "[SceneManager::RecordInstanceUpdates] " << stats.pending
+       << " instances don't fit the instance buffers, they need ReloadGPUData";
+    vk_utils::logWarning(ss.str());
+    m_instanceOverflowWarned = true;
+  }
+
+  if (m_dirtyInstances.empty() && m_gpuInstances >= gpuEnd)
+    return stats;
+
+  struct Range
+  {
+    uint32_t first;
+    uint32_t count;
+  };
+
+  // the same merging as UploadInstanceRanges, the appended instances go last
+  std::sort(m_dirtyInstances.begin(), m_dirtyInstances.end());
+  auto collect = [&](uint8_t bit) {
+    std::vector<Range> ranges;
+    auto add = [&ranges](uint32_t first, uint32_t count) {
+      if (!ranges.empty() && first - (ranges.back().first + ranges.back().count - 1) <= MAX_INSTANCE_GAP)
+        ranges.back().count = first + count - ranges.back().first;
+      else
+        ranges.push_back({ first, count });
+    };
+    for (auto instId : m_dirtyInstances)
+    {
+      if (m_instanceDirty[instId] & bit)
+        add(instId, 1);
+    }
+    if (m_gpuInstances < gpuEnd)
+      add(m_gpuInstances, gpuEnd - m_gpuInstances);
+    return ranges;
+  };
+  const auto matrixRanges = collect(INSTANCE_MATRIX_DIRTY);
+  const auto infoRanges   = collect(INSTANCE_INFO_DIRTY);
+
+  if (m_instanceUpdateBuf == VK_NULL_HANDLE)
+  {
+    m_instanceUpdateSlotSize = VkDeviceSize(m_instanceCapacity) * (sizeof(GpuInstanceTransform) + sizeof(GpuInstanceInfo));
+    m_instanceUpdateBuf = vk_utils::createBuffer(m_device, m_instanceUpdateSlotSize * m_framesInFlight,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    GpuAllocator::TagScope tag("instance updates");
+    m_instanceUpdateAlloc = m_pAllocator->AllocateAndBind({m_instanceUpdateBuf},
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  }
+
+  // every range is at most the whole buffer, so a slot never overflows
+  std::byte* mapped = m_pAllocator->Info(m_instanceUpdateAlloc).mapped;
+  VkDeviceSize srcOffset = (a_frame % m_framesInFlight) * m_instanceUpdateSlotSize;
+  auto stage = [&](VkDeviceSize elementSize, const std::vector<Range>& ranges, auto&& fill) {
+    std::vector<VkBufferCopy> regions;
+    regions.reserve(ranges.size());
+    for (const auto& range : ranges)
+    {
+      const VkDeviceSize size = range.count * elementSize;
+      fill(range.first, range.count, mapped + srcOffset);
+      regions.push_back({ srcOffset, range.first * elementSize, size });
+      srcOffset += size;
+
+      stats.bytes += size;
+      stats.instances += range.count;
+    }
+    return regions;
+  };
+  const auto matrixRegions = stage(sizeof(GpuInstanceTransform), matrixRanges, packTransforms(m_instanceMatrices.data()));
+  const auto infoRegions   = stage(sizeof(GpuInstanceInfo), infoRanges,
+    [this](std::size_t first, std::size_t count, std::byte* dst) {
+      std::memcpy(dst, m_instanceInfos.data() + first, count * sizeof(GpuInstanceInfo));
+    });
+  stats.regions = static_cast<uint32_t>(matrixRegions.size() + infoRegions.size());
+
+  // last frame's culling and vertex shaders may still read what is about to be overwritten
+  const VkPipelineStageFlags readers = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, readers, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+  if (!matrixRegions.empty())
+    vkCmdCopyBuffer(a_cmdBuff, m_instanceUpdateBuf, m_instanceMatricesBuffer,
+      static_cast<uint32_t>(matrixRegions.size()), matrixRegions.data());
+  if (!infoRegions.empty())
+    vkCmdCopyBuffer(a_cmdBuff, m_instanceUpdateBuf, m_instanceInfosBuffer,
+      static_cast<uint32_t>(infoRegions.size()), infoRegions.data());
+
+  std::array<VkBufferMemoryBarrier, 2> barriers;
+  barriers.fill(VkBufferMemoryBarrier{
+    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .offset = 0,
+    .size = VK_WHOLE_SIZE,
+  });
+  barriers[0].buffer = m_instanceMatricesBuffer;
+  barriers[1].buffer = m_instanceInfosBuffer;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, readers, 0,
+    0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+
+  for (auto instId : m_dirtyInstances)
+    m_instanceDirty[instId] = 0;
+  m_dirtyInstances.clear();
+  m_gpuInstances = std::max(m_gpuInstances, gpuEnd);
+
+  return stats;
+}
+
+uint64_t SceneManager::RecordUploadAcquire(VkCommandBuffer a_cmdBuff)
+{
+  // scene buffers are read all over the frame, and RecordInstanceUpdates writes to some of them
+  return m_pStagingRing->RecordAcquire(a_cmdBuff, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+    VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+}
+
+void SceneManager::FreeInstanceUpdateRing()
+{
+  if (m_instanceUpdateBuf != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_instanceUpdateBuf, nullptr);
+    m_instanceUpdateBuf = VK_NULL_HANDLE;
+  }
+  m_pAllocator->Free(m_instanceUpdateAlloc);
+  m_instanceUpdateSlotSize = 0;
 }
 
 void SceneManager::ReloadGPUData()
@@ -311,18 +1478,27 @@ void SceneManager::ReloadGPUData()
 
 void SceneManager::LoadGeoDataOnGPU()
 {
-  VkDeviceSize vertexBufSize = m_pMeshData->VertexDataSize();
-  VkDeviceSize indexBufSize  = m_pMeshData->IndexDataSize();
-  VkDeviceSize infoBufSize   = m_meshInfos.size() * sizeof(GpuMeshInfo);
-  VkDeviceSize instanceInfoBufSize = m_instanceInfos.size() * sizeof(GpuInstanceInfo);
-  VkDeviceSize instanceMatrixBufSize = m_instanceMatrices.size() * sizeof(m_instanceMatrices[0]);
+  // an async load reserves room for meshes that aren't decoded yet, from here on
+  // the capacities describe what the buffers can hold
+  m_meshCapacity     = MeshesCapacity();
+  m_instanceCapacity = InstancesCapacity();
+  m_vertexCapacity   = m_vertexHeap.Capacity();
+  m_indexCapacity    = m_indexHeap.Capacity();
+  m_index16Capacity  = m_index16Heap.Capacity();
+
+  // one of the index classes is often empty, buffers can't be
+  VkDeviceSize vertexBufSize = VkDeviceSize(m_vertexCapacity) * GpuVertexSize();
+  VkDeviceSize indexBufSize  = std::max<VkDeviceSize>(VkDeviceSize(m_indexCapacity) * sizeof(uint32_t), 4);
+  VkDeviceSize index16BufSize = std::max<VkDeviceSize>(VkDeviceSize(m_index16Capacity) * sizeof(uint16_t), 4);
+  VkDeviceSize infoBufSize   = MeshesCapacity() * sizeof(GpuMeshInfo);
+  VkDeviceSize instanceInfoBufSize = InstancesCapacity() * sizeof(GpuInstanceInfo);
+  VkDeviceSize instanceMatrixBufSize = InstancesCapacity() * sizeof(GpuInstanceTransform);
   VkDeviceSize lightsBufSize = m_sceneLights.size() * sizeof(GpuLight);
   VkDeviceSize landscapeInfoBufSize = m_landscapeInfos.size() * sizeof(LandscapeGpuInfo);
   
-  m_geoVertBuf  = vk_utils::createBuffer(m_device, vertexBufSize,
-      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-  m_geoIdxBuf   = vk_utils::createBuffer(m_device, indexBufSize,
-      VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_geoVertBuf  = vk_utils::createBuffer(m_device, std::max<VkDeviceSize>(vertexBufSize, 4), GEO_VERTEX_USAGE);
+  m_geoIdxBuf   = vk_utils::createBuffer(m_device, indexBufSize,   GEO_INDEX_USAGE);
+  m_geoIdx16Buf = vk_utils::createBuffer(m_device, index16BufSize, GEO_INDEX_USAGE);
   m_meshInfoBuf = vk_utils::createBuffer(m_device, infoBufSize,
       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
   m_instanceInfosBuffer = vk_utils::createBuffer(m_device, instanceInfoBufSize,
@@ -334,24 +1510,24 @@ void SceneManager::LoadGeoDataOnGPU()
   m_landscapeGpuInfos = vk_utils::createBuffer(m_device, landscapeInfoBufSize,
       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 
-  VkMemoryAllocateFlags allocFlags {};
-
-  m_geoMemAlloc = vk_utils::allocateAndBindWithPadding(m_device, m_physDevice,
-      {m_geoVertBuf, m_geoIdxBuf, m_meshInfoBuf, m_instanceInfosBuffer,
-        m_instanceMatricesBuffer, m_lightsBuffer, m_landscapeGpuInfos},
-      allocFlags);
+  {
+    GpuAllocator::TagScope tag("geometry");
+    m_geoVertAlloc  = m_pAllocator->AllocateAndBind({m_geoVertBuf});
+    m_geoIdxAlloc   = m_pAllocator->AllocateAndBind({m_geoIdxBuf});
+    m_geoIdx16Alloc = m_pAllocator->AllocateAndBind({m_geoIdx16Buf});
+  }
+  {
+    GpuAllocator::TagScope tag("scene data");
+    m_geoMemAlloc = m_pAllocator->AllocateAndBind(
+        {m_meshInfoBuf, m_instanceInfosBuffer, m_instanceMatricesBuffer, m_lightsBuffer, m_landscapeGpuInfos});
+  }
+  ++m_buffersGeneration;
 
   std::vector<GpuMeshInfo> mesh_info_tmp;
   mesh_info_tmp.reserve(m_meshInfos.size());
   for(std::size_t i = 0; i < m_meshInfos.size(); ++i)
   {
-    const auto& info = m_meshInfos[i];
-    const auto& aabb = m_meshBboxes[i];
-    mesh_info_tmp.emplace_back(GpuMeshInfo {
-        info.m_indNum, info.m_indexOffset, static_cast<uint32_t>(info.m_vertexOffset),
-        glm::vec3(aabb.boxMin.x, aabb.boxMin.y, aabb.boxMin.z),
-        glm::vec3(aabb.boxMax.x, aabb.boxMax.y, aabb.boxMax.z)
-      });
+    mesh_info_tmp.emplace_back(MakeGpuMeshInfo(i));
   }
 
   // TODO: proper color and radius
@@ -369,30 +1545,320 @@ void SceneManager::LoadGeoDataOnGPU()
   }
 
 
-  m_pCopyHelper->UpdateBuffer(m_geoVertBuf, 0,
-      m_pMeshData->VertexData(), vertexBufSize);
+  // everything goes through the staging ring and is flushed once at the end,
+  // small scenes end up as a single submission with one copy per buffer
+  UploadMeshGeometry(0);
 
-  m_pCopyHelper->UpdateBuffer(m_geoIdxBuf, 0,
-      m_pMeshData->IndexData(), indexBufSize);
-
-  m_pCopyHelper->UpdateBuffer(m_meshInfoBuf, 0,
+  m_pStagingRing->UploadData(m_meshInfoBuf, 0,
       mesh_info_tmp.data(), mesh_info_tmp.size() * sizeof(mesh_info_tmp[0]));
 
-  m_pCopyHelper->UpdateBuffer(m_instanceInfosBuffer, 0,
+  m_pStagingRing->UploadData(m_instanceInfosBuffer, 0,
       m_instanceInfos.data(), m_instanceInfos.size() * sizeof(m_instanceInfos[0]));
 
-  m_pCopyHelper->UpdateBuffer(m_instanceMatricesBuffer, 0,
-      m_instanceMatrices.data(), m_instanceMatrices.size() * sizeof(m_instanceMatrices[0]));
+  m_pStagingRing->Upload(m_instanceMatricesBuffer, 0, m_instanceMatrices.size(), sizeof(GpuInstanceTransform),
+      packTransforms(m_instanceMatrices.data()));
 
-  m_pCopyHelper->UpdateBuffer(m_lightsBuffer, 0,
+  m_pStagingRing->UploadData(m_lightsBuffer, 0,
       lights_tmp.data(), lights_tmp.size() * sizeof(lights_tmp[0]));
 
-  m_pCopyHelper->UpdateBuffer(m_landscapeGpuInfos, 0,
+  m_pStagingRing->UploadData(m_landscapeGpuInfos, 0,
       m_landscapeInfos.data(), m_landscapeInfos.size() * sizeof(m_landscapeInfos[0]));
+
+  m_pStagingRing->Flush();
+
+  m_gpuInstances = InstancesNum();
+  m_instanceDirty.clear();
+  m_dirtyInstances.clear();
+  m_instanceOverflowWarned = false;
 }
 
-void SceneManager::FreeGPUResource()
+bool SceneManager::SetVertexFormat(VertexFormat format)
+{
+  if (!m_meshInfos.empty() || m_pAsyncLoad)
+  {
+    vk_utils::logWarning("[SceneManager::SetVertexFormat] can't change the vertex format of a loaded scene");
+    return false;
+  }
+  m_vertexFormat = format;
+  return true;
+}
+
+std::size_t SceneManager::GpuVertexSize() const
 {
+  return m_vertexFormat == VertexFormat::Compact ? sizeof(CompactVertex) : m_pMeshData->SingleVertexSize();
+}
+
+VkPipelineVertexInputStateCreateInfo SceneManager::GetPipelineVertexInputStateCreateInfo()
+{
+  if (m_vertexFormat == VertexFormat::Full)
+    return m_pMeshData->VertexInputLayout();
+
+  m_compactBinding = VkVertexInputBindingDescription{
+    .binding   = 0,
+    .stride    = sizeof(CompactVertex),
+    .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+  };
+  m_compactAttributes = {
+    VkVertexInputAttributeDescription{ 0, 0, VK_FORMAT_R16G16B16A16_UINT, offsetof(CompactVertex, position) },
+    VkVertexInputAttributeDescription{ 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal) },
+    VkVertexInputAttributeDescription{ 2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, texCoord) },
+  };
+
+  return VkPipelineVertexInputStateCreateInfo{
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+    .vertexBindingDescriptionCount   = 1,
+    .pVertexBindingDescriptions      = &m_compactBinding,
+    .vertexAttributeDescriptionCount = static_cast<uint32_t>(m_compactAttributes.size()),
+    .pVertexAttributeDescriptions    = m_compactAttributes.data(),
+  };
+}
+
+GpuMeshInfo SceneManager::MakeGpuMeshInfo(std::size_t meshId) const
+{
+  const auto& info = m_meshInfos[meshId];
+  const auto& aabb = m_meshBboxes[meshId];
+  const uint32_t rank = m_meshDrawRanks[meshId];
+  return GpuMeshInfo {
+      info.m_indNum, info.m_indexOffset, static_cast<uint32_t>(info.m_vertexOffset),
+      glm::vec3(aabb.boxMin.x, aabb.boxMin.y, aabb.boxMin.z),
+      glm::vec3(aabb.boxMax.x, aabb.boxMax.y, aabb.boxMax.z),
+      fitsIndex16(info.m_vertNum) ? Index16Draws().first + rank : Index32Draws().first + rank
+    };
+}
+
+void SceneManager::UploadMeshGeometry(uint32_t firstMesh)
+{
+  const std::size_t sourceVertexSize = m_pMeshData->SingleVertexSize();
+  const std::size_t vertexSize = GpuVertexSize();
+  const bool compact = m_vertexFormat == VertexFormat::Compact;
+
+  // sources always keep 32 bit indices, meshes that fit get them narrowed on the way
+  auto uploadIndices = [this](const MeshInfo& info, const uint32_t* indices) {
+    if (fitsIndex16(info.m_vertNum))
+      m_pStagingRing->Upload(m_geoIdx16Buf, info.m_indexBufOffset, info.m_indNum, sizeof(uint16_t),
+        [indices](std::size_t first, std::size_t count, std::byte* dst) {
+          auto* out = reinterpret_cast<uint16_t*>(dst);
+          for (std::size_t j = 0; j < count; ++j)
+            out[j] = static_cast<uint16_t>(indices[first + j]);
+        });
+    else
+      m_pStagingRing->Upload(m_geoIdxBuf, info.m_indexBufOffset, info.m_indNum, sizeof(uint32_t),
+        [indices](std::size_t first, std::size_t count, std::byte* dst) {
+          std::memcpy(dst, indices + first, count * sizeof(uint32_t));
+        });
+  };
+
+  const std::size_t cachedMeshes = m_pSceneCache ? m_pSceneCache->Data().meshInfos.size() : 0;
+
+  for (std::size_t i = firstMesh; i < m_meshInfos.size(); ++i)
+  {
+    const auto& info   = m_meshInfos[i];
+    const auto& source = m_meshSources[i];
+    const auto& bbox   = m_meshBboxes[i];
+
+    // removed, its ranges may belong to someone else by now
+    if (info.m_indNum == 0)
+      continue;
+
+    if (source.file)
+    {
+      const auto& file = *source.file;
+      if (compact)
+        m_pStagingRing->Upload(m_geoVertBuf, info.m_vertexBufOffset, info.m_vertNum, vertexSize,
+          [&file, &bbox](std::size_t first, std::size_t count, std::byte* dst) {
+            file.EncodeVerticesCompact(static_cast<uint32_t>(first), static_cast<uint32_t>(count), bbox,
+              reinterpret_cast<CompactVertex*>(dst));
+          });
+      else
+        m_pStagingRing->Upload(m_geoVertBuf, info.m_vertexBufOffset, info.m_vertNum, vertexSize,
+          [&file](std::size_t first, std::size_t count, std::byte* dst) {
+            file.EncodeVertices8F(static_cast<uint32_t>(first), static_cast<uint32_t>(count), reinterpret_cast<float*>(dst));
+          });
+      uploadIndices(info, file.Indices().data());
+    }
+    else
+    {
+      // both the cache and m_pMeshData hold Mesh8F vertices and 32 bit indices
+      const std::byte* vertices;
+      const std::byte* indices;
+      if (i < cachedMeshes)
+      {
+        vertices = m_pSceneCache->Data().vertices.data() + source.vertexDataOffset;
+        indices  = m_pSceneCache->Data().indices.data() + source.indexDataOffset;
+      }
+      else
+      {
+        vertices = reinterpret_cast<const std::byte*>(m_pMeshData->VertexData()) + source.vertexDataOffset;
+        indices  = reinterpret_cast<const std::byte*>(m_pMeshData->IndexData()) + source.indexDataOffset;
+      }
+
+      if (compact)
+        m_pStagingRing->Upload(m_geoVertBuf, info.m_vertexBufOffset, info.m_vertNum, vertexSize,
+          [vertices, sourceVertexSize, &bbox](std::size_t first, std::size_t count, std::byte* dst) {
+            compactFrom8F(reinterpret_cast<const float*>(vertices + first * sourceVertexSize), count, bbox,
+              reinterpret_cast<CompactVertex*>(dst));
+          });
+      else
+        m_pStagingRing->Upload(m_geoVertBuf, info.m_vertexBufOffset, info.m_vertNum, vertexSize,
+          [vertices, vertexSize](std::size_t first, std::size_t count, std::byte* dst) {
+            std::memcpy(dst, vertices + first * vertexSize, count * vertexSize);
+          });
+      uploadIndices(info, reinterpret_cast<const uint32_t*>(indices));
+    }
+  }
+}
+
+void SceneManager::UploadResidentRange(uint32_t firstMesh, uint32_t firstInstance)
+{
+  // duplicates of resident meshes only bring new instances
+  if (firstMesh != MeshesNum())
+  {
+    UploadMeshGeometry(firstMesh);
+
+    std::vector<GpuMeshInfo> mesh_info_tmp;
+    mesh_info_tmp.reserve(MeshesNum() - firstMesh);
+    for (std::size_t i = firstMesh; i < MeshesNum(); ++i)
+    {
+      mesh_info_tmp.emplace_back(MakeGpuMeshInfo(i));
+    }
+
+    m_pStagingRing->UploadData(m_meshInfoBuf, firstMesh * sizeof(GpuMeshInfo),
+        mesh_info_tmp.data(), mesh_info_tmp.size() * sizeof(mesh_info_tmp[0]));
+  }
+
+  if (firstInstance == InstancesNum())
+    return;
+
+  m_pStagingRing->UploadData(m_instanceInfosBuffer, firstInstance * sizeof(GpuInstanceInfo),
+      m_instanceInfos.data() + firstInstance, (InstancesNum() - firstInstance) * sizeof(m_instanceInfos[0]));
+
+  m_pStagingRing->Upload(m_instanceMatricesBuffer, firstInstance * sizeof(GpuInstanceTransform),
+      InstancesNum() - firstInstance, sizeof(GpuInstanceTransform), packTransforms(m_instanceMatrices.data() + firstInstance));
+  m_gpuInstances = std::max(m_gpuInstances, InstancesNum());
+}
+
+void SceneManager::UploadInstanceRanges(std::vector<uint32_t> &instances)
+{
+  if (instances.empty())
+    return;
+
+  std::sort(instances.begin(), instances.end());
+  instances.erase(std::unique(instances.begin(), instances.end()), instances.end());
+
+  auto copyFrom = [](const auto* src) {
+    return [src](std::size_t first, std::size_t count, std::byte* dst) {
+      std::memcpy(dst, src + first, count * sizeof(*src));
+    };
+  };
+
+  for (std::size_t i = 0; i < instances.size(); )
+  {
+    const uint32_t first = instances[i];
+    uint32_t last = first;
+    for (++i; i < instances.size() && instances[i] - last <= MAX_INSTANCE_GAP; ++i)
+      last = instances[i];
+
+    const uint32_t count = last - first + 1;
+    m_pStagingRing->Upload(m_instanceInfosBuffer, first * sizeof(GpuInstanceInfo), count, sizeof(GpuInstanceInfo),
+      copyFrom(m_instanceInfos.data() + first));
+    m_pStagingRing->Upload(m_instanceMatricesBuffer, first * sizeof(GpuInstanceTransform), count,
+      sizeof(GpuInstanceTransform), packTransforms(m_instanceMatrices.data() + first));
+  }
+}
+
+void SceneManager::GrowGeometryBuffers()
+{
+  GrowGeometryBuffer(m_geoVertBuf, m_geoVertAlloc, m_vertexCapacity, m_vertexHeap, GpuVertexSize(), GEO_VERTEX_USAGE);
+  GrowGeometryBuffer(m_geoIdxBuf, m_geoIdxAlloc, m_indexCapacity, m_indexHeap, sizeof(uint32_t), GEO_INDEX_USAGE);
+  GrowGeometryBuffer(m_geoIdx16Buf, m_geoIdx16Alloc, m_index16Capacity, m_index16Heap, sizeof(uint16_t), GEO_INDEX_USAGE);
+}
+
+void SceneManager::GrowGeometryBuffer(VkBuffer &buffer, GpuAllocation &allocation, uint32_t &capacity,
+  const RangeAllocator &heap, VkDeviceSize elementSize, VkBufferUsageFlags usage)
+{
+  if (heap.Capacity() <= capacity)
+    return;
+
+  VkBuffer grown = vk_utils::createBuffer(m_device, VkDeviceSize(heap.Capacity()) * elementSize, usage);
+  GpuAllocation grownAllocation;
+  {
+    GpuAllocator::TagScope tag("geometry");
+    grownAllocation = m_pAllocator->AllocateAndBind({grown});
+  }
+
+  // The old buffer belongs to the graphics queue, so it is copied there, after taking over
+  // whatever streamed into it last. Only the part below the heap's tail can hold anything,
+  // holes are copied along.
+  const uint32_t live = std::min(capacity, heap.End());
+  m_pStagingRing->SubmitAsync();
+
+  VkCommandBuffer cmdBuf = vk_utils::createCommandBuffer(m_device, m_graphicsCmdPool);
+  VkCommandBufferBeginInfo beginInfo{
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuf, &beginInfo));
+  const uint64_t uploads = RecordUploadAcquire(cmdBuf);
+  if (live > 0)
+  {
+    const VkBufferCopy region{ 0, 0, VkDeviceSize(live) * elementSize };
+    vkCmdCopyBuffer(cmdBuf, buffer, grown, 1, &region);
+  }
+  // frames come later in submission order
+  const VkMemoryBarrier copied{
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+  };
+  vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+    1, &copied, 0, nullptr, 0, nullptr);
+  VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuf));
+
+  const VkSemaphore timeline = m_pStagingRing->Timeline();
+  const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  VkTimelineSemaphoreSubmitInfo timelineInfo{
+    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+    .waitSemaphoreValueCount = 1,
+    .pWaitSemaphoreValues = &uploads,
+  };
+  VkSubmitInfo submitInfo{
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .pNext = uploads != 0 ? &timelineInfo : nullptr,
+    .waitSemaphoreCount = uploads != 0 ? 1u : 0u,
+    .pWaitSemaphores = &timeline,
+    .pWaitDstStageMask = &waitStage,
+    .commandBufferCount = 1,
+    .pCommandBuffers = &cmdBuf,
+  };
+  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQ, 1, &submitInfo, VK_NULL_HANDLE));
+
+  // also makes sure no frame in flight uses the old buffer anymore
+  VK_CHECK_RESULT(vkQueueWaitIdle(m_graphicsQ));
+  vkFreeCommandBuffers(m_device, m_graphicsCmdPool, 1, &cmdBuf);
+  vkDestroyBuffer(m_device, buffer, nullptr);
+  m_pAllocator->Free(allocation);
+
+  buffer     = grown;
+  allocation = grownAllocation;
+  capacity   = heap.Capacity();
+}
+
+void SceneManager::FreeGeoBuffers()
+{
+  // streamed uploads may still be copying into these
+  if (m_pStagingRing)
+    m_pStagingRing->Flush();
+  for (VkBuffer buffer : {m_geoVertBuf, m_geoIdxBuf, m_geoIdx16Buf, m_meshInfoBuf, m_instanceMatricesBuffer,
+    m_instanceInfosBuffer, m_lightsBuffer, m_landscapeGpuInfos})
+  {
+    if (m_pStagingRing && buffer != VK_NULL_HANDLE)
+      m_pStagingRing->Forget(buffer);
+  }
+
+  FreeInstanceUpdateRing();
+  m_gpuInstances = 0;
+  m_instanceDirty.clear();
+  m_dirtyInstances.clear();
 
   if(m_geoVertBuf != VK_NULL_HANDLE)
   {
@@ -406,6 +1872,12 @@ void SceneManager::FreeGPUResource()
     m_geoIdxBuf = VK_NULL_HANDLE;
   }
 
+  if(m_geoIdx16Buf != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_geoIdx16Buf, nullptr);
+    m_geoIdx16Buf = VK_NULL_HANDLE;
+  }
+
   if(m_meshInfoBuf != VK_NULL_HANDLE)
   {
     vkDestroyBuffer(m_device, m_meshInfoBuf, nullptr);
@@ -436,16 +1908,21 @@ void SceneManager::FreeGPUResource()
     m_landscapeGpuInfos = VK_NULL_HANDLE;
   }
 
-  if(m_geoMemAlloc != VK_NULL_HANDLE)
-  {
-    vkFreeMemory(m_device, m_geoMemAlloc, nullptr);
-    m_geoMemAlloc = VK_NULL_HANDLE;
-  }
+  m_pAllocator->Free(m_geoVertAlloc);
+  m_pAllocator->Free(m_geoIdxAlloc);
+  m_pAllocator->Free(m_geoIdx16Alloc);
+  m_pAllocator->Free(m_geoMemAlloc);
+}
+
+void SceneManager::FreeGPUResource()
+{
+  FreeGeoBuffers();
 
   for (auto& landscape : m_landscapes)
   {
     vkDestroyBuffer(m_device, landscape.tileMinMaxHeights, nullptr);
-    vkFreeMemory(m_device, landscape.allocation, nullptr);
+    m_pAllocator->Free(landscape.allocation);
+    m_pAllocator->UntrackImage(landscape.heightmap.image);
     vk_utils::deleteImg(m_device, &landscape.heightmap);
   }
   m_landscapes.clear();
@@ -453,12 +1930,42 @@ void SceneManager::FreeGPUResource()
 
 void SceneManager::DestroyScene()
 {
+  // stops and joins the decoding thread, drops whatever it produced
+  if (m_pAsyncLoad)
+  {
+    m_pAsyncLoad->onComplete = {};
+    FinishAsyncLoad();
+  }
+
   FreeGPUResource();
 
   m_pCopyHelper = nullptr;
+  m_pStagingRing = nullptr;
 
   m_meshInfos.clear();
+  m_meshBboxes.clear();
+  m_meshSources.clear();
+  m_meshDrawRanks.clear();
+  m_index16Meshes  = 0;
+  m_totalVertices  = 0;
+  m_totalIndices   = 0;
+  m_totalIndices16 = 0;
+  m_vertexHeap  = RangeAllocator{};
+  m_indexHeap   = RangeAllocator{};
+  m_index16Heap = RangeAllocator{};
+  m_meshesByHash.clear();
+  m_dedupStats = {};
+  m_optimizeTotals = {};
+  m_meshByHydraId.clear();
+  m_instanceByHydraId.clear();
   m_pMeshData = nullptr;
+  m_pSceneCache = nullptr;
   m_instanceInfos.clear();
   m_instanceMatrices.clear();
+
+  m_meshCapacity     = 0;
+  m_instanceCapacity = 0;
+  m_vertexCapacity   = 0;
+  m_indexCapacity    = 0;
+  m_index16Capacity  = 0;
 }
\ No newline at end of file
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <span>
+#include <unordered_map>
 #include <vector>
 
 #include <geom/vk_mesh.h>
@@ -7,6 +13,10 @@
 #include <vk_copy.h>
 
 #include "vk_images.h"
+#include "mesh_decode.h"
+#include "gpu_allocator.h"
+#include "range_allocator.h"
+#include "staging_ring.h"
 #include "../loader_utils/hydraxml.h"
 #include "../resources/shaders/common.h"
 
@@ -18,6 +28,14 @@ struct GpuInstanceInfo
   VkBool32 renderMark = false;
 };
 
+// What the GPU keeps of an instance matrix: its top three rows, the last one is always 0 0 0 1.
+// Shaders read it as a mat3x4 m and transform with vec4(p, 1.0f) * m.
+struct GpuInstanceTransform
+{
+  glm::vec4 rows[3];
+};
+static_assert(sizeof(GpuInstanceTransform) == 48);
+
 struct GpuMeshInfo
 {
   uint32_t indexCount;
@@ -25,13 +43,15 @@ struct GpuMeshInfo
   uint32_t vertexOffset;
   glm::vec3 AABB_min{};
   glm::vec3 AABB_max{};
+  // where culling writes this mesh's indirect command, see SceneManager::Index16Draws
+  uint32_t drawSlot = 0;
 };
 
 struct Landscape
 {
   vk_utils::VulkanImageMem heightmap{};
   VkBuffer tileMinMaxHeights;
-  VkDeviceMemory allocation;
+  GpuAllocation allocation;
 };
 
 struct LandscapeGpuInfo
@@ -63,33 +83,174 @@ inline glm::mat4 lmToGlm(const LiteMath::float4x4& lmMat)
   return mat;
 }
 
+class SceneCache;
+
+struct MeshDedupStats
+{
+  uint32_t meshesAdded = 0;
+  uint32_t duplicates  = 0;
+  uint64_t bytesSaved  = 0;
+};
+
+// what the vertex cache optimization did over everything loaded so far
+struct MeshOptimizeTotals
+{
+  uint32_t optimized = 0;
+  uint32_t reused    = 0;
+  uint32_t failed    = 0;
+  // over the meshes optimized during this run, reused ones weren't measured
+  VertexCacheStats before;
+  VertexCacheStats after;
+  double cpuMs = 0.0;
+};
+
+struct SceneChangeStats
+{
+  uint32_t meshesAdded      = 0;
+  uint32_t instancesAdded   = 0;
+  uint32_t instancesPatched = 0;
+  uint32_t instancesHidden  = 0;
+  // the change didn't fit into the reserved mesh or instance slots, so all GPU buffers were recreated
+  // and every handle obtained from the manager before the call is stale. Vertex and index buffers
+  // may be replaced by bigger ones either way, they should be fetched when recording.
+  bool buffersReallocated = false;
+};
+
+// What one SceneManager::RecordInstanceUpdates call copied
+struct InstanceUpdateStats
+{
+  uint32_t instances = 0; // sent, including untouched ones between nearby dirty ones
+  uint32_t regions   = 0; // vkCmdCopyBuffer regions over both instance buffers
+  uint64_t bytes     = 0;
+  // instances past the buffer capacity, they stay CPU only until ReloadGPUData
+  uint32_t pending   = 0;
+};
+
+// Layout of the vertex buffer. Full is Mesh8F (32 bytes), Compact is CompactVertex (16 bytes)
+// and has to be drawn with static_mesh_compact.vert, which needs the instance and mesh infos.
+enum class VertexFormat
+{
+  Full,
+  Compact,
+};
+
+// Filled by LoadSceneXML, times are wall clock unless said otherwise
+struct SceneLoadStats
+{
+  double cacheMs      = 0.0; // opening (and, on a miss, writing) the binary scene cache
+  double xmlParseMs   = 0.0;
+  double meshDecodeMs = 0.0; // mapping meshes on the worker pool and appending them
+  double gpuUploadMs  = 0.0; // allocating the buffers and streaming everything into them
+  double totalMs      = 0.0;
+  // summed over workers, so these can exceed meshDecodeMs
+  double decodeCpuMs  = 0.0;
+  double bboxCpuMs    = 0.0;
+  uint64_t bytesUploaded = 0;
+  uint32_t uploadSubmits = 0;
+  bool fromCache = false;
+};
+
 struct SceneManager
 {
+  // a_allocator is shared with the renderer, a private one is made if none is given
   SceneManager(VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_transferQId, uint32_t a_graphicsQId,
-    bool debug = false);
-  ~SceneManager() { DestroyScene(); }
+    bool debug = false, std::shared_ptr<GpuAllocator> a_allocator = nullptr);
+  ~SceneManager();
 
   bool LoadSceneXML(const std::string &scenePath, bool transpose = true);
+
+  using LoadProgressCallback   = std::function<void(uint32_t loadedMeshes, uint32_t totalMeshes)>;
+  using LoadCompletionCallback = std::function<void()>;
+
+  // Parses the xml and allocates GPU buffers for the whole scene, then returns. Meshes are decoded
+  // on a background thread and become resident (together with their instances) in file order
+  // as UpdateAsyncLoad uploads them. Until then MeshesNum()/InstancesNum() count only what is resident.
+  bool LoadSceneXMLAsync(const std::string &scenePath, bool transpose = true,
+    LoadProgressCallback onProgress = {}, LoadCompletionCallback onComplete = {});
+  // call once per frame from the render thread; returns true if anything new became resident
+  bool UpdateAsyncLoad();
+  bool IsLoading() const { return m_pAsyncLoad != nullptr; }
+
+  // Applies a hydra change_*.xml on top of what is loaded. Meshes it lists are appended (or resolve
+  // to identical resident ones), instances are matched by their hydra id: known ones get matrix and
+  // mesh patched, new ones are appended, and if the scene is marked discard, known instances it
+  // doesn't list are hidden. Only touched ranges are uploaded while everything fits the buffers.
+  SceneChangeStats ApplySceneChange(const std::string &changePath, bool transpose = true);
   void LoadSingleTriangle();
 
+  // Both return the id of an already loaded mesh if the new one is byte-identical to it,
+  // so instances of duplicates end up in the same indirect draw. Once the scene is on the GPU
+  // the new mesh is uploaded right away, like ApplySceneChange this has to happen between frames.
+  // Vertex and index buffers grow by a GPU side copy, only running out of mesh slots recreates
+  // everything, which GpuBuffersGeneration() tells about.
   uint32_t AddMeshFromFile(const std::string& meshPath);
   uint32_t AddMeshFromData(cmesh::SimpleMesh &meshData);
+  // Gives the geometry of a mesh back to the heaps and hides its instances, the id is never reused
+  // and instancing it again is an error. Between frames as well.
+  void RemoveMesh(uint32_t meshId);
+  bool IsMeshRemoved(uint32_t meshId) const { return m_meshInfos[meshId].m_indNum == 0; }
+  // bumped every time all GPU buffers were recreated, anything bound to them has to follow
+  uint32_t GpuBuffersGeneration() const { return m_buffersGeneration; }
+  const MeshDedupStats& GetMeshDedupStats() const { return m_dedupStats; }
+  const MeshOptimizeTotals& GetMeshOptimizeTotals() const { return m_optimizeTotals; }
+  const SceneLoadStats& GetLoadStats() const { return m_loadStats; }
+  // on by default, benchmarks turn it off to measure a cold load every time
+  void SetSceneCacheEnabled(bool enabled) { m_useSceneCache = enabled; }
+  // Reorders triangles and vertices of every mesh added from now on for vertex cache and fetch
+  // locality. Off by default since mesh files get an optimized copy written next to them.
+  void SetMeshOptimization(bool enabled) { m_optimizeMeshes = enabled; }
   void AddLandscape();
 
   uint32_t InstanceMesh(uint32_t meshId, const glm::mat4& matrix, bool markForRender = true);
 
+  // These only change the CPU copies and remember what was touched, RecordInstanceUpdates
+  // sends it to the GPU. Instances added with InstanceMesh are sent by it as well.
+  void SetInstanceMatrix(uint32_t instId, const glm::mat4& matrix);
   void MarkInstance(uint32_t instId);
   void UnmarkInstance(uint32_t instId);
 
+  // Records copies of the instance ranges changed since the last call into a_cmdBuff, with
+  // barriers against the culling and vertex shaders on both sides. Data is staged in slot
+  // a_frame % framesInFlight of a persistently mapped ring, so the command buffer recorded for
+  // a frame has to be finished before the same a_frame comes around again.
+  InstanceUpdateStats RecordInstanceUpdates(VkCommandBuffer a_cmdBuff, uint32_t a_frame);
+  // number of RecordInstanceUpdates slots, the renderer's frames in flight
+  void SetFramesInFlight(uint32_t frames);
+
+  // Streaming uploads (async load, scene changes, meshes added or removed at runtime) go to the
+  // transfer queue and aren't waited for. Records taking their buffer ranges over to the graphics
+  // queue into a_cmdBuff, which should come before anything else touching scene buffers, and
+  // returns the UploadTimeline() value the submission of a_cmdBuff has to wait for
+  // (at VK_PIPELINE_STAGE_ALL_COMMANDS_BIT), 0 if there is nothing to wait for.
+  uint64_t RecordUploadAcquire(VkCommandBuffer a_cmdBuff);
+  VkSemaphore UploadTimeline() const { return m_pStagingRing->Timeline(); }
+
   void DestroyScene();
 
-  VkPipelineVertexInputStateCreateInfo GetPipelineVertexInputStateCreateInfo() { return m_pMeshData->VertexInputLayout();}
+  // only before anything is loaded, the CPU side always keeps Mesh8F and converts on upload
+  bool SetVertexFormat(VertexFormat format);
+  VertexFormat GetVertexFormat() const { return m_vertexFormat; }
+  VkPipelineVertexInputStateCreateInfo GetPipelineVertexInputStateCreateInfo();
 
   VkBuffer GetVertexBuffer() const { return m_geoVertBuf; }
   VkBuffer GetIndexBuffer()  const { return m_geoIdxBuf; }
+  VkBuffer GetIndex16Buffer() const { return m_geoIdx16Buf; }
+
+  // Meshes with at most 65536 vertices keep their indices in GetIndex16Buffer as uint16, the rest
+  // in GetIndexBuffer as uint32. Each class gets its own range of indirect draw slots: 16 bit ones
+  // start at 0, 32 bit ones at MeshesCapacity(), so the indirect buffer needs DrawSlotsCapacity() commands.
+  struct DrawRange
+  {
+    uint32_t first;
+    uint32_t count;
+  };
+  DrawRange Index16Draws() const { return { 0, m_index16Meshes }; }
+  DrawRange Index32Draws() const { return { MeshesCapacity(), MeshesNum() - m_index16Meshes }; }
+  uint32_t DrawSlotsCapacity() const { return 2 * MeshesCapacity(); }
   VkBuffer GetModelInfosBuffer() const { return m_meshInfoBuf; }
   
   VkBuffer GetInstanceInfosBuffer()  const { return m_instanceInfosBuffer; }
+  // GpuInstanceTransform per instance
   VkBuffer GetInstanceMatricesBuffer() const { return m_instanceMatricesBuffer; }
 
   VkBuffer GetLightsBuffer() const { return m_lightsBuffer; }
@@ -119,6 +280,17 @@ struct SceneManager
     return result;
   }
 
+  std::vector<glm::uvec2> LandscapeTileGrids() const
+  {
+    std::vector<glm::uvec2> result;
+    result.reserve(m_landscapeInfos.size());
+    for (auto& landscape : m_landscapeInfos)
+    {
+      result.emplace_back(landscape.width/landscape.tileSize, landscape.height/landscape.tileSize);
+    }
+    return result;
+  }
+
   std::vector<VkBuffer> GetLandscapeMinMaxHeights() const
   {
     std::vector<VkBuffer> result;
@@ -132,6 +304,11 @@ struct SceneManager
 
   VkBuffer GetLandscapeInfos() const { return m_landscapeGpuInfos; }
 
+  // what CpuFrustumCuller reads
+  std::span<const GpuInstanceInfo> GetInstanceInfos() const { return m_instanceInfos; }
+  std::span<const glm::mat4> GetInstanceMatrices() const { return m_instanceMatrices; }
+  std::span<const LiteMath::Box4f> GetMeshBboxes() const { return m_meshBboxes; }
+
   // Debug stuff
   GpuInstanceInfo GetInstanceInfo(std::size_t i) const { return m_instanceInfos[i]; }
   glm::mat4 GetInstanceMatrix(std::size_t i) const { return m_instanceMatrices[i]; }
@@ -142,6 +319,9 @@ struct SceneManager
 
   uint32_t MeshesNum() const {return (uint32_t)m_meshInfos.size();}
   uint32_t InstancesNum() const {return (uint32_t)m_instanceInfos.size();}
+  // what GPU buffers are sized for, may be ahead of the above during an async load or after ApplySceneChange
+  uint32_t MeshesCapacity() const {return std::max(MeshesNum(), m_meshCapacity);}
+  uint32_t InstancesCapacity() const {return std::max(InstancesNum(), m_instanceCapacity);}
 
   hydra_xml::Camera GetCamera(uint32_t camId) const;
   MeshInfo GetMeshInfo(uint32_t meshId) const {assert(meshId < m_meshInfos.size()); return m_meshInfos[meshId];}
@@ -152,16 +332,119 @@ struct SceneManager
   void ReloadGPUData();
 
 private:
+  struct AsyncLoad;
+
+  uint32_t AppendMesh(const cmesh::SimpleMesh &meshData, const LiteMath::Box4f &bbox, uint64_t hash);
+  uint32_t AppendMesh(const MappedMesh &mesh);
+  // meshData is the new mesh when it isn't a mapped file
+  uint32_t FindDuplicateMesh(uint64_t hash, uint32_t vertNum, uint32_t indNum, const VsgfView* file,
+    const cmesh::SimpleMesh* meshData);
+  // Mesh8F vertices and 32 bit indices of a mesh, scratch holds the vertices
+  // when they have to be encoded from a mapped file
+  struct MeshBytes
+  {
+    std::span<const std::byte> vertices;
+    std::span<const std::byte> indices;
+  };
+  MeshBytes MeshGeometryBytes(uint32_t meshId, std::vector<float>& scratch);
+  void LogMeshDedupStats() const;
+  void AccountMeshOptimize(const MeshOptimizeStats &stats, const std::string &meshPath);
+  void LogMeshOptimizeStats() const;
+  uint32_t AppendMeshInfo(uint32_t vertNum, uint32_t indNum, const LiteMath::Box4f &bbox);
+  // takes the mesh's ranges from the geometry heaps and gives it the next draw rank of its index class
+  void PlaceMeshGeometry(MeshInfo &info);
+  uint32_t AllocateGeometry(RangeAllocator &heap, uint32_t size);
+  // after the heaps grew past the buffers, moves what's there into bigger ones
+  void GrowGeometryBuffers();
+  void GrowGeometryBuffer(VkBuffer &buffer, GpuAllocation &allocation, uint32_t &capacity, const RangeAllocator &heap,
+    VkDeviceSize elementSize, VkBufferUsageFlags usage);
+  // uploads meshes from firstMesh on that were added after the scene went to the GPU
+  void UploadAddedMeshes(uint32_t firstMesh);
+  // maps files[meshIds.size()..] on a worker pool and appends them in file order
+  void AppendMeshFiles(const std::vector<std::string> &files, std::vector<uint32_t> &meshIds);
+  // single pass over the xml without a DOM, meshes are appended and instanced as they come
+  void StreamSceneXML(const std::string &scenePath, bool transpose, std::vector<std::string> &meshFiles);
+  // one streaming pass that gathers mesh files and instances for an async load, cameras and lights go in right away
+  void CollectSceneXML(const std::string &scenePath, AsyncLoad &load);
+  // appends the async load's next mesh file with its instances
+  void AddSceneMesh(AsyncLoad &load, MappedMesh &mesh);
+  GpuMeshInfo MakeGpuMeshInfo(std::size_t meshId) const;
+  // the Upload* functions only stage into m_pStagingRing, callers Flush once they're done
+  void UploadResidentRange(uint32_t firstMesh, uint32_t firstInstance);
+  void UploadMeshGeometry(uint32_t firstMesh);
+  void UploadInstanceRanges(std::vector<uint32_t> &instances);
+
+  enum InstanceDirtyBits : uint8_t
+  {
+    INSTANCE_MATRIX_DIRTY = 1,
+    INSTANCE_INFO_DIRTY   = 2,
+  };
+  void MarkInstanceDirty(uint32_t instId, uint8_t bits);
+  void FreeInstanceUpdateRing();
+  void FinishAsyncLoad();
+
+  // nullptr unless the scene has a valid cache and nothing is loaded yet
+  std::unique_ptr<SceneCache> OpenSceneCache(const std::string &scenePath, bool transpose) const;
+  // cache is what OpenSceneCache returned, start is when the load began
+  bool LoadSceneXML(const std::string &scenePath, bool transpose, std::unique_ptr<SceneCache> cache,
+    std::chrono::steady_clock::time_point start);
+  void LoadFromSceneCache(std::unique_ptr<SceneCache> cache);
+  void WriteSceneCache(const std::string& cachePath, bool transpose, const std::vector<std::string>& sourceFiles,
+    std::size_t firstCamera, std::size_t firstLight);
+
+  // vertex stride in m_geoVertBuf, sources stay in Mesh8F layout
+  std::size_t GpuVertexSize() const;
+
   void LoadGeoDataOnGPU();
+  void FreeGeoBuffers();
   void FreeGPUResource();
 
+  // Where the geometry of a mesh lives on the CPU side: either a mapped VSGF file, which is
+  // encoded straight into staging memory, or a range of m_pMeshData. Empty for cached meshes.
+  struct MeshSource
+  {
+    std::shared_ptr<const VsgfView> file;
+    std::size_t vertexDataOffset = 0;
+    std::size_t indexDataOffset  = 0;
+  };
+
   std::vector<MeshInfo> m_meshInfos = {};
   std::vector<LiteMath::Box4f> m_meshBboxes = {};
+  std::vector<MeshSource> m_meshSources = {};
+  std::unordered_multimap<uint64_t, uint32_t> m_meshesByHash;
+  MeshDedupStats m_dedupStats;
+  bool m_optimizeMeshes = false;
+  MeshOptimizeTotals m_optimizeTotals;
   std::shared_ptr<IMeshData> m_pMeshData = nullptr;
+  VertexFormat m_vertexFormat = VertexFormat::Full;
+  VkVertexInputBindingDescription m_compactBinding{};
+  std::array<VkVertexInputAttributeDescription, 3> m_compactAttributes{};
+  // when the scene came from a binary cache, its vertex/index streams stay mapped
+  // and go in front of whatever m_pMeshData holds
+  std::unique_ptr<SceneCache> m_pSceneCache;
+  bool m_useSceneCache = true;
+  SceneLoadStats m_loadStats;
 
   std::vector<GpuInstanceInfo> m_instanceInfos = {};
   std::vector<glm::mat4> m_instanceMatrices = {};
 
+  // instances [0, m_gpuInstances) are in the GPU buffers, of those the ones in
+  // m_dirtyInstances have InstanceDirtyBits set in m_instanceDirty and wait for RecordInstanceUpdates
+  uint32_t m_gpuInstances = 0u;
+  std::vector<uint8_t> m_instanceDirty;
+  std::vector<uint32_t> m_dirtyInstances;
+  bool m_instanceOverflowWarned = false;
+
+  // host visible, m_framesInFlight slots each big enough for every instance
+  uint32_t m_framesInFlight = 2u;
+  VkBuffer m_instanceUpdateBuf = VK_NULL_HANDLE;
+  GpuAllocation m_instanceUpdateAlloc;
+  VkDeviceSize m_instanceUpdateSlotSize = 0;
+
+  // hydra "id" attributes of what was loaded, change files refer to meshes and instances by them
+  std::unordered_map<uint32_t, uint32_t> m_meshByHydraId;
+  std::unordered_map<uint32_t, uint32_t> m_instanceByHydraId;
+
   std::vector<hydra_xml::Camera> m_sceneCameras = {};
   std::vector<hydra_xml::LightInstance> m_sceneLights = {};
   LiteMath::Box4f sceneBbox;
@@ -170,11 +453,34 @@ private:
   std::vector<LandscapeGpuInfo> m_landscapeInfos;
   VkBuffer m_landscapeGpuInfos = VK_NULL_HANDLE;
 
+  // of the meshes that weren't removed
   uint32_t m_totalVertices = 0u;
   uint32_t m_totalIndices  = 0u;
+  uint32_t m_totalIndices16 = 0u;
+
+  // where each mesh lives in m_geoVertBuf, m_geoIdxBuf and m_geoIdx16Buf, in elements.
+  // Their capacity runs ahead of the buffers' between adding meshes and GrowGeometryBuffers.
+  RangeAllocator m_vertexHeap;
+  RangeAllocator m_indexHeap;
+  RangeAllocator m_index16Heap;
+
+  // position of each mesh among the meshes of its index class
+  std::vector<uint32_t> m_meshDrawRanks;
+  uint32_t m_index16Meshes = 0u;
+
+  // what the GPU buffers can hold, ahead of the data during LoadSceneXMLAsync
+  // and with some headroom after a change or a runtime addition had to grow them
+  uint32_t m_meshCapacity     = 0u;
+  uint32_t m_instanceCapacity = 0u;
+  uint32_t m_vertexCapacity   = 0u;
+  uint32_t m_indexCapacity    = 0u;
+  uint32_t m_index16Capacity  = 0u;
+
+  std::unique_ptr<AsyncLoad> m_pAsyncLoad;
 
   VkBuffer m_geoVertBuf = VK_NULL_HANDLE;
   VkBuffer m_geoIdxBuf  = VK_NULL_HANDLE;
+  VkBuffer m_geoIdx16Buf = VK_NULL_HANDLE;
   VkBuffer m_meshInfoBuf  = VK_NULL_HANDLE;
 
   VkBuffer m_instanceInfosBuffer = VK_NULL_HANDLE;
@@ -182,7 +488,12 @@ private:
 
   VkBuffer m_lightsBuffer = VK_NULL_HANDLE;
 
-  VkDeviceMemory m_geoMemAlloc = VK_NULL_HANDLE;
+  // geometry buffers are allocated on their own, so that each can be grown
+  GpuAllocation m_geoVertAlloc;
+  GpuAllocation m_geoIdxAlloc;
+  GpuAllocation m_geoIdx16Alloc;
+  GpuAllocation m_geoMemAlloc;
+  uint32_t m_buffersGeneration = 0u;
 
   VkDevice m_device = VK_NULL_HANDLE;
   VkPhysicalDevice m_physDevice = VK_NULL_HANDLE;
@@ -191,7 +502,11 @@ private:
 
   uint32_t m_graphicsQId = UINT32_MAX;
   VkQueue m_graphicsQ = VK_NULL_HANDLE;
+  std::shared_ptr<GpuAllocator> m_pAllocator;
   std::shared_ptr<vk_utils::ICopyEngine> m_pCopyHelper;
+  std::unique_ptr<StagingRing> m_pStagingRing;
+  // one-off graphics queue work, like copying geometry into grown buffers
+  VkCommandPool m_graphicsCmdPool = VK_NULL_HANDLE;
 
   // for debugging
   struct Vertex
@@ -0,0 +1,216 @@
+#include "staging_ring.h"
+
+#include <cassert>
+
+#include "vk_utils.h"
+#include "vk_buffers.h"
+
+
+StagingRing::StagingRing(GpuAllocator& a_allocator, VkDevice a_device, VkQueue a_queue, uint32_t a_queueFamily,
+  uint32_t a_ownerFamily, VkDeviceSize a_size)
+  : m_allocator(a_allocator)
+  , m_device(a_device)
+  , m_queue(a_queue)
+  , m_queueFamily(a_queueFamily)
+  , m_ownerFamily(a_ownerFamily)
+  , m_halfSize(a_size / 2)
+{
+  m_buffer = vk_utils::createBuffer(m_device, m_halfSize * 2, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+  m_memory = m_allocator.AllocateAndBind({ m_buffer },
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  m_mapped = m_allocator.Info(m_memory).mapped;
+
+  m_cmdPool = vk_utils::createCommandPool(m_device, a_queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  auto cmdBufs = vk_utils::createCommandBuffers(m_device, m_cmdPool, static_cast<uint32_t>(m_halves.size()));
+
+  for (std::size_t i = 0; i < m_halves.size(); ++i)
+  {
+    m_halves[i].cmdBuf = cmdBufs[i];
+  }
+
+  VkSemaphoreTypeCreateInfo timelineInfo{
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+    .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo semaphoreInfo{
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    .pNext = &timelineInfo,
+  };
+  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_timeline));
+}
+
+StagingRing::~StagingRing()
+{
+  Flush();
+
+  vkDestroySemaphore(m_device, m_timeline, nullptr);
+  vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+
+  vkDestroyBuffer(m_device, m_buffer, nullptr);
+  m_allocator.Free(m_memory);
+}
+
+std::byte* StagingRing::Reserve(VkBuffer a_dst, VkDeviceSize a_dstOffset, VkDeviceSize a_size)
+{
+  assert(a_size <= m_halfSize);
+
+  if (m_halves[m_current].used + a_size > m_halfSize)
+  {
+    // the other half was submitted before this one was started, so it has had the whole fill to finish
+    Submit(m_halves[m_current]);
+    m_current = (m_current + 1) % m_halves.size();
+    Wait(m_halves[m_current]);
+  }
+
+  auto& half = m_halves[m_current];
+  const VkDeviceSize srcOffset = m_current * m_halfSize + half.used;
+
+  // neighbouring chunks of one stream end up as a single region
+  auto& copies = half.copies;
+  if (!copies.empty() && copies.back().dst == a_dst
+    && copies.back().region.srcOffset + copies.back().region.size == srcOffset
+    && copies.back().region.dstOffset + copies.back().region.size == a_dstOffset)
+  {
+    copies.back().region.size += a_size;
+  }
+  else
+  {
+    copies.push_back(Copy{ a_dst, VkBufferCopy{ srcOffset, a_dstOffset, a_size } });
+  }
+
+  // keep every reservation 16 byte aligned for whoever fills it
+  half.used = (half.used + a_size + 15) / 16 * 16;
+  m_bytesUploaded += a_size;
+
+  return m_mapped + srcOffset;
+}
+
+uint64_t StagingRing::SubmitAsync()
+{
+  if (m_halves[m_current].copies.empty())
+    return m_lastSubmitted;
+
+  Submit(m_halves[m_current]);
+  m_current = (m_current + 1) % m_halves.size();
+  Wait(m_halves[m_current]);
+  return m_lastSubmitted;
+}
+
+void StagingRing::Flush()
+{
+  Submit(m_halves[m_current]);
+  for (auto& half : m_halves)
+  {
+    Wait(half);
+  }
+}
+
+uint64_t StagingRing::RecordAcquire(VkCommandBuffer a_cmdBuf, VkPipelineStageFlags a_dstStages, VkAccessFlags a_dstAccess)
+{
+  if (m_lastAcquired == m_lastSubmitted)
+    return 0;
+
+  if (!m_released.empty())
+  {
+    std::vector<VkBufferMemoryBarrier> acquires;
+    acquires.reserve(m_released.size());
+    for (const auto& copy : m_released)
+      acquires.push_back(OwnershipBarrier(copy, 0, a_dstAccess));
+    vkCmdPipelineBarrier(a_cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, a_dstStages, 0,
+      0, nullptr, static_cast<uint32_t>(acquires.size()), acquires.data(), 0, nullptr);
+    m_released.clear();
+  }
+
+  m_lastAcquired = m_lastSubmitted;
+  return m_lastSubmitted;
+}
+
+void StagingRing::Forget(VkBuffer a_dst)
+{
+  std::erase_if(m_released, [a_dst](const Copy& copy) { return copy.dst == a_dst; });
+}
+
+VkBufferMemoryBarrier StagingRing::OwnershipBarrier(const Copy& a_copy, VkAccessFlags a_srcAccess,
+  VkAccessFlags a_dstAccess) const
+{
+  return VkBufferMemoryBarrier{
+    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    .srcAccessMask = a_srcAccess,
+    .dstAccessMask = a_dstAccess,
+    .srcQueueFamilyIndex = m_queueFamily,
+    .dstQueueFamilyIndex = m_ownerFamily,
+    .buffer = a_copy.dst,
+    .offset = a_copy.region.dstOffset,
+    .size = a_copy.region.size,
+  };
+}
+
+void StagingRing::Submit(Half& half)
+{
+  if (half.copies.empty())
+    return;
+
+  VkCommandBufferBeginInfo beginInfo{
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  VK_CHECK_RESULT(vkBeginCommandBuffer(half.cmdBuf, &beginInfo));
+  for (std::size_t i = 0; i < half.copies.size(); )
+  {
+    // one call per destination buffer
+    std::vector<VkBufferCopy> regions;
+    const VkBuffer dst = half.copies[i].dst;
+    for (; i < half.copies.size() && half.copies[i].dst == dst; ++i)
+      regions.push_back(half.copies[i].region);
+    vkCmdCopyBuffer(half.cmdBuf, m_buffer, dst, static_cast<uint32_t>(regions.size()), regions.data());
+  }
+
+  // exclusive buffers have to be handed over to the family that reads them
+  if (m_ownerFamily != m_queueFamily)
+  {
+    std::vector<VkBufferMemoryBarrier> releases;
+    releases.reserve(half.copies.size());
+    for (const auto& copy : half.copies)
+      releases.push_back(OwnershipBarrier(copy, VK_ACCESS_TRANSFER_WRITE_BIT, 0));
+    vkCmdPipelineBarrier(half.cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+      0, nullptr, static_cast<uint32_t>(releases.size()), releases.data(), 0, nullptr);
+    m_released.insert(m_released.end(), half.copies.begin(), half.copies.end());
+  }
+  VK_CHECK_RESULT(vkEndCommandBuffer(half.cmdBuf));
+
+  half.submitted = ++m_lastSubmitted;
+  VkTimelineSemaphoreSubmitInfo timelineInfo{
+    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+    .signalSemaphoreValueCount = 1,
+    .pSignalSemaphoreValues = &half.submitted,
+  };
+  VkSubmitInfo submitInfo{
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .pNext = &timelineInfo,
+    .commandBufferCount = 1,
+    .pCommandBuffers = &half.cmdBuf,
+    .signalSemaphoreCount = 1,
+    .pSignalSemaphores = &m_timeline,
+  };
+  VK_CHECK_RESULT(vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+  half.copies.clear();
+  ++m_submits;
+}
+
+void StagingRing::Wait(Half& half)
+{
+  if (half.submitted != 0)
+  {
+    VkSemaphoreWaitInfo waitInfo{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+      .semaphoreCount = 1,
+      .pSemaphores = &m_timeline,
+      .pValues = &half.submitted,
+    };
+    VK_CHECK_RESULT(vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX));
+    half.submitted = 0;
+  }
+  half.used = 0;
+}
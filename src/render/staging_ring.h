@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "gpu_allocator.h"
+
+
+// Persistently mapped upload buffer split in two halves: while the queue copies one
+// half into device buffers, the other one is being filled. Unlike ICopyEngine::UpdateBuffer
+// callers get a pointer into the mapped memory and write (or convert) data there directly,
+// so nothing has to be gathered into an intermediate CPU copy first.
+// Submissions signal a timeline semaphore. If the destination buffers are used on another queue
+// family, every copied range is released to it and has to be taken over with RecordAcquire.
+class StagingRing
+{
+public:
+  // a_ownerFamily is the queue family the destination buffers are used on
+  StagingRing(GpuAllocator& a_allocator, VkDevice a_device, VkQueue a_queue, uint32_t a_queueFamily,
+    uint32_t a_ownerFamily, VkDeviceSize a_size);
+  ~StagingRing();
+
+  StagingRing(const StagingRing&) = delete;
+  StagingRing& operator=(const StagingRing&) = delete;
+
+  VkDeviceSize MaxReservation() const { return m_halfSize; }
+
+  // Returns a_size bytes (at most MaxReservation()) of mapped memory that will be copied
+  // to a_dst at a_dstOffset. Has to be filled before the next Reserve or Flush call.
+  std::byte* Reserve(VkBuffer a_dst, VkDeviceSize a_dstOffset, VkDeviceSize a_size);
+
+  // Uploads a_count elements in as few reservations as possible,
+  // fill(firstElement, elementCount, dst) writes each chunk.
+  template<typename F>
+  void Upload(VkBuffer a_dst, VkDeviceSize a_dstOffset, std::size_t a_count, std::size_t a_elementSize, F&& fill)
+  {
+    const std::size_t chunk = m_halfSize / a_elementSize;
+    for (std::size_t first = 0; first < a_count; first += chunk)
+    {
+      const std::size_t count = std::min(chunk, a_count - first);
+      fill(first, count, Reserve(a_dst, a_dstOffset + first * a_elementSize, count * a_elementSize));
+    }
+  }
+
+  // plain copy of a_size bytes that are already laid out the way a_dst expects
+  void UploadData(VkBuffer a_dst, VkDeviceSize a_dstOffset, const void* a_data, VkDeviceSize a_size)
+  {
+    const auto* src = static_cast<const std::byte*>(a_data);
+    Upload(a_dst, a_dstOffset, a_size, 1, [src](std::size_t first, std::size_t count, std::byte* dst) {
+      std::memcpy(dst, src + first, count);
+    });
+  }
+
+  // Submits everything reserved so far without waiting for it, returns the timeline value
+  // signalled once it landed. Only blocks if the other half is still being copied.
+  uint64_t SubmitAsync();
+  // submits everything reserved so far and waits for it to land
+  void Flush();
+
+  // Records into a_cmdBuf, which goes to the owner family, the acquire half of the ownership
+  // transfers submitted since the last call. Returns the Timeline() value that submission has to
+  // wait for, 0 if nothing was submitted since. With a single family only the wait is needed.
+  uint64_t RecordAcquire(VkCommandBuffer a_cmdBuf, VkPipelineStageFlags a_dstStages, VkAccessFlags a_dstAccess);
+  // a_dst is about to be destroyed, drops its pending acquires
+  void Forget(VkBuffer a_dst);
+  VkSemaphore Timeline() const { return m_timeline; }
+
+  VkDeviceSize BytesUploaded() const { return m_bytesUploaded; }
+  // number of queue submissions so far, a batch that fits into one half takes a single one
+  uint32_t Submits() const { return m_submits; }
+
+private:
+  struct Copy
+  {
+    VkBuffer dst;
+    VkBufferCopy region;
+  };
+
+  struct Half
+  {
+    VkCommandBuffer cmdBuf = VK_NULL_HANDLE;
+    // timeline value of the last submission, the half is free once the semaphore reaches it
+    uint64_t submitted = 0;
+    VkDeviceSize used = 0;
+    std::vector<Copy> copies;
+  };
+
+  void Submit(Half& half);
+  void Wait(Half& half);
+  VkBufferMemoryBarrier OwnershipBarrier(const Copy& a_copy, VkAccessFlags a_srcAccess, VkAccessFlags a_dstAccess) const;
+
+  GpuAllocator& m_allocator;
+  VkDevice m_device = VK_NULL_HANDLE;
+  VkQueue m_queue = VK_NULL_HANDLE;
+  uint32_t m_queueFamily = 0;
+  uint32_t m_ownerFamily = 0;
+
+  VkSemaphore m_timeline = VK_NULL_HANDLE;
+  uint64_t m_lastSubmitted = 0;
+  uint64_t m_lastAcquired  = 0;
+  // released by the ring's queue, not acquired by the owner yet
+  std::vector<Copy> m_released;
+
+  VkBuffer m_buffer = VK_NULL_HANDLE;
+  GpuAllocation m_memory;
+  std::byte* m_mapped = nullptr;
+  VkDeviceSize m_halfSize = 0;
+
+  VkCommandPool m_cmdPool = VK_NULL_HANDLE;
+  std::array<Half, 2> m_halves;
+  uint32_t m_current = 0;
+
+  VkDeviceSize m_bytesUploaded = 0;
+  uint32_t m_submits = 0;
+};
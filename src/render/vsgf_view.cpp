@@ -0,0 +1,125 @@
+#include "vsgf_view.h"
+
+#include <cstring>
+
+
+namespace
+{
+  struct VsgfHeader
+  {
+    uint64_t fileSizeInBytes;
+    uint32_t verticesNum;
+    uint32_t indicesNum;
+    uint32_t materialsNum;
+    uint32_t flags;
+  };
+
+  // must match DecodeNormal in unpack_attributes.h
+  uint32_t encodeNormal(const float* n)
+  {
+    const int x = static_cast<int>(n[0] * 32767.0f);
+    const int y = static_cast<int>(n[1] * 32767.0f);
+
+    const uint32_t sign = (n[2] >= 0) ? 0u : 1u;
+    const uint32_t sx   = (static_cast<uint32_t>(x & 0xfffe) | sign);
+    const uint32_t sy   = (static_cast<uint32_t>(y & 0xffff) << 16);
+
+    return sx | sy;
+  }
+
+  float asFloat(uint32_t bits)
+  {
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+  }
+}
+
+VsgfView::VsgfView(const std::string& path)
+  : m_file(path)
+{
+  if (!m_file.IsOpen() || m_file.Size() < sizeof(VsgfHeader))
+    return;
+
+  VsgfHeader header;
+  std::memcpy(&header, m_file.Data(), sizeof(header));
+
+  const std::size_t vertices = header.verticesNum;
+  const std::size_t indices  = header.indicesNum;
+  const bool hasNormals  = (header.flags & HAS_NO_NORMALS) == 0;
+  const bool hasTangents = (header.flags & HAS_TANGENT) != 0;
+
+  // same order cmesh::LoadMeshFromVSGF reads them in, material indices aren't needed
+  const std::size_t positionsAt = sizeof(VsgfHeader);
+  const std::size_t normalsAt   = positionsAt + vertices * 4 * sizeof(float);
+  const std::size_t tangentsAt  = normalsAt + (hasNormals ? vertices * 4 * sizeof(float) : 0);
+  const std::size_t texCoordsAt = tangentsAt + (hasTangents ? vertices * 4 * sizeof(float) : 0);
+  const std::size_t indicesAt   = texCoordsAt + vertices * 2 * sizeof(float);
+  const std::size_t end         = indicesAt + indices * sizeof(uint32_t);
+
+  if (vertices == 0 || end > m_file.Size())
+  {
+    m_file.Close();
+    return;
+  }
+
+  auto floats = [this](std::size_t at, std::size_t count) {
+    return std::span(reinterpret_cast<const float*>(m_file.Data() + at), count);
+  };
+
+  m_positions = floats(positionsAt, vertices * 4);
+  if (hasNormals)
+    m_normals = floats(normalsAt, vertices * 4);
+  if (hasTangents)
+    m_tangents = floats(tangentsAt, vertices * 4);
+  m_texCoords = floats(texCoordsAt, vertices * 2);
+  m_indices   = std::span(reinterpret_cast<const uint32_t*>(m_file.Data() + indicesAt), indices);
+
+  const std::size_t materialIdsEnd = end + indices / 3 * sizeof(uint32_t);
+  if (materialIdsEnd <= m_file.Size())
+    m_materialIds = std::span(reinterpret_cast<const uint32_t*>(m_file.Data() + end), indices / 3);
+}
+
+LiteMath::Box4f VsgfView::ComputeBbox() const
+{
+  LiteMath::Box4f meshBox;
+  const auto* positions = reinterpret_cast<const LiteMath::float4*>(m_positions.data());
+  for (std::size_t i = 0; i < VerticesNum(); ++i)
+  {
+    meshBox.include(positions[i]);
+  }
+  return meshBox;
+}
+
+void VsgfView::EncodeVertices8F(uint32_t first, uint32_t count, float* dst) const
+{
+  // missing normals/tangents are zero in cmesh, which packs to 0 as well
+  const float zero[4] = {};
+  for (uint32_t i = first; i < first + count; ++i, dst += 8)
+  {
+    const float* pos  = &m_positions[i * 4];
+    const float* norm = m_normals.empty() ? zero : &m_normals[i * 4];
+    const float* tang = m_tangents.empty() ? zero : &m_tangents[i * 4];
+    const float* uv   = &m_texCoords[i * 2];
+
+    dst[0] = pos[0];
+    dst[1] = pos[1];
+    dst[2] = pos[2];
+    dst[3] = asFloat(encodeNormal(norm));
+    dst[4] = uv[0];
+    dst[5] = uv[1];
+    dst[6] = asFloat(encodeNormal(tang));
+    dst[7] = 0.0f;
+  }
+}
+
+void VsgfView::EncodeVerticesCompact(uint32_t first, uint32_t count, const LiteMath::Box4f& bbox, CompactVertex* dst) const
+{
+  const float zero[4] = {};
+  for (uint32_t i = first; i < first + count; ++i, ++dst)
+  {
+    const float* norm = m_normals.empty() ? zero : &m_normals[i * 4];
+    const float* tang = m_tangents.empty() ? zero : &m_tangents[i * 4];
+    *dst = packCompactVertex(&m_positions[i * 4], norm, tang, &m_texCoords[i * 2], bbox);
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "compact_vertex.h"
+#include "../loader_utils/LiteMath.h"
+#include "../utils/mapped_file.h"
+
+
+// Read-only view of a VSGF mesh file. Unlike cmesh::LoadMeshFromVSGF nothing is
+// read up front: the file is mapped and the streams point straight into the mapping,
+// so vertices can be converted directly into wherever they have to end up.
+class VsgfView
+{
+public:
+  // same values as cmesh uses
+  enum Flags : uint32_t
+  {
+    HAS_TANGENT    = 1,
+    HAS_NO_NORMALS = 8,
+  };
+
+  VsgfView() = default;
+  // stays closed if the file is missing, truncated or has no vertices
+  explicit VsgfView(const std::string& path);
+
+  bool IsOpen() const { return !m_positions.empty(); }
+
+  uint32_t VerticesNum() const { return static_cast<uint32_t>(m_positions.size() / 4); }
+  uint32_t IndicesNum()  const { return static_cast<uint32_t>(m_indices.size()); }
+
+  // 4 floats per vertex, normals and tangents are empty when the file doesn't have them
+  std::span<const float> Positions() const { return m_positions; }
+  std::span<const float> Normals()   const { return m_normals; }
+  std::span<const float> Tangents()  const { return m_tangents; }
+  std::span<const float> TexCoords() const { return m_texCoords; }
+  std::span<const uint32_t> Indices() const { return m_indices; }
+  // one per triangle, empty if the file stops right after the indices
+  std::span<const uint32_t> MaterialIds() const { return m_materialIds; }
+
+  // the whole file, all of the spans above point into it
+  std::span<const std::byte> Bytes() const { return { m_file.Data(), m_file.Size() }; }
+
+  LiteMath::Box4f ComputeBbox() const;
+
+  // Writes vertices [first, first + count) the way Mesh8F::Append lays them out:
+  // position + packed normal, texcoord + packed tangent + 0. dst must hold 8 * count floats.
+  void EncodeVertices8F(uint32_t first, uint32_t count, float* dst) const;
+
+  // Same vertices in the compact format, positions are quantized relative to bbox
+  // (normally ComputeBbox() of this file).
+  void EncodeVerticesCompact(uint32_t first, uint32_t count, const LiteMath::Box4f& bbox, CompactVertex* dst) const;
+
+private:
+  MappedFile m_file;
+
+  std::span<const float> m_positions;
+  std::span<const float> m_normals;
+  std::span<const float> m_tangents;
+  std::span<const float> m_texCoords;
+  std::span<const uint32_t> m_indices;
+  std::span<const uint32_t> m_materialIds;
+};
@@ -23,7 +23,7 @@ void initVulkanGLFW(IRender& app, GLFWwindow* window, int deviceID)
   }
 }
 
-int main()
+int main(int argc, char** argv)
 {
   constexpr int WIDTH = 1024;
   constexpr int HEIGHT = 1024;
@@ -31,7 +31,16 @@ int main()
 
 
   SimpleRender app(WIDTH, HEIGHT);
-  
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::string(argv[i]) == "--compact-vertices")
+      app.SetCompactVertices(true);
+    else if (std::string(argv[i]) == "--optimize-meshes")
+      app.SetOptimizeMeshes(true);
+    else if (std::string(argv[i]) == "--change" && i + 1 < argc)
+      app.QueueSceneChange(argv[++i]);
+  }
+
 
   auto* window = initWindow(WIDTH, HEIGHT);
 
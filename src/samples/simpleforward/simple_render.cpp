@@ -1,5 +1,8 @@
 #include "simple_render.h"
 
+#include <algorithm>
+#include <bit>
+#include <fstream>
 #include <random>
 #include <tuple>
 #include <span>
@@ -112,8 +115,15 @@ void SimpleRender::SetupDeviceFeatures()
   m_enabledDeviceFeatures.tessellationShader = true;
 
   
+  // scene uploads run on the transfer queue and are waited for on the GPU
+  m_enabledTimelineSemaphoreFeatures = VkPhysicalDeviceTimelineSemaphoreFeatures{
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+    .timelineSemaphore = true,
+  };
+
   m_enabledDeviceDescriptorIndexingFeatures = VkPhysicalDeviceDescriptorIndexingFeatures{
     .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+    .pNext = &m_enabledTimelineSemaphoreFeatures,
     .descriptorBindingPartiallyBound = true,
     .runtimeDescriptorArray = true,
   };
@@ -125,6 +135,7 @@ void SimpleRender::SetupDeviceExtensions()
   m_deviceExtensions.emplace_back(VK_KHR_SHADER_NON_SEMANTIC_INFO_EXTENSION_NAME);
   m_deviceExtensions.emplace_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
   m_optionalDeviceExtensions.emplace_back(VK_EXT_DEBUG_MARKER_EXTENSION_NAME);
+  m_optionalDeviceExtensions.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 }
 
 void SimpleRender::SetupValidationLayers()
@@ -175,9 +186,17 @@ void SimpleRender::InitVulkan(const char** a_instanceExtensions, uint32_t a_inst
   m_noiseSampler = vk_utils::createSampler(
     m_device, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_REPEAT,
     VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK);
+  m_depthPyramidSampler = vk_utils::createSampler(
+    m_device, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK);
+
+  m_pAllocator = std::make_shared<GpuAllocator>(m_device, m_physicalDevice);
+  m_pAllocator->EnableMemoryBudget(m_memoryBudgetEnabled);
+  m_renderTargetPool = m_pAllocator->CreateLinearPool(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
   m_pScnMgr = std::make_unique<SceneManager>(m_device, m_physicalDevice, m_queueFamilyIDXs.transfer,
-                                             m_queueFamilyIDXs.graphics, false);
+                                             m_queueFamilyIDXs.graphics, false, m_pAllocator);
+  m_pScnMgr->SetFramesInFlight(m_framesInFlight);
 
   m_pScnMgr->AddLandscape();
 
@@ -197,6 +216,7 @@ void SimpleRender::InitPresentation(VkSurfaceKHR &a_surface)
   VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished))
 
   CreateGBuffer();
+  CreateDepthPyramid();
   CreatePostFx();
   CreateShadowmaps();
   CreateTransparent();
@@ -249,6 +269,8 @@ void SimpleRender::CreateDevice(uint32_t a_deviceId)
       {
         std::cout << "Enabling optional extension " << optExt << std::endl;
         extensions.emplace_back(optExt);
+        if (std::strcmp(optExt, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+          m_memoryBudgetEnabled = true;
       }
     }
 
@@ -272,7 +294,8 @@ vk_utils::DescriptorMaker& SimpleRender::GetDescMaker()
       {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 100},
       {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 100},
       {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 100},
-      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 100}
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 100},
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 100}
     };
     m_pBindings = std::make_unique<vk_utils::DescriptorMaker>(m_device, dtypes, 100);
   }
@@ -288,6 +311,9 @@ void SimpleRender::SetupStaticMeshPipeline()
   bindings.BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT);
   bindings.BindBuffer(0, m_ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
   bindings.BindBuffer(1, m_pScnMgr->GetInstanceMatricesBuffer());
+  // the compact vertex format needs the mesh bbox to dequantize positions
+  bindings.BindBuffer(2, m_pScnMgr->GetInstanceInfosBuffer());
+  bindings.BindBuffer(3, m_pScnMgr->GetModelInfosBuffer());
   bindings.BindEnd(&m_graphicsDescriptorSet, &m_graphicsDescriptorSetLayout);
 
   for (auto* visInfo : m_visibilityInfos)
@@ -349,7 +375,8 @@ void SimpleRender::SetupStaticMeshPipeline()
   m_deferredPipeline = make_deferred_pipeline(
     std::unordered_map<VkShaderStageFlagBits, std::string> {
       {VK_SHADER_STAGE_FRAGMENT_BIT, std::string{WRITE_GBUF_FRAGMENT_SHADER_PATH} + ".spv"},
-      {VK_SHADER_STAGE_VERTEX_BIT, std::string{STATIC_MESH_VERTEX_SHADER_PATH} + ".spv"}
+      {VK_SHADER_STAGE_VERTEX_BIT, std::string{m_pScnMgr->GetVertexFormat() == VertexFormat::Compact
+        ? STATIC_MESH_COMPACT_VERTEX_SHADER_PATH : STATIC_MESH_VERTEX_SHADER_PATH} + ".spv"}
     });
 }
 
@@ -988,16 +1015,26 @@ void SimpleRender::SetupCullingPipeline()
     bindings.BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
     bindings.BindBuffer(0, visInfo->indirectDrawBuffer);
     bindings.BindBuffer(1, visInfo->instanceMappingBuffer);
+    bindings.BindBuffer(2, visInfo->modelRangesBuffer);
+    bindings.BindBuffer(3, visInfo->instanceSlotsBuffer);
     bindings.BindEnd(&visInfo->cullingOutputDescriptorSet, &m_cullingOutputDescriptorSetLayout);
   }
 
-  
-  vk_utils::ComputePipelineMaker maker;
-  maker.LoadShader(m_device, std::string{CULLING_SHADER_PATH} + ".spv");
+  // identical layouts, so the sets bound for the first pass stay valid for the others.
+  // Set 2 comes from SetupDepthPyramidPipeline, which has to run first.
+  for (auto [pipeline, path] : {
+      std::pair{&m_cullingPipeline, CULLING_SHADER_PATH},
+      std::pair{&m_cullingPrefixPipeline, CULLING_PREFIX_SHADER_PATH},
+      std::pair{&m_cullingScatterPipeline, CULLING_SCATTER_SHADER_PATH}})
+  {
+    vk_utils::ComputePipelineMaker maker;
+    maker.LoadShader(m_device, std::string{path} + ".spv");
 
-  m_cullingPipeline.layout = maker.MakeLayout(m_device,
-    {m_cullingSceneDescriptorSetLayout, m_cullingOutputDescriptorSetLayout}, sizeof(CullingPushConstants));
-  m_cullingPipeline.pipeline = maker.MakePipeline(m_device);
+    pipeline->layout = maker.MakeLayout(m_device,
+      {m_cullingSceneDescriptorSetLayout, m_cullingOutputDescriptorSetLayout, m_occlusionDescriptorSetLayout},
+        sizeof(CullingPushConstants));
+    pipeline->pipeline = maker.MakePipeline(m_device);
+  }
 
 
   auto minMaxHeights = m_pScnMgr->GetLandscapeMinMaxHeights();
@@ -1025,12 +1062,19 @@ void SimpleRender::SetupCullingPipeline()
   }
 
 
-  maker.LoadShader(m_device, std::string{LANDSCAPE_CULLING_SHADER_PATH} + ".spv");
-  
-  m_landscapeCullingPipeline.layout = maker.MakeLayout(m_device,
-    {m_landscapeCullingSceneDescriptorSetLayout, m_landscapeCullingOutputDescriptorSetLayout},
-      sizeof(LandscapeCullingPushConstants));
-  m_landscapeCullingPipeline.pipeline = maker.MakePipeline(m_device);
+  // same story as above, both passes share landscape_culling.glsl
+  for (auto [pipeline, path] : {
+      std::pair{&m_landscapeCullingPipeline, LANDSCAPE_CULLING_SHADER_PATH},
+      std::pair{&m_landscapeCullingArgsPipeline, LANDSCAPE_CULLING_ARGS_SHADER_PATH}})
+  {
+    vk_utils::ComputePipelineMaker maker;
+    maker.LoadShader(m_device, std::string{path} + ".spv");
+
+    pipeline->layout = maker.MakeLayout(m_device,
+      {m_landscapeCullingSceneDescriptorSetLayout, m_landscapeCullingOutputDescriptorSetLayout},
+        sizeof(LandscapeCullingPushConstants));
+    pipeline->pipeline = maker.MakePipeline(m_device);
+  }
 }
 
 void SimpleRender::SetupParticlePipeline()
@@ -1106,41 +1150,20 @@ void SimpleRender::SetupParticlePipeline()
 
 void SimpleRender::CreateUniformBuffer()
 {
-  VkMemoryRequirements memReq1;
-  VkMemoryRequirements memReq2;
-  VkMemoryRequirements memReq3;
-  m_ubo = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq1);
-  m_shadowmapUbo = vk_utils::createBuffer(m_device, sizeof(ShadowmapUbo), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq2);
-  m_particlesUbo = vk_utils::createBuffer(m_device, sizeof(ShadowmapUbo), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq3);
+  m_ubo = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+  m_shadowmapUbo = vk_utils::createBuffer(m_device, sizeof(ShadowmapUbo), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+  m_particlesUbo = vk_utils::createBuffer(m_device, sizeof(ShadowmapUbo), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 
-  if (memReq1.memoryTypeBits != memReq2.memoryTypeBits
-    || memReq2.memoryTypeBits != memReq3.memoryTypeBits)
-  {
-    vk_utils::logWarning("UBOs have different mem reqs!");
-  }
-
-  auto offsets = vk_utils::calculateMemOffsets({memReq1, memReq2, memReq3});
-
-  VkMemoryAllocateInfo allocateInfo{
-    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-    .allocationSize = offsets.back(),
-    .memoryTypeIndex =
-      vk_utils::findMemoryType(memReq1.memoryTypeBits,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_physicalDevice)
-  };
-
-  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_uboAlloc));
-
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_ubo, m_uboAlloc, offsets[0]))
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_shadowmapUbo, m_uboAlloc, offsets[1]))
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_particlesUbo, m_uboAlloc, offsets[2]))
+  std::vector<VkDeviceSize> offsets;
+  GpuAllocator::TagScope tag("uniforms");
+  m_uboAlloc = m_pAllocator->AllocateAndBind({m_ubo, m_shadowmapUbo, m_particlesUbo},
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &offsets);
 
-  void* mappedMem;
-  vkMapMemory(m_device, m_uboAlloc, 0, offsets.back(), 0, &mappedMem);
+  std::byte* mappedMem = m_pAllocator->Info(m_uboAlloc).mapped;
 
-  m_uboMappedMem = static_cast<std::byte*>(mappedMem) + offsets[0];
-  m_shadowmapUboMappedMem = static_cast<std::byte*>(mappedMem) + offsets[1];
-  m_particlesUboMappedMem = static_cast<std::byte*>(mappedMem) + offsets[2];
+  m_uboMappedMem = mappedMem + offsets[0];
+  m_shadowmapUboMappedMem = mappedMem + offsets[1];
+  m_particlesUboMappedMem = mappedMem + offsets[2];
 
   m_uniforms.baseColor = glm::vec3(0.9f, 0.92f, 1.0f);
   m_uniforms.animateLightColor = false;
@@ -1165,37 +1188,12 @@ void SimpleRender::CreateUniformBuffer()
   allBuffers.emplace_back(m_rsmKernel);
   allBuffers.emplace_back(m_particles);
 
-  for (auto* visInfo : m_visibilityInfos)
   {
-    // worst case we'll see all instances
-    visInfo->instanceMappingBuffer = vk_utils::createBuffer(m_device,
-      sizeof(uint32_t)*(m_pScnMgr->InstancesNum() + 1),
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-    // worst case we'll have to draw all model types
-    visInfo->indirectDrawBuffer = vk_utils::createBuffer(m_device,
-      sizeof(VkDrawIndexedIndirectCommand) * m_pScnMgr->MeshesNum(),
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
-
-
-    visInfo->landscapeIndirectDrawBuffer = vk_utils::createBuffer(m_device,
-      2*sizeof(VkDrawIndirectCommand)*m_pScnMgr->LandscapeNum(),
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
-
-    allBuffers.emplace_back(visInfo->instanceMappingBuffer);
-    allBuffers.emplace_back(visInfo->indirectDrawBuffer);
-    allBuffers.emplace_back(visInfo->landscapeIndirectDrawBuffer);
-
-    for (auto tiles : m_pScnMgr->LandscapeTileCounts())
-    {
-      allBuffers.emplace_back(visInfo->landscapeTileBuffers.emplace_back(vk_utils::createBuffer(m_device,
-        (1 + tiles) * sizeof(uint32_t),
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)));
-    }
+    GpuAllocator::TagScope tag("indirect draw");
+    m_indirectRenderingMemory = m_pAllocator->AllocateAndBind(allBuffers);
   }
 
-  m_indirectRenderingMemory = vk_utils::allocateAndBindWithPadding(m_device, m_physicalDevice,
-      allBuffers, VkMemoryAllocateFlags{});
-
+  CreateCullingBuffers();
 
   {
     std::vector<LiteMath::float4> ssaoKernel(SSAO_KERNEL_SIZE);
@@ -1233,6 +1231,142 @@ void SimpleRender::CreateUniformBuffer()
   }
 }
 
+void SimpleRender::SetupDepthPyramidPipeline()
+{
+  auto& bindings = GetDescMaker();
+
+  m_depthPyramidDescriptorSets.clear();
+  for (size_t i = 0; i < m_depthPyramidMips.size(); ++i)
+  {
+    bindings.BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+    if (i == 0)
+    {
+      bindings.BindImage(0, m_gbuffer.depth_stencil_layer.image.view, m_depthPyramidSampler,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+    }
+    else
+    {
+      bindings.BindImage(0, m_depthPyramidMips[i - 1], m_depthPyramidSampler,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_IMAGE_LAYOUT_GENERAL);
+    }
+    bindings.BindImage(1, m_depthPyramidMips[i], VK_NULL_HANDLE,
+      VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_IMAGE_LAYOUT_GENERAL);
+    bindings.BindEnd(&m_depthPyramidDescriptorSets.emplace_back(), &m_depthPyramidDescriptorSetLayout);
+  }
+
+  // set 2 of the culling passes, follows both the pyramid and the history buffer
+  bindings.BindBegin(VK_SHADER_STAGE_COMPUTE_BIT);
+  bindings.BindBuffer(0, m_visibilityHistoryBuffer);
+  bindings.BindImage(1, m_depthPyramid.view, m_depthPyramidSampler,
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_IMAGE_LAYOUT_GENERAL);
+  bindings.BindEnd(&m_occlusionDescriptorSet, &m_occlusionDescriptorSetLayout);
+
+  vk_utils::ComputePipelineMaker maker;
+  maker.LoadShader(m_device, std::string{DEPTH_PYRAMID_SHADER_PATH} + ".spv");
+
+  m_depthPyramidPipeline.layout = maker.MakeLayout(m_device,
+    {m_depthPyramidDescriptorSetLayout}, sizeof(glm::uvec2));
+  m_depthPyramidPipeline.pipeline = maker.MakePipeline(m_device);
+}
+
+void SimpleRender::CreateCullingBuffers()
+{
+  std::vector<VkBuffer> allBuffers;
+
+  for (auto* visInfo : m_visibilityInfos)
+  {
+    // worst case we'll see all instances
+    visInfo->instanceMappingBuffer = vk_utils::createBuffer(m_device,
+      sizeof(uint32_t)*(m_pScnMgr->InstancesCapacity() + 1),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    // worst case we'll have to draw all model types, 16 and 32 bit index ones have separate ranges
+    visInfo->indirectDrawBuffer = vk_utils::createBuffer(m_device,
+      sizeof(VkDrawIndexedIndirectCommand) * m_pScnMgr->DrawSlotsCapacity(),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    visInfo->modelRangesBuffer = vk_utils::createBuffer(m_device,
+      sizeof(uint32_t) * m_pScnMgr->MeshesCapacity(),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    visInfo->instanceSlotsBuffer = vk_utils::createBuffer(m_device,
+      sizeof(uint32_t) * m_pScnMgr->InstancesCapacity(),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+
+    visInfo->landscapeIndirectDrawBuffer = vk_utils::createBuffer(m_device,
+      2*sizeof(VkDrawIndirectCommand)*m_pScnMgr->LandscapeNum(),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+
+    allBuffers.emplace_back(visInfo->instanceMappingBuffer);
+    allBuffers.emplace_back(visInfo->indirectDrawBuffer);
+    allBuffers.emplace_back(visInfo->modelRangesBuffer);
+    allBuffers.emplace_back(visInfo->instanceSlotsBuffer);
+    allBuffers.emplace_back(visInfo->landscapeIndirectDrawBuffer);
+
+    for (auto tiles : m_pScnMgr->LandscapeTileCounts())
+    {
+      allBuffers.emplace_back(visInfo->landscapeTileBuffers.emplace_back(vk_utils::createBuffer(m_device,
+        (1 + tiles) * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)));
+    }
+  }
+
+  // only the main view is occlusion culled
+  m_visibilityHistoryBuffer = vk_utils::createBuffer(m_device,
+    sizeof(uint32_t) * m_pScnMgr->InstancesCapacity(),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  allBuffers.emplace_back(m_visibilityHistoryBuffer);
+  m_resetVisibilityHistory = true;
+
+  GpuAllocator::TagScope tag("culling");
+  m_cullingBuffersMemory = m_pAllocator->AllocateAndBind(allBuffers);
+}
+
+void SimpleRender::DestroyCullingBuffers()
+{
+  for (auto* visInfo : m_visibilityInfos)
+  {
+    if (visInfo->indirectDrawBuffer != VK_NULL_HANDLE)
+    {
+      vkDestroyBuffer(m_device, visInfo->indirectDrawBuffer, nullptr);
+      visInfo->indirectDrawBuffer = VK_NULL_HANDLE;
+    }
+
+    if (visInfo->landscapeIndirectDrawBuffer != VK_NULL_HANDLE)
+    {
+      vkDestroyBuffer(m_device, visInfo->landscapeIndirectDrawBuffer, nullptr);
+      visInfo->landscapeIndirectDrawBuffer = VK_NULL_HANDLE;
+    }
+
+    for (auto& buffer : visInfo->landscapeTileBuffers)
+    {
+      vkDestroyBuffer(m_device, buffer, nullptr);
+    }
+    visInfo->landscapeTileBuffers.clear();
+
+    if(visInfo->instanceMappingBuffer != VK_NULL_HANDLE)
+    {
+      vkDestroyBuffer(m_device, visInfo->instanceMappingBuffer, nullptr);
+      visInfo->instanceMappingBuffer = VK_NULL_HANDLE;
+    }
+
+    for (auto* buffer : {&visInfo->modelRangesBuffer, &visInfo->instanceSlotsBuffer})
+    {
+      if (*buffer != VK_NULL_HANDLE)
+      {
+        vkDestroyBuffer(m_device, *buffer, nullptr);
+        *buffer = VK_NULL_HANDLE;
+      }
+    }
+  }
+
+  if (m_visibilityHistoryBuffer != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_visibilityHistoryBuffer, nullptr);
+    m_visibilityHistoryBuffer = VK_NULL_HANDLE;
+  }
+
+  m_pAllocator->Free(m_cullingBuffersMemory);
+}
+
 void SimpleRender::UpdateUniformBuffer(float a_time)
 {
   m_uniforms.time = a_time;
@@ -1254,44 +1388,98 @@ void SimpleRender::UpdateUniformBuffer(float a_time)
   std::memcpy(m_particlesUboMappedMem, &m_particlesUboData, sizeof(m_particlesUboData));
 }
 
-void SimpleRender::RecordStaticMeshCulling(VkCommandBuffer a_cmdBuff, VisibilityInfo& visInfo)
+void SimpleRender::RecordStaticMeshCulling(VkCommandBuffer a_cmdBuff, VisibilityInfo& visInfo, CullPass pass)
 {
-  cmdBeginRegion(a_cmdBuff, "Static mesh culling");
-  vkCmdFillBuffer(a_cmdBuff, visInfo.instanceMappingBuffer, 0, sizeof(uint32_t), 0);
+  cmdBeginRegion(a_cmdBuff, pass == CullPass::Late ? "Static mesh culling (late)" : "Static mesh culling");
 
+  if (pass == CullPass::Late)
   {
-    std::array bufferMemBarriers
+    // the early pass draws are still reading the draws and mappings we are about to overwrite,
+    // and its culling shaders the model ranges the fill below clears
+    vkCmdPipelineBarrier(a_cmdBuff,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        {},
+        0, nullptr,
+        0, nullptr,
+        0, nullptr);
+  }
+
+  vkCmdFillBuffer(a_cmdBuff, visInfo.modelRangesBuffer, 0, VK_WHOLE_SIZE, 0);
+  // nothing was visible before the history buffer existed
+  if (pass == CullPass::Early && m_resetVisibilityHistory)
+  {
+    vkCmdFillBuffer(a_cmdBuff, m_visibilityHistoryBuffer, 0, VK_WHOLE_SIZE, 0);
+    m_resetVisibilityHistory = false;
+  }
+
+  // between the passes only the scratch buffers are handed over
+  auto passBarrier = [&](VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, std::initializer_list<VkBuffer> buffers)
+  {
+    std::vector<VkBufferMemoryBarrier> bufferMemBarriers;
+    for (auto buffer : buffers)
     {
-      VkBufferMemoryBarrier {
+      bufferMemBarriers.emplace_back(VkBufferMemoryBarrier {
         .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .srcAccessMask = srcAccess,
         .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
-        .buffer = visInfo.instanceMappingBuffer,
+        .buffer = buffer,
         .offset = 0,
-        .size = sizeof(uint32_t)
-      }
-    };
+        .size = VK_WHOLE_SIZE
+      });
+    }
 
     vkCmdPipelineBarrier(a_cmdBuff,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        srcStage,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
         {},
         0, nullptr,
         static_cast<uint32_t>(bufferMemBarriers.size()), bufferMemBarriers.data(),
         0, nullptr);
-  }
+  };
 
-  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullingPipeline.pipeline);
+  if (pass == CullPass::Early)
+  {
+    // the history is either just cleared or written by last frame's late pass
+    passBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        {visInfo.modelRangesBuffer, m_visibilityHistoryBuffer});
+  }
+  else
+  {
+    passBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, {visInfo.modelRangesBuffer});
+  }
 
   vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE,
     m_cullingPipeline.layout, 0, 1, &m_cullingSceneDescriptorSet, 0, nullptr);
   vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE,
     m_cullingPipeline.layout, 1, 1, &visInfo.cullingOutputDescriptorSet, 0, nullptr);
+  // not read at all with CullPass::All, the shadow cascades bind it just to have set 2 bound
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE,
+    m_cullingPipeline.layout, 2, 1, &m_occlusionDescriptorSet, 0, nullptr);
 
+  visInfo.cullingPushConsts.pass = pass;
   vkCmdPushConstants(a_cmdBuff, m_cullingPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT,
       0, sizeof(visInfo.cullingPushConsts), &visInfo.cullingPushConsts);
 
-  vkCmdDispatch(a_cmdBuff, m_pScnMgr->MeshesNum(), 1, 1);
+  const uint32_t instanceGroups =
+    (visInfo.cullingPushConsts.instanceCount + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE;
+
+  // every instance is tested once and counted towards its model
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullingPipeline.pipeline);
+  vkCmdDispatch(a_cmdBuff, instanceGroups, 1, 1);
+
+  passBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, {visInfo.modelRangesBuffer});
+
+  // counts -> ranges of the mapping buffer, and the draws themselves
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullingPrefixPipeline.pipeline);
+  vkCmdDispatch(a_cmdBuff, 1, 1, 1);
+
+  passBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+    {visInfo.modelRangesBuffer, visInfo.instanceSlotsBuffer});
+
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullingScatterPipeline.pipeline);
+  vkCmdDispatch(a_cmdBuff, instanceGroups, 1, 1);
 
   {
     std::array bufferMemBarriers
@@ -1361,24 +1549,67 @@ void SimpleRender::RecordLandscapeCulling(VkCommandBuffer a_cmdBuff, VisibilityI
   }
 
 
+  auto bindLandscapeSets = [&](std::size_t i)
+    {
+      uint32_t drawIndirectOffset = static_cast<uint32_t>(i*2*sizeof(VkDrawIndirectCommand));
+      uint32_t landscapeInfoOffset = static_cast<uint32_t>(i*sizeof(LandscapeGpuInfo));
+
+      vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE,
+        m_landscapeCullingPipeline.layout, 0, 1, &m_landscapeCullingSceneDescriptorSets[i],
+        1, &landscapeInfoOffset);
+
+      vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE,
+        m_landscapeCullingPipeline.layout, 1, 1, &visInfo.landscapeCullingOutputDescriptorSets[i],
+        1, &drawIndirectOffset);
+    };
+
+  // one invocation per tile, so big heightmaps simply get more workgroups
+  auto tileGrids = m_pScnMgr->LandscapeTileGrids();
+
   vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_landscapeCullingPipeline.pipeline);
   vkCmdPushConstants(a_cmdBuff, m_landscapeCullingPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT,
       0, sizeof(visInfo.landscapeCullingPushConsts), &visInfo.landscapeCullingPushConsts);
 
-
   for (std::size_t i = 0; i < m_landscapeCullingSceneDescriptorSets.size(); ++i)
   {
-    uint32_t drawIndirectOffset = static_cast<uint32_t>(i*2*sizeof(VkDrawIndirectCommand));
-    uint32_t landscapeInfoOffset = static_cast<uint32_t>(i*sizeof(LandscapeGpuInfo));
-    
-    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE,
-      m_landscapeCullingPipeline.layout, 0, 1, &m_landscapeCullingSceneDescriptorSets[i],
-      1, &landscapeInfoOffset);
-    
-    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE,
-      m_landscapeCullingPipeline.layout, 1, 1, &visInfo.landscapeCullingOutputDescriptorSets[i],
-      1, &drawIndirectOffset);
+    bindLandscapeSets(i);
+    vkCmdDispatch(a_cmdBuff,
+      (tileGrids[i].x + LANDSCAPE_CULLING_GROUP_SIZE - 1) / LANDSCAPE_CULLING_GROUP_SIZE,
+      (tileGrids[i].y + LANDSCAPE_CULLING_GROUP_SIZE - 1) / LANDSCAPE_CULLING_GROUP_SIZE,
+      1);
+  }
+
+  // the tile count is only final once every workgroup is done
+  {
+    std::vector<VkBufferMemoryBarrier> bufferMemBarriers;
+    bufferMemBarriers.reserve(visInfo.landscapeTileBuffers.size());
 
+    for (auto& buf : visInfo.landscapeTileBuffers)
+    {
+      bufferMemBarriers.emplace_back(VkBufferMemoryBarrier {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .buffer = buf,
+        .offset = 0,
+        .size = sizeof(uint32_t)
+      });
+    }
+
+    vkCmdPipelineBarrier(a_cmdBuff,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        {},
+        0, nullptr,
+        static_cast<uint32_t>(bufferMemBarriers.size()), bufferMemBarriers.data(),
+        0, nullptr);
+  }
+
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_landscapeCullingArgsPipeline.pipeline);
+
+  for (std::size_t i = 0; i < m_landscapeCullingSceneDescriptorSets.size(); ++i)
+  {
+    bindLandscapeSets(i);
     vkCmdDispatch(a_cmdBuff, 1, 1, 1);
   }
 
@@ -1423,6 +1654,74 @@ void SimpleRender::RecordLandscapeCulling(VkCommandBuffer a_cmdBuff, VisibilityI
 }
 
 
+void SimpleRender::RecordDepthPyramid(VkCommandBuffer a_cmdBuff)
+{
+  cmdBeginRegion(a_cmdBuff, "Depth pyramid");
+
+  // rebuilt from scratch every frame, last frame's late culling pass was the only reader
+  {
+    VkImageMemoryBarrier toGeneral {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = 0,
+      .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = m_depthPyramid.image,
+      .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1},
+    };
+
+    vkCmdPipelineBarrier(a_cmdBuff,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        {},
+        0, nullptr,
+        0, nullptr,
+        1, &toGeneral);
+  }
+
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_depthPyramidPipeline.pipeline);
+
+  for (uint32_t level = 0; level < m_depthPyramidMips.size(); ++level)
+  {
+    const glm::uvec2 dstSize{
+      std::max(m_depthPyramidExtent.width >> level, 1u),
+      std::max(m_depthPyramidExtent.height >> level, 1u)};
+
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE,
+      m_depthPyramidPipeline.layout, 0, 1, &m_depthPyramidDescriptorSets[level], 0, nullptr);
+    vkCmdPushConstants(a_cmdBuff, m_depthPyramidPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT,
+      0, sizeof(dstSize), &dstSize);
+    vkCmdDispatch(a_cmdBuff,
+      (dstSize.x + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+      (dstSize.y + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE, 1);
+
+    // read by the next level, and the last one by the late culling pass
+    VkImageMemoryBarrier levelBarrier {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+      .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = m_depthPyramid.image,
+      .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1},
+    };
+
+    vkCmdPipelineBarrier(a_cmdBuff,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        {},
+        0, nullptr,
+        0, nullptr,
+        1, &levelBarrier);
+  }
+
+  cmdEndRegion(a_cmdBuff);
+}
+
 void SimpleRender::RecordStaticMeshRendering(VkCommandBuffer a_cmdBuff, VisibilityInfo& visInfo, bool depthOnly)
 {
   cmdBeginRegion(a_cmdBuff, "Static meshes");
@@ -1441,12 +1740,18 @@ void SimpleRender::RecordStaticMeshRendering(VkCommandBuffer a_cmdBuff, Visibili
 
   VkDeviceSize zero_offset = 0u;
   VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
-  VkBuffer indexBuf = m_pScnMgr->GetIndexBuffer();
 
   vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
-  vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
 
-  vkCmdDrawIndexedIndirect(a_cmdBuff, visInfo.indirectDrawBuffer, 0, m_pScnMgr->MeshesNum(), sizeof(VkDrawIndexedIndirectCommand));
+  auto drawRange = [&](SceneManager::DrawRange range, VkBuffer indexBuf, VkIndexType indexType) {
+    if (range.count == 0)
+      return;
+    vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, indexType);
+    vkCmdDrawIndexedIndirect(a_cmdBuff, visInfo.indirectDrawBuffer,
+      range.first * sizeof(VkDrawIndexedIndirectCommand), range.count, sizeof(VkDrawIndexedIndirectCommand));
+  };
+  drawRange(m_pScnMgr->Index16Draws(), m_pScnMgr->GetIndex16Buffer(), VK_INDEX_TYPE_UINT16);
+  drawRange(m_pScnMgr->Index32Draws(), m_pScnMgr->GetIndexBuffer(), VK_INDEX_TYPE_UINT32);
 
   cmdEndRegion(a_cmdBuff);
 }
@@ -1705,10 +2010,17 @@ void SimpleRender::RecordFrameCommandBuffer(VkCommandBuffer a_cmdBuff, uint32_t
 
   VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo))
 
+  // streamed uploads first, instance updates may write to the same buffers
+  m_uploadWaitValue = m_pScnMgr->RecordUploadAcquire(a_cmdBuff);
+
+  // instances moved or (un)marked since the last frame, before anything culls or draws them
+  m_pScnMgr->RecordInstanceUpdates(a_cmdBuff, m_presentationResources.currentFrame);
+
   RecordShadowmapRendering(a_cmdBuff);
 
 
-  RecordStaticMeshCulling(a_cmdBuff, m_mainVisInfo);
+  // with occlusion culling only what was visible last frame is drawn before the depth pyramid
+  RecordStaticMeshCulling(a_cmdBuff, m_mainVisInfo, m_occlusionCulling ? CullPass::Early : CullPass::All);
   RecordLandscapeCulling(a_cmdBuff, m_mainVisInfo);
 
   vk_utils::setDefaultViewport(a_cmdBuff, static_cast<float>(m_width), static_cast<float>(m_height));
@@ -1735,7 +2047,7 @@ void SimpleRender::RecordFrameCommandBuffer(VkCommandBuffer a_cmdBuff, uint32_t
 
     VkRenderPassBeginInfo mainPassInfo {
       .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-      .renderPass = m_gbuffer.renderpass,
+      .renderPass = m_gbuffer.earlyRenderpass,
       .framebuffer = m_mainPassFrameBuffer,
       .renderArea = {
         .offset = {0, 0},
@@ -1745,12 +2057,18 @@ void SimpleRender::RecordFrameCommandBuffer(VkCommandBuffer a_cmdBuff, uint32_t
       .pClearValues = mainPassClearValues.data(),
     };
 
+    auto pushGraphicsConstants = [&]()
+      {
+        vkCmdPushConstants(a_cmdBuff, m_deferredLandscapePipeline.layout,
+          VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
+            | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, 0,
+              sizeof(graphicsPushConsts), &graphicsPushConsts);
+      };
+
+    // landscape and grass are not occlusion culled, but they are the best occluders we have
     vkCmdBeginRenderPass(a_cmdBuff, &mainPassInfo, VK_SUBPASS_CONTENTS_INLINE);
     {
-      vkCmdPushConstants(a_cmdBuff, m_deferredLandscapePipeline.layout,
-        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
-          | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, 0,
-            sizeof(graphicsPushConsts), &graphicsPushConsts);
+      pushGraphicsConstants();
       {
         RecordStaticMeshRendering(a_cmdBuff, m_mainVisInfo, false);
 
@@ -1760,6 +2078,26 @@ void SimpleRender::RecordFrameCommandBuffer(VkCommandBuffer a_cmdBuff, uint32_t
       }
 
       vkCmdNextSubpass(a_cmdBuff, VK_SUBPASS_CONTENTS_INLINE);
+    }
+    vkCmdEndRenderPass(a_cmdBuff);
+
+    if (m_occlusionCulling)
+    {
+      RecordDepthPyramid(a_cmdBuff);
+      RecordStaticMeshCulling(a_cmdBuff, m_mainVisInfo, CullPass::Late);
+    }
+
+    mainPassInfo.renderPass = m_gbuffer.renderpass;
+    vkCmdBeginRenderPass(a_cmdBuff, &mainPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    {
+      if (m_occlusionCulling)
+      {
+        // the compute passes in between disturbed the push constants
+        pushGraphicsConstants();
+        RecordStaticMeshRendering(a_cmdBuff, m_mainVisInfo, false);
+      }
+
+      vkCmdNextSubpass(a_cmdBuff, VK_SUBPASS_CONTENTS_INLINE);
       
       RecordLightResolve(a_cmdBuff);
     }
@@ -1866,6 +2204,7 @@ void SimpleRender::CleanupPipelineAndSwapchain()
   m_frameFences.clear();
 
   ClearGBuffer();
+  ClearDepthPyramid();
   ClearPostFx();
   ClearShadowmaps();
   ClearTransparent();
@@ -1889,13 +2228,17 @@ void SimpleRender::RecreateSwapChain()
   ClearPipeline(m_postFxPipeline);
   ClearPipeline(m_particlesComputePipeline);
   ClearPipeline(m_particlesPipeline);
+  ClearPipeline(m_depthPyramidPipeline);
 
   CleanupPipelineAndSwapchain();
+  // render targets are all gone now, the pool is regrown to one block if the new size needs more
+  m_pAllocator->ResetLinearPool(m_renderTargetPool);
   auto oldImagesNum = m_swapchain.GetImageCount();
   m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface, m_width, m_height,
     oldImagesNum, m_vsync);
 
   CreateGBuffer();
+  CreateDepthPyramid();
   CreatePostFx();
   CreateShadowmaps();
   CreateTransparent();
@@ -1904,6 +2247,7 @@ void SimpleRender::RecreateSwapChain()
   SetupLightingPipeline();
   SetupPostfxPipeline();
   SetupParticlePipeline();
+  SetupDepthPyramidPipeline();
 
   m_frameFences.resize(m_framesInFlight);
   VkFenceCreateInfo fenceInfo = {};
@@ -1954,6 +2298,12 @@ void SimpleRender::Cleanup()
     m_noiseSampler = VK_NULL_HANDLE;
   }
 
+  if (m_depthPyramidSampler != VK_NULL_HANDLE)
+  {
+    vkDestroySampler(m_device, m_depthPyramidSampler, nullptr);
+    m_depthPyramidSampler = VK_NULL_HANDLE;
+  }
+
   ClearAllPipelines();
 
   if (m_presentationResources.imageAvailable != VK_NULL_HANDLE)
@@ -2009,47 +2359,18 @@ void SimpleRender::Cleanup()
     m_particles = VK_NULL_HANDLE;
   }
 
-  for (auto* visInfo : m_visibilityInfos)
-  {
-    if (visInfo->indirectDrawBuffer != VK_NULL_HANDLE)
-    {
-      vkDestroyBuffer(m_device, visInfo->indirectDrawBuffer, nullptr);
-      visInfo->indirectDrawBuffer = VK_NULL_HANDLE;
-    }
-
-    if (visInfo->landscapeIndirectDrawBuffer != VK_NULL_HANDLE)
-    {
-      vkDestroyBuffer(m_device, visInfo->landscapeIndirectDrawBuffer, nullptr);
-      visInfo->landscapeIndirectDrawBuffer = VK_NULL_HANDLE;
-    }
-
-    for (auto& buffer : visInfo->landscapeTileBuffers)
-    {
-      vkDestroyBuffer(m_device, buffer, nullptr);
-    }
-    visInfo->landscapeTileBuffers.clear();
-
-    if(visInfo->instanceMappingBuffer != VK_NULL_HANDLE)
-    {
-      vkDestroyBuffer(m_device, visInfo->instanceMappingBuffer, nullptr);
-      visInfo->instanceMappingBuffer = VK_NULL_HANDLE;
-    }
-  }
-
-  if(m_uboAlloc != VK_NULL_HANDLE)
-  {
-    vkFreeMemory(m_device, m_uboAlloc, nullptr);
-    m_uboAlloc = VK_NULL_HANDLE;
-  }
+  DestroyCullingBuffers();
 
-  if(m_indirectRenderingMemory != VK_NULL_HANDLE)
+  if (m_pAllocator)
   {
-    vkFreeMemory(m_device, m_indirectRenderingMemory, nullptr);
-    m_indirectRenderingMemory = VK_NULL_HANDLE;
+    m_pAllocator->Free(m_uboAlloc);
+    m_pAllocator->Free(m_indirectRenderingMemory);
+    m_pAllocator->DestroyLinearPool(m_renderTargetPool);
   }
 
-  m_pBindings = nullptr;
-  m_pScnMgr   = nullptr;
+  m_pBindings  = nullptr;
+  m_pScnMgr    = nullptr;
+  m_pAllocator = nullptr;
 
   if(m_device != VK_NULL_HANDLE)
   {
@@ -2090,10 +2411,13 @@ void SimpleRender::ProcessInput(const AppInput &input)
     SetupLandscapePipeline();
     SetupLightingPipeline();
     SetupPostfxPipeline();
+    SetupDepthPyramidPipeline();
     SetupCullingPipeline();
     SetupParticlePipeline();
   }
 
+  if(input.keyPressed[GLFW_KEY_N] && m_nextSceneChange < m_sceneChanges.size())
+    ApplySceneChange(m_sceneChanges[m_nextSceneChange++].c_str(), false);
 }
 
 void SimpleRender::UpdateCamera(const Camera* cams, uint32_t a_camsCount)
@@ -2215,6 +2539,11 @@ void SimpleRender::UpdateView()
   }
 
 
+  UpdateCullingCounts();
+}
+
+void SimpleRender::UpdateCullingCounts()
+{
   // TODO: should this really be here?
   for (auto* visInfo : m_visibilityInfos)
   {
@@ -2225,13 +2554,23 @@ void SimpleRender::UpdateView()
 
 void SimpleRender::LoadScene(const char* path, bool transpose_inst_matrices)
 {
-  m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
+  m_pScnMgr->SetVertexFormat(m_compactVertices ? VertexFormat::Compact : VertexFormat::Full);
+  m_pScnMgr->SetMeshOptimization(m_optimizeMeshes);
+
+  // buffers are sized for the whole scene right away, meshes show up as they are streamed in
+  m_pScnMgr->LoadSceneXMLAsync(path, transpose_inst_matrices,
+    [this](uint32_t loadedMeshes, uint32_t totalMeshes)
+    {
+      m_loadedMeshes = loadedMeshes;
+      m_totalMeshes  = totalMeshes;
+    });
 
   CreateUniformBuffer();
   SetupStaticMeshPipeline();
   SetupLandscapePipeline();
   SetupLightingPipeline();
   SetupPostfxPipeline();
+  SetupDepthPyramidPipeline();
   SetupCullingPipeline();
   SetupParticlePipeline();
 
@@ -2242,9 +2581,40 @@ void SimpleRender::LoadScene(const char* path, bool transpose_inst_matrices)
   m_cam.lookAt = glm::vec3(loadedCam.lookAt[0], loadedCam.lookAt[1], loadedCam.lookAt[2]);
   m_cam.tdist  = loadedCam.farPlane;
 
+  m_sceneBuffersGeneration = m_pScnMgr->GpuBuffersGeneration();
   UpdateView();
 }
 
+void SimpleRender::ApplySceneChange(const char* path, bool transpose_inst_matrices)
+{
+  // the previous frame was waited on, so patching ranges in place is safe here
+  const auto stats = m_pScnMgr->ApplySceneChange(path, transpose_inst_matrices);
+  std::cout << path << ": " << stats.meshesAdded << " meshes and " << stats.instancesAdded << " instances added, "
+    << stats.instancesPatched << " patched, " << stats.instancesHidden << " hidden"
+    << (stats.buffersReallocated ? ", scene buffers reallocated" : "") << std::endl;
+  FollowSceneBuffers();
+  UpdateCullingCounts();
+}
+
+void SimpleRender::FollowSceneBuffers()
+{
+  if (m_pScnMgr->GpuBuffersGeneration() == m_sceneBuffersGeneration)
+    return;
+
+  vkDeviceWaitIdle(m_device);
+  DestroyCullingBuffers();
+  CreateCullingBuffers();
+  ClearPipeline(m_cullingPipeline);
+  ClearPipeline(m_cullingPrefixPipeline);
+  ClearPipeline(m_cullingScatterPipeline);
+  ClearPipeline(m_landscapeCullingPipeline);
+  ClearPipeline(m_landscapeCullingArgsPipeline);
+  SetupCullingPipeline();
+  RecreateSwapChain();
+
+  m_sceneBuffersGeneration = m_pScnMgr->GpuBuffersGeneration();
+}
+
 void SimpleRender::ClearPipeline(pipeline_data_t& pipeline)
 {
   if(pipeline.layout != VK_NULL_HANDLE)
@@ -2296,7 +2666,11 @@ void SimpleRender::ClearAllPipelines()
   ClearPipeline(m_fogPipeline);
   ClearPipeline(m_ssaoPipeline);
   ClearPipeline(m_cullingPipeline);
+  ClearPipeline(m_cullingPrefixPipeline);
+  ClearPipeline(m_cullingScatterPipeline);
   ClearPipeline(m_landscapeCullingPipeline);
+  ClearPipeline(m_landscapeCullingArgsPipeline);
+  ClearPipeline(m_depthPyramidPipeline);
   ClearPipeline(m_particlesComputePipeline);
   ClearPipeline(m_particlesPipeline);
 }
@@ -2311,14 +2685,23 @@ void SimpleRender::DrawFrameSimple()
 
   auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
 
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-
   RecordFrameCommandBuffer(currentCmdBuf, imageIdx);
 
+  // scene uploads still on the transfer queue have to land before the frame touches the scene
+  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable, m_pScnMgr->UploadTimeline()};
+  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT};
+  const uint64_t waitValues[] = {0, m_uploadWaitValue};
+  const uint32_t waitCount = m_uploadWaitValue != 0 ? 2 : 1;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = waitCount;
+  timelineInfo.pWaitSemaphoreValues = waitValues;
+
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.waitSemaphoreCount = waitCount;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
   submitInfo.commandBufferCount = 1;
@@ -2349,6 +2732,12 @@ void SimpleRender::DrawFrameSimple()
 
 void SimpleRender::DrawFrame(float a_time, DrawMode a_mode)
 {
+  // previous frame was waited on, so nothing in flight reads the ranges being filled
+  if (m_pScnMgr->UpdateAsyncLoad())
+    UpdateCullingCounts();
+  // meshes added between frames may have run out of slots and recreated the scene buffers
+  FollowSceneBuffers();
+
   UpdateUniformBuffer(a_time);
   switch (a_mode)
   {
@@ -2377,6 +2766,7 @@ void SimpleRender::SetupGUIElements()
     ImGui::Begin("Simple render settings");
 
     ImGui::Checkbox("Wireframe", &m_wireframe);
+    ImGui::Checkbox("Occlusion culling", &m_occlusionCulling);
     ImGui::Checkbox("Point lights", &m_pointLights);
     ImGui::Checkbox("Cascade shadows", &m_shadows);
     ImGui::Checkbox("Screenspace ambient occlusion", &m_ssao);
@@ -2389,9 +2779,15 @@ void SimpleRender::SetupGUIElements()
     ImGui::Checkbox("Sun lighting", &m_sun);
     ImGui::SliderAngle("Sun pitch", &m_sunPitch);
     ImGui::SliderAngle("Sun yaw", &m_sunYaw);
+    ImGui::Checkbox("GPU memory", &m_showMemoryPanel);
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
     ImGui::Text("Camera pos: %.3f %.3f %.3f", m_cam.pos.x, m_cam.pos.y, m_cam.pos.z);
+    if (m_pScnMgr->IsLoading())
+    {
+      ImGui::ProgressBar(m_totalMeshes > 0 ? float(m_loadedMeshes) / float(m_totalMeshes) : 0.0f);
+      ImGui::Text("Loading scene: %u/%u meshes", m_loadedMeshes, m_totalMeshes);
+    }
 
     ImGui::NewLine();
 
@@ -2400,6 +2796,9 @@ void SimpleRender::SetupGUIElements()
     ImGui::End();
   }
 
+  if (m_showMemoryPanel)
+    SetupMemoryPanel();
+
   /*
   for (std::size_t i = 0; i < m_pScnMgr->InstancesNum(); ++i)
   {
@@ -2451,6 +2850,83 @@ void SimpleRender::SetupGUIElements()
   ImGui::Render();
 }
 
+static float toMb(VkDeviceSize bytes)
+{
+  return float(bytes) / float(1024 * 1024);
+}
+
+void SimpleRender::SetupMemoryPanel()
+{
+  const GpuAllocatorStats stats = m_pAllocator->Stats();
+
+  ImGui::Begin("GPU memory", &m_showMemoryPanel);
+
+  ImGui::Text("Device allocations: %u/%u (%llu vkAllocateMemory calls)",
+    stats.deviceAllocations, stats.maxDeviceAllocations, static_cast<unsigned long long>(stats.allocateCalls));
+
+  for (std::size_t i = 0; i < stats.heaps.size(); ++i)
+  {
+    const auto& heap = stats.heaps[i];
+    if (heap.blocks == 0 && heap.usage == 0)
+      continue;
+
+    ImGui::Separator();
+    ImGui::Text("Heap %zu (%s), %.0f MB", i,
+      (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "device local" : "host", toMb(heap.heapSize));
+    ImGui::Text("  blocks %.1f MB, used %.1f MB in %u allocations",
+      toMb(heap.blockBytes), toMb(heap.usedBytes), heap.allocations);
+    if (stats.hasBudget && heap.budget > 0)
+    {
+      // usage is the whole process, whatever is above our blocks comes from elsewhere
+      ImGui::ProgressBar(float(heap.usage) / float(heap.budget), ImVec2(-1.0f, 0.0f));
+      ImGui::Text("  usage %.1f / budget %.1f MB, %.1f MB outside the allocator",
+        toMb(heap.usage), toMb(heap.budget), toMb(heap.usage > heap.blockBytes ? heap.usage - heap.blockBytes : 0));
+    }
+  }
+  if (!stats.hasBudget)
+    ImGui::TextDisabled("VK_EXT_memory_budget is not available");
+
+  ImGui::Separator();
+  auto tags = stats.tags;
+  std::sort(tags.begin(), tags.end(), [](const auto& a, const auto& b) { return a.bytes > b.bytes; });
+
+  ImGui::Columns(4, "tags");
+  ImGui::Text("Tag");       ImGui::NextColumn();
+  ImGui::Text("MB");        ImGui::NextColumn();
+  ImGui::Text("Peak MB");   ImGui::NextColumn();
+  ImGui::Text("Count");     ImGui::NextColumn();
+  ImGui::Separator();
+  for (const auto& tag : tags)
+  {
+    ImGui::Text("%s", tag.name.c_str());      ImGui::NextColumn();
+    ImGui::Text("%.2f", toMb(tag.bytes));     ImGui::NextColumn();
+    ImGui::Text("%.2f", toMb(tag.peakBytes)); ImGui::NextColumn();
+    ImGui::Text("%u", tag.allocations);       ImGui::NextColumn();
+  }
+  ImGui::Columns(1);
+
+  ImGui::Separator();
+  if (ImGui::Button("Dump JSON"))
+    DumpMemoryStats("gpu_memory.json");
+  if (!m_memoryDumpStatus.empty())
+  {
+    ImGui::SameLine();
+    ImGui::Text("%s", m_memoryDumpStatus.c_str());
+  }
+
+  ImGui::End();
+}
+
+void SimpleRender::DumpMemoryStats(const char* a_path)
+{
+  std::ofstream out(a_path);
+  writeStatsJson(out, m_pAllocator->Stats());
+  if (out.flush())
+    m_memoryDumpStatus = std::string("written to ") + a_path;
+  else
+    m_memoryDumpStatus = std::string("couldn't write ") + a_path;
+}
+
 void SimpleRender::DrawFrameWithGUI()
 {
   vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
@@ -2470,11 +2946,19 @@ void SimpleRender::DrawFrameWithGUI()
 
   auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
 
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-
   RecordFrameCommandBuffer(currentCmdBuf, imageIdx);
 
+  // scene uploads still on the transfer queue have to land before the frame touches the scene
+  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable, m_pScnMgr->UploadTimeline()};
+  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT};
+  const uint64_t waitValues[] = {0, m_uploadWaitValue};
+  const uint32_t waitCount = m_uploadWaitValue != 0 ? 2 : 1;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = waitCount;
+  timelineInfo.pWaitSemaphoreValues = waitValues;
+
   ImDrawData* pDrawData = ImGui::GetDrawData();
   auto currentGUICmdBuf = m_pGUIRender->BuildGUIRenderCommand(imageIdx, pDrawData);
 
@@ -2482,7 +2966,8 @@ void SimpleRender::DrawFrameWithGUI()
 
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.waitSemaphoreCount = waitCount;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
   submitInfo.commandBufferCount = (uint32_t)submitCmdBufs.size();
@@ -2513,10 +2998,13 @@ void SimpleRender::DrawFrameWithGUI()
 
 void SimpleRender::ClearGBuffer()
 {
-  if (m_gbuffer.renderpass != VK_NULL_HANDLE)
+  for (auto* renderpass : {&m_gbuffer.earlyRenderpass, &m_gbuffer.renderpass})
   {
-    vkDestroyRenderPass(m_device, m_gbuffer.renderpass, nullptr);
-    m_gbuffer.renderpass = VK_NULL_HANDLE;
+    if (*renderpass != VK_NULL_HANDLE)
+    {
+      vkDestroyRenderPass(m_device, *renderpass, nullptr);
+      *renderpass = VK_NULL_HANDLE;
+    }
   }
 
   if (m_mainPassFrameBuffer != VK_NULL_HANDLE)
@@ -2527,7 +3015,7 @@ void SimpleRender::ClearGBuffer()
 
   auto clearLayer = [this](GBufferLayer& layer)
     {
-      vk_utils::deleteImg(m_device, &layer.image);
+      m_pAllocator->DestroyImage(&layer.image);
     };
 
   for (auto& layer : m_gbuffer.color_layers)
@@ -2536,11 +3024,22 @@ void SimpleRender::ClearGBuffer()
   }
 
   m_gbuffer.color_layers.clear();
-  vk_utils::deleteImg(m_device, &m_gbuffer.resolved);
+  m_pAllocator->DestroyImage(&m_gbuffer.resolved);
 
   clearLayer(m_gbuffer.depth_stencil_layer);
 }
 
+void SimpleRender::ClearDepthPyramid()
+{
+  for (auto& view : m_depthPyramidMips)
+  {
+    vkDestroyImageView(m_device, view, nullptr);
+  }
+  m_depthPyramidMips.clear();
+
+  m_pAllocator->DestroyImage(&m_depthPyramid);
+}
+
 void SimpleRender::ClearPostFx()
 {
   for (auto framebuf : m_framebuffers)
@@ -2568,8 +3067,9 @@ void SimpleRender::ClearPostFx()
     m_prePostFxRenderPass = VK_NULL_HANDLE;
   }
   
-  vk_utils::deleteImg(m_device, &m_fogImage);
-  vk_utils::deleteImg(m_device, &m_ssaoImage);
+  m_pAllocator->DestroyImage(&m_fogImage);
+  m_pAllocator->DestroyImage(&m_ssaoImage);
+  m_pAllocator->UntrackImage(m_ssaoNoise.image);
   vk_utils::deleteImg(m_device, &m_ssaoNoise);
 }
 
@@ -2622,10 +3122,10 @@ void SimpleRender::ClearShadowmaps()
   destroyViews(m_rsmAlbedoViews);
   destroyViews(m_vsmViews);
   
-  vk_utils::deleteImg(m_device, &m_shadowmap);
-  vk_utils::deleteImg(m_device, &m_rsmNormals);
-  vk_utils::deleteImg(m_device, &m_rsmAlbedo);
-  vk_utils::deleteImg(m_device, &m_vsm);
+  m_pAllocator->DestroyImage(&m_shadowmap);
+  m_pAllocator->DestroyImage(&m_rsmNormals);
+  m_pAllocator->DestroyImage(&m_rsmAlbedo);
+  m_pAllocator->DestroyImage(&m_vsm);
 }
 
 void SimpleRender::ClearTransparent()
@@ -2642,11 +3142,13 @@ void SimpleRender::ClearTransparent()
     m_transparentFramebuffer = VK_NULL_HANDLE;
   }
 
-  vk_utils::deleteImg(m_device, &m_transparent);
+  m_pAllocator->DestroyImage(&m_transparent);
 }
 
 void SimpleRender::CreateGBuffer()
 {
+  GpuAllocator::TagScope tag("gbuffer");
+
   auto makeLayer = [this](VkFormat format, VkImageUsageFlagBits usage)
       -> GBufferLayer
     {
@@ -2662,8 +3164,8 @@ void SimpleRender::CreateGBuffer()
         result.image.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
       }
 
-      vk_utils::createImgAllocAndBind(m_device, m_physicalDevice, m_width, m_height,
-        format, usage, &result.image);
+      m_pAllocator->CreateImage(m_width, m_height, format, usage, &result.image,
+        nullptr, nullptr, m_renderTargetPool);
 
       return result;
     };
@@ -2697,13 +3199,16 @@ void SimpleRender::CreateGBuffer()
   VkFormat dformat;
   vk_utils::getSupportedDepthFormat(m_physicalDevice, depthFormats, &dformat);
 
+  // sampled when building the depth pyramid
   m_gbuffer.depth_stencil_layer = makeLayer(dformat,
-    VkImageUsageFlagBits(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT));
+    VkImageUsageFlagBits(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT
+      | VK_IMAGE_USAGE_SAMPLED_BIT));
 
 
   m_gbuffer.resolved.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  vk_utils::createImgAllocAndBind(m_device, m_physicalDevice, m_width, m_height,
-    VK_FORMAT_R16G16B16A16_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, &m_gbuffer.resolved);
+  m_pAllocator->CreateImage(m_width, m_height,
+    VK_FORMAT_R16G16B16A16_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, &m_gbuffer.resolved,
+    nullptr, nullptr, m_renderTargetPool);
 
 
   // Renderpass
@@ -2801,19 +3306,78 @@ void SimpleRender::CreateGBuffer()
       },
     };
 
-    VkRenderPassCreateInfo renderPassInfo {
-      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-      .attachmentCount = static_cast<uint32_t>(attachmentDescs.size()),
-      .pAttachments = attachmentDescs.data(),
-      .subpassCount = static_cast<uint32_t>(subpasses.size()),
-      .pSubpasses = subpasses.data(),
-      .dependencyCount = static_cast<uint32_t>(dependencies.size()),
-      .pDependencies = dependencies.data(),
-    };
+    auto makeRenderPass = [&](std::span<const VkAttachmentDescription> descs,
+      std::span<const VkSubpassDependency> deps, VkRenderPass* renderPass, const char* name)
+      {
+        VkRenderPassCreateInfo renderPassInfo {
+          .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+          .attachmentCount = static_cast<uint32_t>(descs.size()),
+          .pAttachments = descs.data(),
+          .subpassCount = static_cast<uint32_t>(subpasses.size()),
+          .pSubpasses = subpasses.data(),
+          .dependencyCount = static_cast<uint32_t>(deps.size()),
+          .pDependencies = deps.data(),
+        };
 
-    VK_CHECK_RESULT(vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_gbuffer.renderpass))
+        VK_CHECK_RESULT(vkCreateRenderPass(m_device, &renderPassInfo, nullptr, renderPass))
 
-    setObjectName(m_gbuffer.renderpass, VK_DEBUG_REPORT_OBJECT_TYPE_RENDER_PASS_EXT, "Build g-buffer RP");
+        setObjectName(*renderPass, VK_DEBUG_REPORT_OBJECT_TYPE_RENDER_PASS_EXT, name);
+      };
+
+    // Early pass: clears and draws last frame's visible set. Nothing is resolved,
+    // depth is left for the depth pyramid and the main pass.
+    {
+      auto earlyDescs = attachmentDescs;
+      earlyDescs[layers.size()].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+      earlyDescs.back().loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+      earlyDescs.back().storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+      std::array earlyDependencies {
+        dependencies[0],
+        VkSubpassDependency {
+          .srcSubpass = 1,
+          .dstSubpass = VK_SUBPASS_EXTERNAL,
+          .srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+            | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+          // depth pyramid, then the main pass
+          .dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+            | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+          .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+          .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+            | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        },
+      };
+
+      makeRenderPass(earlyDescs, earlyDependencies, &m_gbuffer.earlyRenderpass, "Early g-buffer RP");
+    }
+
+    // Main pass: loads what the early pass drew, adds what the late culling pass found and resolves lighting
+    for (std::size_t i = 0; i < layers.size(); ++i)
+    {
+      attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+      attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    attachmentDescs[layers.size()].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachmentDescs[layers.size()].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    std::array mainDependencies {
+      VkSubpassDependency {
+        .srcSubpass = VK_SUBPASS_EXTERNAL,
+        .dstSubpass = 0,
+        .srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+          | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+          | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+          | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      },
+      dependencies[0],
+      dependencies[1],
+    };
+
+    makeRenderPass(attachmentDescs, mainDependencies, &m_gbuffer.renderpass, "Build g-buffer RP");
   }
 
   // Framebuffer
@@ -2839,17 +3403,71 @@ void SimpleRender::CreateGBuffer()
   VK_CHECK_RESULT(vkCreateFramebuffer(m_device, &fbufCreateInfo, nullptr, &m_mainPassFrameBuffer))
 }
 
+void SimpleRender::CreateDepthPyramid()
+{
+  GpuAllocator::TagScope tag("depth pyramid");
+
+  // power of two, so that every level is exactly half of the previous one
+  m_depthPyramidExtent = VkExtent2D{std::bit_floor(m_width), std::bit_floor(m_height)};
+  const auto levels = static_cast<uint32_t>(
+    std::bit_width(std::max(m_depthPyramidExtent.width, m_depthPyramidExtent.height)));
+
+  VkImageCreateInfo imgInfo{
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType = VK_IMAGE_TYPE_2D,
+    .format = VK_FORMAT_R32_SFLOAT,
+    .extent = VkExtent3D{
+      .width = m_depthPyramidExtent.width,
+      .height = m_depthPyramidExtent.height,
+      .depth = 1,
+    },
+    .mipLevels = levels,
+    .arrayLayers = 1,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+
+  m_depthPyramid.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  m_pAllocator->CreateImage(m_depthPyramidExtent.width, m_depthPyramidExtent.height,
+    imgInfo.format, imgInfo.usage, &m_depthPyramid, &imgInfo, nullptr, m_renderTargetPool);
+
+  // one view per level to write it and read it while building the next one
+  m_depthPyramidMips.resize(levels);
+  for (uint32_t i = 0; i < levels; ++i)
+  {
+    VkImageViewCreateInfo info {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .image = m_depthPyramid.image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = imgInfo.format,
+      .subresourceRange = VkImageSubresourceRange{
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = i,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+      },
+    };
+    VK_CHECK_RESULT(vkCreateImageView(m_device, &info, nullptr, &m_depthPyramidMips[i]))
+  }
+}
+
 void SimpleRender::CreatePostFx()
 {
+  GpuAllocator::TagScope tag("postfx");
+
   m_fogImage.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  vk_utils::createImgAllocAndBind(m_device, m_physicalDevice, m_width / POSTFX_DOWNSCALE_FACTOR, m_height / POSTFX_DOWNSCALE_FACTOR,
+  m_pAllocator->CreateImage(m_width / POSTFX_DOWNSCALE_FACTOR, m_height / POSTFX_DOWNSCALE_FACTOR,
     VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-    &m_fogImage);
+    &m_fogImage, nullptr, nullptr, m_renderTargetPool);
 
   m_ssaoImage.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  vk_utils::createImgAllocAndBind(m_device, m_physicalDevice, m_width / POSTFX_DOWNSCALE_FACTOR, m_height / POSTFX_DOWNSCALE_FACTOR,
+  m_pAllocator->CreateImage(m_width / POSTFX_DOWNSCALE_FACTOR, m_height / POSTFX_DOWNSCALE_FACTOR,
     VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-    &m_ssaoImage);
+    &m_ssaoImage, nullptr, nullptr, m_renderTargetPool);
 
   {
     std::vector<glm::vec2> ssaoNoise(SSAO_NOISE_DIM * SSAO_NOISE_DIM);
@@ -2861,6 +3479,7 @@ void SimpleRender::CreatePostFx()
     m_ssaoNoise = vk_utils::allocateColorTextureFromDataLDR(m_device, m_physicalDevice,
       reinterpret_cast<const unsigned char*>(ssaoNoise.data()), SSAO_NOISE_DIM, SSAO_NOISE_DIM,
       1, VK_FORMAT_R8G8_SNORM, m_pScnMgr->GetCopyHelper());
+    m_pAllocator->TrackImage(m_ssaoNoise.image);
   }
   
 
@@ -3072,8 +3691,8 @@ void SimpleRender::CreateStackedTexture(vk_utils::VulkanImageMem& mem,
     },
   };
   
-  vk_utils::createImgAllocAndBind(m_device, m_physicalDevice, SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION,
-    format, 0, &mem, &imgInfo, &viewInfo);
+  m_pAllocator->CreateImage(SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION,
+    format, 0, &mem, &imgInfo, &viewInfo, m_renderTargetPool);
 
   for (size_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; ++i)
   {
@@ -3102,9 +3721,19 @@ void SimpleRender::CreateShadowmaps()
   auto vsmFormat = VK_FORMAT_R32G32_SFLOAT;
 
   {
+    GpuAllocator::TagScope tag("shadow depth");
     CreateStackedTexture(m_shadowmap, m_cascadeViews, format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+  }
+  {
+    GpuAllocator::TagScope tag("rsm normals");
     CreateStackedTexture(m_rsmNormals, m_rsmNormalViews, rsmNormalsFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+  }
+  {
+    GpuAllocator::TagScope tag("rsm albedo");
     CreateStackedTexture(m_rsmAlbedo, m_rsmAlbedoViews, rsmAlbedoFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+  }
+  {
+    GpuAllocator::TagScope tag("vsm");
     CreateStackedTexture(m_vsm, m_vsmViews, vsmFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
   }
 
@@ -3273,8 +3902,12 @@ void SimpleRender::CreateTransparent()
 {
   auto transparentFormat = VK_FORMAT_R16G16B16A16_UNORM;
   m_transparent.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  vk_utils::createImgAllocAndBind(m_device, m_physicalDevice, m_width, m_height,
-    transparentFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &m_transparent);
+  {
+    GpuAllocator::TagScope tag("transparent");
+    m_pAllocator->CreateImage(m_width, m_height,
+      transparentFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &m_transparent,
+      nullptr, nullptr, m_renderTargetPool);
+  }
 
   {
     std::array attachmentDescs{
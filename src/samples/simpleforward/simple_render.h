@@ -4,6 +4,7 @@
 #define VK_NO_PROTOTYPES
 
 #include "../../render/scene_mgr.h"
+#include "../../render/gpu_allocator.h"
 #include "../../render/render_common.h"
 #include "../../render/render_gui.h"
 #include "../../../resources/shaders/common.h"
@@ -25,6 +26,10 @@ struct GBuffer
   GBufferLayer depth_stencil_layer;
   // pre-postfx resolved gbuffer
   vk_utils::VulkanImageMem resolved;
+  // Same attachments and subpasses, so pipelines and the framebuffer work with both.
+  // The early one clears and leaves depth readable for the depth pyramid,
+  // the main one loads what the early one drew and resolves lighting.
+  VkRenderPass earlyRenderpass{VK_NULL_HANDLE};
   VkRenderPass renderpass{VK_NULL_HANDLE};
 };
 
@@ -40,6 +45,7 @@ struct SceneGeometryPipeline
 class SimpleRender : public IRender
 {
   static constexpr char const* STATIC_MESH_VERTEX_SHADER_PATH = "../resources/shaders/geometry/static_mesh.vert";
+  static constexpr char const* STATIC_MESH_COMPACT_VERTEX_SHADER_PATH = "../resources/shaders/geometry/static_mesh_compact.vert";
   static constexpr char const* WRITE_GBUF_FRAGMENT_SHADER_PATH = "../resources/shaders/geometry/write_gbuffer.frag";
 
   static constexpr char const* WRITE_RSM_FRAGMENT_SHADER_PATH = "../resources/shaders/geometry/rsm.frag";
@@ -70,13 +76,24 @@ class SimpleRender : public IRender
   static constexpr char const* WIREFRAME_FRAGMENT_SHADER_PATH = "../resources/shaders/geometry/wireframe.frag";
 
   static constexpr char const* CULLING_SHADER_PATH = "../resources/shaders/culling.comp";
+  static constexpr char const* CULLING_PREFIX_SHADER_PATH = "../resources/shaders/culling_prefix.comp";
+  static constexpr char const* CULLING_SCATTER_SHADER_PATH = "../resources/shaders/culling_scatter.comp";
+  static constexpr char const* DEPTH_PYRAMID_SHADER_PATH = "../resources/shaders/depth_pyramid.comp";
   static constexpr char const* LANDSCAPE_CULLING_SHADER_PATH = "../resources/shaders/landscape_culling.comp";
+  static constexpr char const* LANDSCAPE_CULLING_ARGS_SHADER_PATH = "../resources/shaders/landscape_culling_args.comp";
   
   static constexpr char const* PARTICLE_VERT_SHADER_PATH = "../resources/shaders/forward/particle.vert";
   static constexpr char const* PARTICLE_FRAG_SHADER_PATH = "../resources/shaders/forward/particle.frag";
   static constexpr char const* PARTICLE_COMP_SHADER_PATH = "../resources/shaders/forward/particle.comp";
 
 
+  // GROUP_SIZE in culling.glsl
+  static constexpr uint32_t CULLING_GROUP_SIZE = 256;
+  // GROUP_SIZE in depth_pyramid.comp
+  static constexpr uint32_t DEPTH_PYRAMID_GROUP_SIZE = 8;
+  // GROUP_SIZE in landscape_culling.glsl, in both dimensions
+  static constexpr uint32_t LANDSCAPE_CULLING_GROUP_SIZE = 16;
+
   static constexpr uint32_t POSTFX_DOWNSCALE_FACTOR = 4;
 
   static constexpr uint32_t SSAO_KERNEL_SIZE = 64;
@@ -111,8 +128,16 @@ public:
   void UpdateCamera(const Camera* cams, uint32_t a_camsCount) override;
   Camera GetCurrentCamera() override {return m_cam;}
   void UpdateView();
+  void UpdateCullingCounts();
 
+  // 16 byte quantized vertices instead of Mesh8F, has to be set before LoadScene
+  void SetCompactVertices(bool compact) { m_compactVertices = compact; }
+  void SetOptimizeMeshes(bool optimize) { m_optimizeMeshes = optimize; }
   void LoadScene(const char *path, bool transpose_inst_matrices) override;
+  // applies a hydra change_*.xml on top of the loaded scene, see SceneManager::ApplySceneChange
+  void ApplySceneChange(const char *path, bool transpose_inst_matrices);
+  // queued changes are applied one per press of N, in the order they were queued
+  void QueueSceneChange(const char *path) { m_sceneChanges.emplace_back(path); }
   void DrawFrame(float a_time, DrawMode a_mode) override;
 
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -213,12 +238,14 @@ protected:
   UniformParams m_uniforms {};
   VkBuffer m_ubo = VK_NULL_HANDLE;
   VkBuffer m_shadowmapUbo = VK_NULL_HANDLE;
-  VkDeviceMemory m_uboAlloc = VK_NULL_HANDLE;
+  GpuAllocation m_uboAlloc;
   void* m_uboMappedMem = nullptr;
   void* m_shadowmapUboMappedMem = nullptr;
   void* m_particlesUboMappedMem = nullptr;
 
-  VkDeviceMemory m_indirectRenderingMemory = VK_NULL_HANDLE;
+  GpuAllocation m_indirectRenderingMemory;
+  // per view culling outputs, sized by the scene capacity
+  GpuAllocation m_cullingBuffersMemory;
   
   VkSampler m_landscapeHeightmapSampler;
   VkSampler m_shadowmapSampler;
@@ -232,17 +259,31 @@ protected:
   pipeline_data_t m_ambientLightingPipeline {};
   pipeline_data_t m_vsmPipeline {};
 
+  // static meshes are culled in three passes, see culling.glsl
   pipeline_data_t m_cullingPipeline {};
+  pipeline_data_t m_cullingPrefixPipeline {};
+  pipeline_data_t m_cullingScatterPipeline {};
   pipeline_data_t m_landscapeCullingPipeline {};
+  pipeline_data_t m_landscapeCullingArgsPipeline {};
+  pipeline_data_t m_depthPyramidPipeline {};
 
   VkDescriptorSet m_graphicsDescriptorSet = VK_NULL_HANDLE;
   VkDescriptorSetLayout m_graphicsDescriptorSetLayout = VK_NULL_HANDLE;
 
+  // CULL_PASS_* in culling.glsl
+  enum class CullPass : uint32_t
+  {
+    All = 0,
+    Early = 1,
+    Late = 2,
+  };
+
   struct CullingPushConstants
   {
     glm::mat4 projView;
     uint32_t instanceCount;
     uint32_t modelCount;
+    CullPass pass;
   };
 
   struct LandscapeCullingPushConstants
@@ -257,6 +298,9 @@ protected:
 
     VkBuffer indirectDrawBuffer = VK_NULL_HANDLE;
     VkBuffer instanceMappingBuffer = VK_NULL_HANDLE;
+    // per model counts, then range starts, and per instance slots, only used between the culling passes
+    VkBuffer modelRangesBuffer = VK_NULL_HANDLE;
+    VkBuffer instanceSlotsBuffer = VK_NULL_HANDLE;
     VkDescriptorSet cullingOutputDescriptorSet = VK_NULL_HANDLE;
     VkDescriptorSet staticMeshVisDescSet = VK_NULL_HANDLE;
 
@@ -277,6 +321,19 @@ protected:
   VkDescriptorSetLayout m_cullingSceneDescriptorSetLayout = VK_NULL_HANDLE;
   VkDescriptorSetLayout m_cullingOutputDescriptorSetLayout = VK_NULL_HANDLE;
 
+  // Hi-Z occlusion culling of the main view
+  bool m_occlusionCulling = true;
+  bool m_resetVisibilityHistory = true;
+  VkBuffer m_visibilityHistoryBuffer = VK_NULL_HANDLE;
+  vk_utils::VulkanImageMem m_depthPyramid;
+  VkExtent2D m_depthPyramidExtent {};
+  std::vector<VkImageView> m_depthPyramidMips;
+  VkSampler m_depthPyramidSampler = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> m_depthPyramidDescriptorSets;
+  VkDescriptorSetLayout m_depthPyramidDescriptorSetLayout = VK_NULL_HANDLE;
+  VkDescriptorSet m_occlusionDescriptorSet = VK_NULL_HANDLE;
+  VkDescriptorSetLayout m_occlusionDescriptorSetLayout = VK_NULL_HANDLE;
+
   std::vector<VkDescriptorSet> m_landscapeCullingSceneDescriptorSets;
   VkDescriptorSetLayout m_landscapeCullingSceneDescriptorSetLayout = VK_NULL_HANDLE;
   VkDescriptorSetLayout m_landscapeCullingOutputDescriptorSetLayout = VK_NULL_HANDLE;
@@ -304,14 +361,23 @@ protected:
   std::unique_ptr<IRenderGUI> m_pGUIRender;
   virtual void SetupGUIElements();
   void DrawFrameWithGUI();
+  // per tag and per heap memory use, see GpuAllocator::TagScope
+  void SetupMemoryPanel();
+  void DumpMemoryStats(const char* a_path);
+  bool m_showMemoryPanel = false;
+  std::string m_memoryDumpStatus;
   //
 
   Camera   m_cam;
   uint32_t m_width  = 1024u;
   uint32_t m_height = 1024u;
   uint32_t m_framesInFlight  = 2u;
+  // scene uploads the frame being recorded took over, its submission waits for them
+  uint64_t m_uploadWaitValue = 0u;
   bool m_vsync = false;
   bool m_wireframe = false;
+  bool m_compactVertices = false;
+  bool m_optimizeMeshes = false;
   bool m_pointLights = true;
   bool m_shadows = true;
   bool m_ssao = true;
@@ -335,14 +401,25 @@ protected:
 
   VkPhysicalDeviceFeatures m_enabledDeviceFeatures = {};
   VkPhysicalDeviceDescriptorIndexingFeatures m_enabledDeviceDescriptorIndexingFeatures = {};
+  VkPhysicalDeviceTimelineSemaphoreFeatures m_enabledTimelineSemaphoreFeatures = {};
   std::vector<const char*> m_deviceExtensions      = {};
   std::vector<const char*> m_optionalDeviceExtensions = {};
+  bool m_memoryBudgetEnabled = false;
   std::vector<const char*> m_instanceExtensions    = {};
 
   bool m_enableValidation;
   std::vector<const char*> m_validationLayers;
 
+  // everything but vk_utils internals and ImGui takes its memory from here, shared with m_pScnMgr
+  std::shared_ptr<GpuAllocator> m_pAllocator;
+  // screen sized targets and shadow maps, all recreated together on resize
+  GpuAllocator::PoolId m_renderTargetPool = GpuAllocator::GENERAL_POOL;
   std::unique_ptr<SceneManager> m_pScnMgr;
+  uint32_t m_loadedMeshes = 0;
+  uint32_t m_totalMeshes  = 0;
+  uint32_t m_sceneBuffersGeneration = 0;
+  std::vector<std::string> m_sceneChanges;
+  std::size_t m_nextSceneChange = 0;
 
   GBuffer m_gbuffer;
 
@@ -449,8 +526,9 @@ protected:
 
   void RecordFrameCommandBuffer(VkCommandBuffer cmdBuff, uint32_t swapchainIdx);
 
-  void RecordStaticMeshCulling(VkCommandBuffer cmdBuff, VisibilityInfo& visInfo);
+  void RecordStaticMeshCulling(VkCommandBuffer cmdBuff, VisibilityInfo& visInfo, CullPass pass = CullPass::All);
   void RecordLandscapeCulling(VkCommandBuffer cmdBuff, VisibilityInfo& visInfo);
+  void RecordDepthPyramid(VkCommandBuffer cmdBuff);
 
   void RecordStaticMeshRendering(VkCommandBuffer a_cmdBuff, VisibilityInfo& visInfo, bool depthOnly);
   void RecordLandscapeRendering(VkCommandBuffer a_cmdBuff, VisibilityInfo& visInfo, bool depthOnly);
@@ -463,11 +541,16 @@ protected:
   void SetupLightingPipeline();
   void SetupPostfxPipeline();
   void SetupCullingPipeline();
+  void SetupDepthPyramidPipeline();
   void SetupParticlePipeline();
   void CleanupPipelineAndSwapchain();
   void RecreateSwapChain();
 
   void CreateUniformBuffer();
+  void CreateCullingBuffers();
+  void DestroyCullingBuffers();
+  // rebuilds what is sized by or bound to the scene buffers once m_pScnMgr recreated them
+  void FollowSceneBuffers();
   void UpdateUniformBuffer(float a_time);
 
   void Cleanup();
@@ -477,11 +560,13 @@ protected:
   void SetupValidationLayers();
 
   void ClearGBuffer();
+  void ClearDepthPyramid();
   void ClearPostFx();
   void ClearShadowmaps();
   void ClearTransparent();
 
   void CreateGBuffer();
+  void CreateDepthPyramid();
   void CreatePostFx();
   void CreateShadowmaps();
   void CreateTransparent();
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+// Read-only view of a whole file mapped into the address space.
+// An empty or missing file yields a closed mapping (IsOpen() == false).
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string& path);
+  ~MappedFile() { Close(); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  bool IsOpen() const { return m_data != nullptr; }
+
+  const std::byte* Data() const { return m_data; }
+  std::size_t Size() const { return m_size; }
+
+  void Close();
+
+private:
+  const std::byte* m_data = nullptr;
+  std::size_t m_size = 0;
+
+#if defined(_WIN32)
+  void* m_file = nullptr;
+  void* m_mapping = nullptr;
+#endif
+};
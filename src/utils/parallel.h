@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+inline std::size_t defaultWorkerCount()
+{
+  return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+// Calls f(i) for every i in [0, count) on up to threadCount threads (the caller included).
+// Items are handed out one by one, so uneven work balances itself.
+// The first exception thrown by f is rethrown on the calling thread after all workers finish.
+template<typename F>
+void parallelFor(std::size_t count, std::size_t threadCount, F&& f)
+{
+  threadCount = std::clamp<std::size_t>(threadCount, 1, std::max<std::size_t>(count, 1));
+  if (threadCount == 1)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+      f(i);
+    return;
+  }
+
+  std::atomic<std::size_t> next{0};
+  std::exception_ptr error;
+  std::mutex errorMutex;
+
+  auto worker = [&]() {
+    for (std::size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+    {
+      try
+      {
+        f(i);
+      }
+      catch (...)
+      {
+        std::lock_guard lock(errorMutex);
+        if (!error)
+          error = std::current_exception();
+        next = count;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(threadCount - 1);
+  for (std::size_t t = 1; t < threadCount; ++t)
+    workers.emplace_back(worker);
+  worker();
+  for (auto& thread : workers)
+    thread.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}